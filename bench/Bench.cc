@@ -0,0 +1,120 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "Bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include <boost/filesystem.hpp>
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+static vector<Benchmark *> & get_registry() {
+    // Function local, as the benchmarks register themselves during static initialization
+    static vector<Benchmark *> registry;
+    return registry;
+}
+
+Benchmark::Benchmark(const string &name, const string &description, FUNCTION function) : name(name), description(description), function(function) {
+    get_registry().push_back(this);
+}
+
+vector<Benchmark *> Benchmark::get_all() {
+    vector<Benchmark *> all = get_registry();
+    sort(all.begin(), all.end(), [](Benchmark *a, Benchmark *b) { return a->name < b->name; });
+    return all;
+}
+
+void Benchmark::write_plate(const string &filename, int copies, int layers) {
+    FILE *file = fopen(filename.c_str(), "w");
+    if (!file)
+        return;
+
+    fprintf(file, "; %d copies\nM104 S200\nG28\nG90\nM82\nG92 E0\n", copies);
+    int columns = (int)ceil(sqrt((double)copies));
+    for (int layer = 0; layer < layers; layer++) {
+        fprintf(file, ";LAYER:%d\nG1 Z%.3f F7800\nG92 E0\n", layer, 0.3 + layer * 0.2);
+        double e = 0.0;
+        for (int copy = 0; copy < copies; copy++) {
+            double cx = 30.0 + (copy % columns) * 45.5, cy = 30.0 + (copy / columns) * 45.5;
+            fprintf(file, "G1 E%.5f F2400\nG1 X%.3f Y%.3f F7800\nG1 E%.5f F2400\n", e - 1.5, cx + 15.0, cy, e);
+
+            // Perimeters
+            fprintf(file, "G1 F1800\n");
+            double px = cx + 15.0, py = cy;
+            for (int wall = 0; wall < 2; wall++) {
+                double r = 15.0 - wall * 0.45;
+                for (int i = 1; i <= 64; i++) {
+                    double angle = 2.0 * M_PI * i / 64, x = cx + r * cos(angle), y = cy + r * sin(angle);
+                    e += hypot(x - px, y - py) * 0.033;
+                    fprintf(file, "G1 X%.3f Y%.3f E%.5f\n", x, y, e);
+                    px = x;
+                    py = y;
+                }
+            }
+
+            // Infill, vertical and horizontal on alternating layers
+            fprintf(file, ";TYPE:FILL\nG1 F3000\n");
+            for (int i = -24; i <= 24; i += 2) {
+                double offset = i * 0.5, half = sqrt(13.5 * 13.5 - offset * offset), start = (i / 2) % 2 ? half : -half;
+                double x1 = cx + offset, y1 = cy + start, x2 = cx + offset, y2 = cy - start;
+                if (layer % 2) {
+                    x1 = cx + start;
+                    x2 = cx - start;
+                    y1 = y2 = cy + offset;
+                }
+                e += hypot(x1 - px, y1 - py) * 0.01;
+                fprintf(file, "G1 X%.3f Y%.3f E%.5f\n", x1, y1, e);
+                e += hypot(x2 - x1, y2 - y1) * 0.033;
+                fprintf(file, "G1 X%.3f Y%.3f E%.5f ; infill\n", x2, y2, e);
+                px = x2;
+                py = y2;
+            }
+        }
+    }
+    fprintf(file, "M104 S0\nG28 X0\n");
+    fclose(file);
+}
+
+vector<string> Benchmark::make_corpus(const string &folder) {
+    const int copies[] = { 1, 9, 25 };
+    vector<string> files;
+    for (int count : copies) {
+        string filename = (fs::path(folder) / ("plate-" + to_string(count) + ".gcode")).string();
+        write_plate(filename, count, 250);
+        files.push_back(filename);
+    }
+    return files;
+}
+
+Config Benchmark::get_config(MotionModel model) {
+    // Loading a file that does not exist gives the defaults
+    Config config ((string()));
+    config.motion_model = model;
+    return config;
+}
+
+string Benchmark::get_name(const string &filename) {
+    return fs::path(filename).filename().string();
+}
@@ -0,0 +1,74 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __BENCH_BENCH_H__
+#define __BENCH_BENCH_H__
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Config.h"
+
+// A benchmark of gcodetimer-bench. Every benchmark file defines a static instance, which registers
+// it. The function gets the gcode files to run on, which are the synthetic corpus of
+// make_corpus() unless files are given on the command line
+class Benchmark {
+public:
+    typedef void (*FUNCTION)(const std::vector<std::string> &inputs);
+
+    std::string name, description;
+    FUNCTION function;
+
+    Benchmark(const std::string &name, const std::string &description, FUNCTION function);
+
+    // Returns all benchmarks in the order of their names
+    static std::vector<Benchmark *> get_all();
+
+    // Returns the shortest wall time of several runs of operation in seconds
+    template <class Operation> static double measure(int repetitions, Operation operation) {
+        double best = 0.0;
+        for (int i = 0; i < repetitions; i++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            operation();
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (i == 0 || elapsed < best)
+                best = elapsed;
+        }
+        return best;
+    }
+
+    // Writes a plate of copies identical parts (two circular perimeters and a rectilinear infill
+    // per layer) with a retraction and a travel between them
+    static void write_plate(const std::string &filename, int copies, int layers);
+
+    // Writes plates of 1, 9 and 25 copies to the folder and returns their names
+    static std::vector<std::string> make_corpus(const std::string &folder);
+
+    // Returns the default config with the given motion model, so that results do not depend on the
+    // config of the user
+    static Config get_config(MotionModel model = MOTION_CLASSIC_JERK);
+
+    // Returns the file name without its folder
+    static std::string get_name(const std::string &filename);
+};
+
+#endif //__BENCH_BENCH_H__
@@ -0,0 +1,91 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Compares the kinematics instantiated with the baked profile (see BakedProfile.h.in) with the
+// ones reading the same values from the config at run time. Only available in builds configured
+// with GCODETIMER_PROFILE
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Bench.h"
+#include "GCodeTimeEstimator.h"
+#include "Kinematics.h"
+#include "MoveTable.h"
+
+using namespace std;
+
+#ifdef GCODETIMER_BAKED_PROFILE
+// Runs the parse loop with a given kinematics instance instead of the one of the config
+class PolicyEstimator : public GCodeTimeEstimator {
+public:
+    PolicyEstimator(istream *input, const Config &config) : GCodeTimeEstimator(input, config) {}
+
+    template <class K> void process_with_kinematics(K &kinematics) {
+        estimated_time = 0.0;
+        process_input(kinematics);
+    }
+};
+
+template <class Parameters> static void time_parameters(const vector<MOVE> &moves, const string &input, const Config &config,
+                                                         double &moves_time, double &file_time, double &total) {
+    moves_time = Benchmark::measure(5, [&]() {
+        with_parameters<Parameters>(config, config.motion_model, [&](auto &kinematics) {
+            total = 0.0;
+            for (vector<MOVE>::const_iterator it = moves.begin(); it != moves.end(); ++it)
+                total += kinematics.get_move_duration(it->movement, it->rate);
+        });
+    });
+    file_time = Benchmark::measure(3, [&]() {
+        ifstream file (input);
+        PolicyEstimator estimator (&file, config);
+        with_parameters<Parameters>(config, config.motion_model, [&](auto &kinematics) { estimator.process_with_kinematics(kinematics); });
+    });
+}
+
+static void run(const vector<string> &inputs) {
+    // The default config of a baked build is the profile
+    const Config &config = *Config::get();
+    for (const string &input : inputs) {
+        MoveTable table (input);
+        table.load();
+        const vector<MOVE> &moves = table.get_moves();
+        double ns_per_move = 1e9 / moves.size();
+
+        double baked_moves, baked_file, baked_total, runtime_moves, runtime_file, runtime_total;
+        time_parameters<BakedProfile>(moves, input, config, baked_moves, baked_file, baked_total);
+        time_parameters<ConfigParameters>(moves, input, config, runtime_moves, runtime_file, runtime_total);
+
+        printf("%s: moves only %.2f ns/move baked, %.2f ns/move from the config (%+.1f%%), with parsing %.2f ns/move baked, %.2f ns/move from the config (%+.1f%%)%s\n",
+               Benchmark::get_name(input).c_str(), baked_moves * ns_per_move, runtime_moves * ns_per_move, 100.0 * (baked_moves - runtime_moves) / runtime_moves,
+               baked_file * ns_per_move, runtime_file * ns_per_move, 100.0 * (baked_file - runtime_file) / runtime_file,
+               baked_total == runtime_total ? "" : ", totals differ");
+    }
+}
+#else
+static void run(const vector<string> &) {
+    printf("This build has no baked profile, configure it with -DGCODETIMER_PROFILE=<config file>\n");
+}
+#endif
+
+static Benchmark benchmark ("baked_profile", "Time per move with the baked profile and with the same values read at run time", run);
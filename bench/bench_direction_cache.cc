@@ -0,0 +1,82 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Hit rate, time per move and deviation of the direction cache (see DirectionCache.h) for a few
+// tolerances and table sizes, on inputs read into memory so that only the estimate is measured
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "AsyncIO.h"
+#include "Bench.h"
+#include "DirectionCache.h"
+#include "GCodeTimeEstimator.h"
+
+using namespace std;
+
+static float estimate(const vector<char> &contents, const Config &config, DirectionCache *cache) {
+    MemoryInputBuffer buffer (contents);
+    istream input (&buffer);
+    GCodeTimeEstimator estimator (&input, config);
+    if (cache)
+        estimator.set_direction_cache(cache);
+    estimator.process_file();
+    return estimator.get_estimated_time();
+}
+
+static void run(const vector<string> &inputs) {
+    const float tolerances[] = { 0.0f, 0.0001f, 0.01f };
+    const size_t entry_counts[] = { DirectionCache::DEFAULT_ENTRIES, 256 };
+    Config config = Benchmark::get_config(MOTION_CLASSIC_JERK);
+
+    for (const string &input : inputs) {
+        ifstream file (input, ios::binary);
+        vector<char> contents ((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+        float exact_time = 0.0;
+        uint64_t moves = 0;
+        double exact = Benchmark::measure(3, [&]() { exact_time = estimate(contents, config, NULL); });
+
+        for (float tolerance : tolerances) {
+            for (size_t entry_count : entry_counts) {
+                float cached_time = 0.0;
+                uint64_t hits = 0;
+                double cached = Benchmark::measure(3, [&]() {
+                    DirectionCache cache (tolerance, entry_count);
+                    cached_time = estimate(contents, config, &cache);
+                    hits = cache.get_hits();
+                    moves = cache.get_hits() + cache.get_misses();
+                });
+                if (moves == 0)
+                    continue;
+
+                printf("%s, tolerance %g, %zu entries: %.1f ns/move exact, %.1f ns/move cached (%+.1f%%), %.1f%% of %llu moves hit, deviation %+.5f%%\n",
+                       Benchmark::get_name(input).c_str(), tolerance, entry_count, 1e9 * exact / moves, 1e9 * cached / moves,
+                       100.0 * (cached - exact) / exact, 100.0 * hits / moves, (unsigned long long)moves, 100.0 * (cached_time - exact_time) / exact_time);
+            }
+        }
+    }
+}
+
+static Benchmark benchmark ("direction_cache", "Hit rate, time per move and deviation of --direction-cache", run);
@@ -0,0 +1,133 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Compares the motion model policies of Kinematics.h, which select the model once per file, with
+// selecting it on every move and with reading the parameters from the config on every move
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Bench.h"
+#include "GCodeTimeEstimator.h"
+#include "Kinematics.h"
+#include "MoveTable.h"
+
+using namespace std;
+
+static const char * const MODEL_NAMES[] = { "classic_jerk", "junction_deviation", "square_corner_velocity" };
+
+// Reads every parameter from the config when it is used, like the classic jerk formula did when it
+// was written out in the parse loop
+class ConfigReadParameters {
+protected:
+    const Config *config;
+    COORDS effective_print_accel_value, effective_move_accel_value;
+
+public:
+    explicit ConfigReadParameters(const Config &config) : config(&config),
+        effective_print_accel_value(Utils::map(config.max_print_accel, [&](float c) { return c * config.accel_efficiency; })),
+        effective_move_accel_value(Utils::map(config.max_move_accel, [&](float c) { return c * config.accel_efficiency; })) {}
+
+    inline const COORDS & max_print_accel() const { return config->max_print_accel; }
+    inline const COORDS & max_move_accel() const { return config->max_move_accel; }
+    inline const COORDS & max_jerk() const { return config->max_jerk; }
+    inline float jerk_efficiency() const { return config->jerk_efficiency; }
+    inline float accel_efficiency() const { return config->accel_efficiency; }
+    inline float speed_multiplier() const { return config->speed_multiplier; }
+    inline float junction_deviation() const { return config->junction_deviation; }
+    inline float square_corner_velocity() const { return config->square_corner_velocity; }
+    inline const COORDS & effective_print_accel() const { return effective_print_accel_value; }
+    inline const COORDS & effective_move_accel() const { return effective_move_accel_value; }
+};
+
+// Selects the model with a switch on every move
+class SwitchingKinematics {
+protected:
+    MotionModel model;
+    ClassicJerkKinematics classic_jerk;
+    JunctionDeviationKinematics junction_deviation;
+    SquareCornerVelocityKinematics square_corner_velocity;
+
+public:
+    explicit SwitchingKinematics(const Config &config) : model(config.motion_model), classic_jerk(config), junction_deviation(config),
+        square_corner_velocity(config) {}
+
+    inline float get_move_duration(const COORDS &movement, float rate) {
+        switch (model) {
+            case MOTION_JUNCTION_DEVIATION: return junction_deviation.get_move_duration(movement, rate);
+            case MOTION_SQUARE_CORNER_VELOCITY: return square_corner_velocity.get_move_duration(movement, rate);
+            default: return classic_jerk.get_move_duration(movement, rate);
+        }
+    }
+};
+
+template <class K> static double sum_durations(const vector<MOVE> &moves, K &kinematics) {
+    double total = 0.0;
+    for (vector<MOVE>::const_iterator it = moves.begin(); it != moves.end(); ++it)
+        total += kinematics.get_move_duration(it->movement, it->rate);
+    return total;
+}
+
+static void run(const vector<string> &inputs) {
+    for (const string &input : inputs) {
+        MoveTable table (input);
+        table.load();
+        const vector<MOVE> &moves = table.get_moves();
+        double ns_per_move = 1e9 / moves.size();
+
+        for (int model = MOTION_CLASSIC_JERK; model <= MOTION_SQUARE_CORNER_VELOCITY; model++) {
+            Config config = Benchmark::get_config((MotionModel)model);
+            double policy_total = 0.0, switching_total = 0.0, read_total = 0.0;
+
+            double policy = Benchmark::measure(5, [&]() {
+                with_kinematics(config, [&](auto &kinematics) { policy_total = sum_durations(moves, kinematics); });
+            });
+            double switching = Benchmark::measure(5, [&]() {
+                SwitchingKinematics kinematics (config);
+                switching_total = sum_durations(moves, kinematics);
+            });
+            double parsing = Benchmark::measure(3, [&]() {
+                ifstream file (input);
+                GCodeTimeEstimator estimator (&file, config);
+                estimator.process_file();
+            });
+
+            printf("%s %s: %.2f ns/move as policy, %.2f ns/move switching per move", Benchmark::get_name(input).c_str(), MODEL_NAMES[model],
+                   policy * ns_per_move, switching * ns_per_move);
+            if (model == MOTION_CLASSIC_JERK) {
+                double read = Benchmark::measure(5, [&]() {
+                    BasicClassicJerkKinematics<ConfigReadParameters> kinematics (config);
+                    read_total = sum_durations(moves, kinematics);
+                });
+                printf(", %.2f ns/move reading the config", read * ns_per_move);
+                if (read_total != policy_total)
+                    printf(" (differs)");
+            }
+            printf(", %.2f ns/move with parsing, %zu moves\n", parsing * ns_per_move, moves.size());
+            if (switching_total != policy_total)
+                printf("  switching total %.3f s differs from %.3f s\n", switching_total, policy_total);
+        }
+    }
+}
+
+static Benchmark benchmark ("kinematics", "Time per move of each motion model, as policy and selected per move", run);
@@ -0,0 +1,55 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Measures what writing the per move records (see MoveExportWriter.h) adds to the estimate
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "Bench.h"
+#include "FileProcessor.h"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+static void run(const vector<string> &inputs) {
+    Config config = Benchmark::get_config();
+    FileProcessor processor (EmissionPolicy(), false, NULL, false, false, false, -1.0, config);
+    fs::path export_path = fs::temp_directory_path() / fs::unique_path("gcodetimer-bench-%%%%-%%%%.moves");
+
+    for (const string &input : inputs) {
+        float plain_time = 0.0, export_time = 0.0;
+        FILE_COUNTS counts;
+        double plain = Benchmark::measure(5, [&]() { processor.estimate(input, plain_time, string(), string(), &counts); });
+        double exported = Benchmark::measure(5, [&]() { processor.estimate(input, export_time, export_path.string()); });
+
+        printf("%s: %.1f ms without export, %.1f ms with export (%+.1f%%), %.1f MB for %llu moves%s\n", Benchmark::get_name(input).c_str(),
+               plain * 1000, exported * 1000, 100.0 * (exported - plain) / plain, fs::file_size(export_path) / 1e6, (unsigned long long)counts.moves,
+               plain_time == export_time ? "" : ", estimates differ");
+    }
+
+    fs::remove(export_path);
+}
+
+static Benchmark benchmark ("move_export", "Estimation time with and without the columnar move export", run);
@@ -0,0 +1,75 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Hit rate, speedup and deviation of the move memo (see MoveMemo.h), with the default size and
+// with a memo small enough to evict on the larger plates
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Bench.h"
+#include "GCodeTimeEstimator.h"
+#include "MoveMemo.h"
+
+using namespace std;
+
+static const char * const MODEL_NAMES[] = { "classic_jerk", "junction_deviation", "square_corner_velocity" };
+
+static void run(const vector<string> &inputs) {
+    const size_t sizes[] = { MoveMemo::DEFAULT_SIZE, 64 * 1024 };
+    for (int model = MOTION_CLASSIC_JERK; model <= MOTION_SQUARE_CORNER_VELOCITY; model++) {
+        Config config = Benchmark::get_config((MotionModel)model);
+        for (const string &input : inputs) {
+            float exact_time = 0.0;
+            double exact = Benchmark::measure(3, [&]() {
+                ifstream file (input);
+                GCodeTimeEstimator estimator (&file, config);
+                estimator.process_file();
+                exact_time = estimator.get_estimated_time();
+            });
+
+            for (size_t size : sizes) {
+                float memo_time = 0.0;
+                uint64_t hits = 0, misses = 0;
+                double memoized = Benchmark::measure(3, [&]() {
+                    ifstream file (input);
+                    MoveMemo memo (size);
+                    GCodeTimeEstimator estimator (&file, config);
+                    estimator.set_memo(&memo);
+                    estimator.process_file();
+                    memo_time = estimator.get_estimated_time();
+                    hits = memo.get_hits();
+                    misses = memo.get_misses();
+                });
+
+                printf("%s %s, %zu KB memo: %.1f ms exact, %.1f ms memoized (%.2fx), %llu of %llu sequences hit (%.1f%%), deviation %+.5f%%\n",
+                       Benchmark::get_name(input).c_str(), MODEL_NAMES[model], size / 1024, exact * 1000, memoized * 1000, exact / memoized,
+                       (unsigned long long)hits, (unsigned long long)(hits + misses), hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0,
+                       100.0 * (memo_time - exact_time) / exact_time);
+            }
+        }
+    }
+}
+
+static Benchmark benchmark ("move_memo", "Hit rate, speedup and deviation of --memo on multi-copy plates", run);
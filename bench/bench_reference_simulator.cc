@@ -0,0 +1,63 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Simulation speed of the reference engine (see ReferenceSimulator.h) per motion model, and how far
+// the estimate of each plate is from it
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Bench.h"
+#include "MoveTable.h"
+#include "ReferenceSimulator.h"
+
+using namespace std;
+
+static const char * const MODEL_NAMES[] = { "classic_jerk", "junction_deviation", "square_corner_velocity" };
+
+static void run(const vector<string> &inputs) {
+    for (const string &input : inputs) {
+        MoveTable table (input);
+        table.load();
+
+        for (int model = MOTION_CLASSIC_JERK; model <= MOTION_SQUARE_CORNER_VELOCITY; model++) {
+            Config config = Benchmark::get_config((MotionModel)model);
+            vector<float> durations (table.size());
+            double reference_time = 0.0;
+            uint64_t dropped = 0, steps = 0, interrupts = 0;
+            double simulate = Benchmark::measure(3, [&]() {
+                ReferenceSimulator simulator (config);
+                reference_time = simulator.simulate(table, durations, dropped);
+                steps = simulator.get_step_count();
+                interrupts = simulator.get_interrupt_count();
+            });
+            float estimated_time = 0.0;
+            double estimate = Benchmark::measure(3, [&]() { estimated_time = table.estimate(config); });
+
+            printf("%s %s: simulated in %.1f ms (%.1f ns/move, %.1f M steps/s, %llu interrupts), estimated in %.1f ms, estimate %+.3f%% from the reference, %llu moves dropped\n",
+                   Benchmark::get_name(input).c_str(), MODEL_NAMES[model], simulate * 1000, 1e9 * simulate / table.size(), steps / simulate / 1e6,
+                   (unsigned long long)interrupts, estimate * 1000, 100.0 * (estimated_time - reference_time) / reference_time, (unsigned long long)dropped);
+        }
+    }
+}
+
+static Benchmark benchmark ("reference_simulator", "Simulation speed of --reference and the deviation of the estimate from it", run);
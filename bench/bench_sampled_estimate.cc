@@ -0,0 +1,90 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Accuracy and latency of the sampled --fast estimate (see SampledEstimator.h) against the exact one,
+// for the sample counts that --refine goes through
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "Bench.h"
+#include "GCodeTimeEstimator.h"
+#include "SampledEstimator.h"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+static const char * const MODEL_NAMES[] = { "classic_jerk", "junction_deviation", "square_corner_velocity" };
+
+// Enough for the share of intervals that hold the exact time to show whether they are 95% intervals
+static const int ROUNDS = 100;
+
+static void run(const vector<string> &inputs) {
+    for (int model = MOTION_CLASSIC_JERK; model <= MOTION_JUNCTION_DEVIATION; model++) {
+        Config config = Benchmark::get_config((MotionModel)model);
+        for (const string &input : inputs) {
+            uint64_t input_size = fs::file_size(input);
+            float exact_time = 0.0;
+            double exact = Benchmark::measure(1, [&]() {
+                ifstream file (input);
+                GCodeTimeEstimator estimator (&file, config);
+                estimator.process_file();
+                exact_time = estimator.get_estimated_time();
+            });
+            printf("%s %s: %.1f MB, exact %.0f s in %.1f ms\n", Benchmark::get_name(input).c_str(), MODEL_NAMES[model], input_size / 1e6, exact_time,
+                   exact * 1000);
+
+            // Every round of an estimator draws new positions, so the error is averaged over several rounds
+            for (size_t samples = SampledEstimator::INITIAL_SAMPLE_COUNT; samples <= 16 * SampledEstimator::INITIAL_SAMPLE_COUNT; samples *= 2) {
+                ifstream file (input);
+                SampledEstimator estimator (&file, input_size, config);
+                double total_latency = 0.0, total_error = 0.0, max_error = 0.0, total_margin = 0.0;
+                int covered = 0;
+                SAMPLED_ESTIMATE result;
+                for (int round = 0; round < ROUNDS; round++) {
+                    total_latency += Benchmark::measure(1, [&]() { estimator.estimate(samples, result); });
+                    if (result.exact)
+                        break;
+                    double error = fabs(result.time - exact_time) / exact_time;
+                    total_error += error;
+                    max_error = max(max_error, error);
+                    total_margin += result.margin / exact_time;
+                    if (fabs(result.time - exact_time) <= result.margin)
+                        covered++;
+                }
+                if (result.exact) {
+                    printf("  %zu samples: exact, the samples would cover half of the file\n", samples);
+                    break;
+                }
+                printf("  %zu samples: %.2f ms, error %.3f%% mean %.3f%% max, interval +-%.3f%%, holds the exact time in %d%% of %d rounds\n",
+                       samples, total_latency * 1000 / ROUNDS, 100.0 * total_error / ROUNDS, 100.0 * max_error, 100.0 * total_margin / ROUNDS,
+                       100 * covered / ROUNDS, ROUNDS);
+            }
+        }
+    }
+}
+
+static Benchmark benchmark ("sampled_estimate", "Error, confidence interval and latency of --fast by number of samples", run);
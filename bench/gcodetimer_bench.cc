@@ -0,0 +1,91 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Runs the benchmarks registered in the bench folder, see Bench.h
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "Bench.h"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+static void print_usage() {
+    cout << "Usage: gcodetimer-bench [-f|--file <gcode file> ...] [<benchmark> ...]" << endl << endl;
+    cout << "Runs the given benchmarks, or all of them. Without files, a synthetic corpus of plates with 1, 9" << endl;
+    cout << "and 25 copies of a part is written to a temporary folder and used instead" << endl << endl;
+    for (Benchmark *benchmark : Benchmark::get_all())
+        cout << "  " << benchmark->name << ": " << benchmark->description << endl;
+}
+
+int main(int argc, char **argv) {
+    vector<string> files, names;
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--file") == 0) && i + 1 < argc) {
+            files.push_back(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            print_usage();
+            return strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        } else {
+            names.push_back(argv[i]);
+        }
+    }
+
+    vector<Benchmark *> selected;
+    for (Benchmark *benchmark : Benchmark::get_all()) {
+        if (names.empty() || find(names.begin(), names.end(), benchmark->name) != names.end())
+            selected.push_back(benchmark);
+    }
+    if (selected.size() < names.size() || selected.empty()) {
+        cerr << "Unknown benchmark" << endl;
+        print_usage();
+        return 1;
+    }
+
+    fs::path corpus;
+    if (files.empty()) {
+        corpus = fs::temp_directory_path() / fs::unique_path("gcodetimer-bench-%%%%-%%%%");
+        fs::create_directories(corpus);
+        files = Benchmark::make_corpus(corpus.string());
+    }
+    for (const string &file : files) {
+        if (!fs::is_regular_file(file)) {
+            cerr << "Cannot open " << file << endl;
+            return 1;
+        }
+    }
+
+    for (Benchmark *benchmark : selected) {
+        cout << "== " << benchmark->name << endl;
+        benchmark->function(files);
+        cout << endl;
+    }
+
+    if (!corpus.empty())
+        fs::remove_all(corpus);
+    return 0;
+}
@@ -0,0 +1,144 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_ASYNCIO_H__
+#define __INCLUDE_ASYNCIO_H__
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct AsyncRing;                   // io_uring state, see AsyncIO.cc
+
+// Asynchronous whole-file I/O for batch runs. Input files are opened and read ahead of their use,
+// in order, and output files are written in the background, so that processing never waits on a
+// syscall unless the device is the bottleneck. On Linux, the requests of all files in flight are
+// submitted to an io_uring in batches by a single I/O thread. Where io_uring is unavailable, a
+// pool of threads performs the same requests with blocking calls
+class AsyncIO {
+public:
+    typedef struct _FILE_BUFFER {
+        std::string filename;
+        std::vector<char> data;
+        bool valid;                 // False if the file could not be read
+    } FILE_BUFFER;
+
+protected:
+    typedef struct _REQUEST {
+        bool write;
+        size_t index;               // Index into inputs, for reads
+        std::string filename;
+        std::vector<char> data;
+        int fd;
+        uint64_t transferred;
+        int pending;                // Operations in flight, for io_uring
+        bool failed;
+        bool streaming;             // The size of the input is unknown, it is read until a read returns nothing
+    } REQUEST;
+
+    static const size_t STREAM_BLOCK_SIZE = 1024 * 1024;
+
+    std::vector<std::string> inputs;
+    size_t read_ahead;
+    uint64_t max_buffered;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t next_read, next_input;
+    std::map<size_t, REQUEST *> finished_reads;
+    uint64_t buffered;              // Bytes of finished reads and queued writes
+    std::deque<REQUEST *> queued_writes;
+    size_t writes_in_flight;
+    bool write_failed;
+    bool stopping;
+
+    AsyncRing *ring;
+    std::vector<std::thread> threads;
+
+    // Takes the next request to start, writes first. Must be called with the mutex held
+    REQUEST * take_request();
+    void complete(REQUEST *request);
+    void wake();
+
+    // Blocking implementation of a request, for the thread pool
+    void run_request(REQUEST *request);
+    void run_threads();
+
+    bool start_ring();
+    void run_ring();
+    void close_ring();
+
+public:
+    // Reads the inputs with at most read_ahead files or max_buffered bytes waiting to be
+    // processed. Pending writes count against max_buffered as well
+    AsyncIO(const std::vector<std::string> &inputs, size_t read_ahead, uint64_t max_buffered);
+    ~AsyncIO();
+
+    // Returns true if the requests are submitted to an io_uring
+    bool is_using_io_uring();
+
+    // Returns the next input file, in the order given to the constructor, waiting until it has been
+    // read. Returns false once all inputs have been returned
+    bool next(FILE_BUFFER &buffer);
+
+    // Writes data to filename in the background. Waits while too much data is buffered
+    void write(const std::string &filename, std::vector<char> &&data);
+
+    // Waits for all writes. Returns false if any of them failed
+    bool finish();
+};
+
+// Read only stream buffer over data in memory, for processing a FILE_BUFFER with an istream
+class MemoryInputBuffer : public std::streambuf {
+public:
+    MemoryInputBuffer(const std::vector<char> &data) {
+        char *start = const_cast<char *>(data.data());
+        setg(start, start, start + data.size());
+    }
+};
+
+// Stream buffer that appends everything written to it to a vector
+class MemoryOutputBuffer : public std::streambuf {
+protected:
+    std::vector<char> &data;
+
+    virtual int_type overflow(int_type c) {
+        if (c != traits_type::eof())
+            data.push_back((char)c);
+        return c;
+    }
+
+    virtual std::streamsize xsputn(const char *s, std::streamsize count) {
+        data.insert(data.end(), s, s + count);
+        return count;
+    }
+
+public:
+    MemoryOutputBuffer(std::vector<char> &data) : data(data) {}
+};
+
+#endif //__INCLUDE_ASYNCIO_H__
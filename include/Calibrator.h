@@ -0,0 +1,74 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_CALIBRATOR_H__
+#define __INCLUDE_CALIBRATOR_H__
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Config.h"
+#include "MoveTable.h"
+
+// Fits the config parameters to recorded print times. Every file is parsed once into a
+// MoveTable, candidate configs are then evaluated against all tables in parallel
+class Calibrator {
+protected:
+    typedef std::vector<double> POINT;      // Logarithms of the fitted parameters
+
+    Config initial_config, config;
+    Config base_config;                     // Starting point, fitted parameters are set in copies of it
+    bool accel_folded;                      // The accel efficiency of base_config is in its accelerations
+    std::vector<size_t> active_parameters;  // Indices of the fitted parameters in get_all_parameters()
+
+    std::vector<MoveTable> tables;
+    std::vector<float> actual_times;
+
+    int evaluations;
+
+    static std::vector<float *> get_all_parameters(Config &target);
+    static bool is_used(size_t parameter, MotionModel model);
+    std::vector<float *> get_parameters(Config &target) const;
+    POINT get_point(const Config &source) const;
+    Config get_config(const POINT &point) const;
+
+    // Returns the estimated time of every table for every candidate, candidate-major
+    std::vector<float> estimate(const std::vector<Config> &candidates);
+    std::vector<double> evaluate(const std::vector<POINT> &points);
+    double get_error(const float *estimates) const;
+
+public:
+    // If fit_axes is set, the per axis accelerations and jerks are fitted as well, and the accel
+    // efficiency keeps its configured value
+    Calibrator(const Config &config, bool fit_axes);
+
+    // Reads lines of the form "<actual time> <gcode file>" and parses the referenced files.
+    // Relative paths are resolved against the manifest's folder. Returns false on errors
+    bool load_manifest(const std::string &filename);
+
+    void fit();
+
+    const Config & get_config() const;
+    void print_report(std::ostream *stream);
+};
+
+#endif //__INCLUDE_CALIBRATOR_H__
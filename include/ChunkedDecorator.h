@@ -0,0 +1,84 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_CHUNKEDDECORATOR_H__
+#define __INCLUDE_CHUNKEDDECORATOR_H__
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "GCodeTimeDecorator.h"
+
+// Decorator that formats and writes the output on all cores. A sequential pass records the
+// duration of every line, and splits the file into chunks of whole lines:
+//
+//   1. The pass also records the elapsed time at the start of every chunk, summed in the same
+//      order as the stream decorator does, so that both print the same times
+//   2. With a policy that only compares the printed time to the one of the previous line, every
+//      chunk decides on its messages on its own. Policies with a minimum interval, a minimum line
+//      count or layer changes only carry state across chunks, so they are decided in one pass
+//   3. Workers format their chunks with the inserted messages into private buffers, which are
+//      written at their offsets in the output file with pwrite, a few chunks at a time
+class ChunkedDecorator : public GCodeTimeDecorator {
+protected:
+    static const uint64_t CHUNK_SIZE = 4 * 1024 * 1024;
+
+    enum LineFlags {
+        LINE_LAYER_CHANGE = 1 << 0,
+        LINE_EMISSION = 1 << 1,     // Set by decide_emissions() for stateful policies
+        LINE_DROPPED = 1 << 2       // Message of an earlier decoration, left out of the output
+    };
+
+    typedef struct _CHUNK {
+        uint64_t offset, first_line;
+        double start_time;          // Elapsed time before the first line
+    } CHUNK;
+
+    std::ostringstream header;
+    const char *input_data;
+    uint64_t input_size;
+
+    std::vector<float> durations;   // Per line
+    std::vector<uint8_t> flags;     // Per line, LineFlags
+    std::vector<CHUNK> chunks;
+
+    virtual void process_line(const GCODE_LINE &line, const GCODE_COMMAND &command, float line_duration);
+
+    // Returns true if the messages of every chunk only depend on the time at its start
+    bool is_stateless() const;
+
+    void decide_emissions();
+
+    // Formats the lines of a chunk together with their messages. Returns the number of messages
+    uint64_t format_chunk(size_t index, std::vector<char> &buffer) const;
+
+    bool write(int output_fd);
+
+public:
+    ChunkedDecorator(float total_time, const EmissionPolicy &policy = EmissionPolicy(), const Config &config = *Config::get());
+
+    // Decorates the input file into the output file. Returns false on errors or if the platform is not supported
+    bool decorate(const std::string &input_filename, const std::string &output_filename);
+};
+
+#endif //__INCLUDE_CHUNKEDDECORATOR_H__
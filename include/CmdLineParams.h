@@ -24,12 +24,34 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
+
+#include "EmissionPolicy.h"
 
 class CmdLineParams {
 protected:
     enum State {
         STATE_MAIN,
-        STATE_OUTPUT
+        STATE_OUTPUT,
+        STATE_CALIBRATE,
+        STATE_PROFILE,
+        STATE_MIN_INTERVAL,
+        STATE_MIN_LINES,
+        STATE_PROGRESS_FORMAT,
+        STATE_WATCH,
+        STATE_WORKERS,
+        STATE_CACHE_FOLDER,
+        STATE_CACHE_SIZE,
+        STATE_REFINE,
+        STATE_PROCESSES,
+        STATE_WORKER_COMMAND,
+        STATE_TIMEOUT,
+        STATE_IDLE_TIMEOUT,
+        STATE_SENTINEL,
+        STATE_MAX_DEVIATION,
+        STATE_QUERY,
+        STATE_DIRECTION_CACHE,
+        STATE_MANIFEST
     };
 
     std::vector<std::string> inputs;
@@ -37,6 +59,40 @@ protected:
     bool use_stdout;
     std::string output;
     bool create_config;
+    std::string calibration_manifest;
+    bool calibrate_axes;
+    std::vector<std::string> profiles;
+    EmissionPolicy emission_policy;
+    bool print_stats;
+    bool zero_copy;
+    bool memoize;
+    float direction_tolerance;  // Negative if the direction cache is not used
+    bool parallel;
+    bool export_moves;
+    bool curves;
+    bool async_io;
+    std::string watch_folder;
+    size_t workers;
+    bool use_cache;
+    std::string cache_folder;
+    uint64_t cache_size;
+    bool fast;
+    float refine_budget;
+    size_t processes;
+    std::string worker_command;
+    float timeout;
+    bool worker;
+    std::vector<std::string> worker_args;   // The options that are passed on to worker processes
+    bool follow;
+    float idle_timeout;
+    std::string sentinel;
+    bool compact;
+    bool verify;
+    bool reference;
+    float max_deviation;        // Percent, negative if not given
+    std::string query_curves;
+    std::string manifest;       // "-" for stdin
+    bool valid_options;
 
 public:
     CmdLineParams();
@@ -46,6 +102,39 @@ public:
     bool get_info_only();
     bool get_use_stdout();
     bool get_create_config();
+    const std::string & get_calibration_manifest();
+    bool get_calibrate_axes();
+    const std::vector<std::string> & get_profiles();
+    const EmissionPolicy & get_emission_policy();
+    bool get_print_stats();
+    bool get_zero_copy();
+    bool get_memoize();
+    float get_direction_tolerance();
+    bool get_parallel();
+    bool get_export_moves();
+    bool get_curves();
+    bool get_async_io();
+    const std::string & get_watch_folder();
+    size_t get_workers();
+    bool get_use_cache();
+    const std::string & get_cache_folder();
+    uint64_t get_cache_size();
+    bool get_fast();
+    float get_refine_budget();
+    size_t get_processes();
+    const std::string & get_worker_command();
+    float get_timeout();
+    bool get_worker();
+    const std::vector<std::string> & get_worker_args();
+    bool get_follow();
+    float get_idle_timeout();
+    const std::string & get_sentinel();
+    bool get_compact();
+    bool get_verify();
+    bool get_reference();
+    float get_max_deviation();
+    const std::string & get_query_curves();
+    const std::string & get_manifest();
 
     bool is_valid();
 
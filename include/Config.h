@@ -23,12 +23,24 @@
 #define __INCLUDE_CONFIG_H__
 
 #include <string>
+#include <cstdint>
 #include "Utils.h"
 
+// Firmware motion model used to estimate the duration of a move
+enum MotionModel {
+    MOTION_CLASSIC_JERK,
+    MOTION_JUNCTION_DEVIATION,
+    MOTION_SQUARE_CORNER_VELOCITY
+};
+
 class Config {
 public:
+    // Returns the user's config, loaded on first use. Safe to call from any thread
     static const Config* get();
 
+    // Loads a config from the given file instead of the user's config file, for printer profiles
+    explicit Config(const std::string &filename);
+
     COORDS max_print_accel, max_move_accel;     // mm/s2
     COORDS max_jerk;     // mm/s
     float jerk_efficiency;      // Average jerk compared to the max jerk
@@ -36,18 +48,23 @@ public:
 
     float speed_multiplier;
 
+    MotionModel motion_model;
+    float junction_deviation;       // mm, for MOTION_JUNCTION_DEVIATION
+    float square_corner_velocity;   // mm/s, for MOTION_SQUARE_CORNER_VELOCITY
+
+    COORDS steps_per_mm;    // Only used by the reference simulator (see ReferenceSimulator.h), not by estimates
+
     void save() const;
     std::string get_path() const;
+
+    // Returns a hash of every value that affects estimates
+    uint64_t get_hash() const;
 private:
-    const std::string CONFIG_FILENAME = "config.xml";
+    static const std::string CONFIG_FILENAME;
 
     Config();
 
-    static Config* instance;
-
-
-
-    void load();
+    void load(const std::string &filename);
 };
 
 #endif //__INCLUDE_CONFIG_H__
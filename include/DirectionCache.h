@@ -0,0 +1,110 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_DIRECTIONCACHE_H__
+#define __INCLUDE_DIRECTIONCACHE_H__
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Utils.h"
+#include "Kinematics.h"
+
+// Direct mapped cache of the length independent factors of classic jerk moves (see MOVE_FACTORS),
+// keyed by the direction of the move, its feed rate and whether it extrudes. Slicers reuse a few
+// directions and feed rates over and over (infill, perimeters at fixed speeds), so most moves only
+// compute the length dependent part of their duration. Direction components are quantized to the
+// tolerance, with a tolerance of 0 they have to match exactly. Colliding entries replace each
+// other. Not thread safe, every estimator uses its own instance
+class DirectionCache {
+public:
+    static const size_t DEFAULT_ENTRIES = 4096;
+
+protected:
+    static const uint32_t ENTRY_VALID = 1, ENTRY_PRINT = 2;
+
+    typedef struct _ENTRY {
+        uint32_t direction[4];
+        uint32_t rate;
+        uint32_t flags;
+        MOVE_FACTORS factors;
+    } ENTRY;
+
+    std::vector<ENTRY> entries;
+    unsigned int index_shift;
+    float quantum_inverse;      // 0 for exact directions
+    uint64_t hits, misses;
+
+    inline uint32_t quantize(float value) const {
+        if (quantum_inverse == 0.0f) {
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+        return (uint32_t)(int32_t)std::lrint(value * quantum_inverse);
+    }
+
+public:
+    // tolerance is the step that direction components (of the unit vector) are rounded to. The
+    // number of entries is rounded up to a power of two
+    explicit DirectionCache(float tolerance, size_t entry_count = DEFAULT_ENTRIES);
+
+    // Returns the entry for the factors of the move. If hit is false, the entry did not hold them
+    // and the caller has to fill it in
+    inline MOVE_FACTORS * find(const COORDS &movement, float length, float rate, bool &hit) {
+        float inverse_length = 1.0f / length;
+        uint32_t x = quantize(movement.x * inverse_length), y = quantize(movement.y * inverse_length);
+        uint32_t z = quantize(movement.z * inverse_length), e = quantize(movement.e * inverse_length);
+        uint32_t rate_bits;
+        memcpy(&rate_bits, &rate, sizeof(rate_bits));
+        uint32_t flags = ENTRY_VALID | (movement.e != 0.0f ? ENTRY_PRINT : 0);
+
+        uint64_t hash = x;
+        hash = (hash * 0x9E3779B97F4A7C15ULL) ^ y;
+        hash = (hash * 0x9E3779B97F4A7C15ULL) ^ z;
+        hash = (hash * 0x9E3779B97F4A7C15ULL) ^ e;
+        hash = (hash * 0x9E3779B97F4A7C15ULL) ^ rate_bits;
+        hash = (hash * 0x9E3779B97F4A7C15ULL) ^ flags;
+        ENTRY &entry = entries[(hash * 0x9E3779B97F4A7C15ULL) >> index_shift];
+
+        hit = entry.flags == flags && entry.rate == rate_bits && entry.direction[0] == x && entry.direction[1] == y
+            && entry.direction[2] == z && entry.direction[3] == e;
+        if (hit) {
+            hits++;
+        } else {
+            misses++;
+            entry.direction[0] = x;
+            entry.direction[1] = y;
+            entry.direction[2] = z;
+            entry.direction[3] = e;
+            entry.rate = rate_bits;
+            entry.flags = flags;
+        }
+        return &entry.factors;
+    }
+
+    uint64_t get_hits() const;
+    uint64_t get_misses() const;
+};
+
+#endif //__INCLUDE_DIRECTIONCACHE_H__
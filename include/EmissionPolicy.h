@@ -0,0 +1,57 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_EMISSIONPOLICY_H__
+#define __INCLUDE_EMISSIONPOLICY_H__
+
+#include <cstdint>
+
+// Decides how often the decorator inserts remaining time messages. The defaults emit a message
+// whenever the remaining time rounded to the second changes
+class EmissionPolicy {
+public:
+    enum Format {
+        FORMAT_M117,        // M117 ETR 01h02m03s
+        FORMAT_M73,         // M73 P<percent done> R<remaining minutes>
+        FORMAT_BOTH
+    };
+
+    float min_interval;     // Minimum print time between two messages, in seconds
+    uint64_t min_lines;     // Minimum number of input lines between two messages
+    bool adaptive;          // Use coarser steps for long remaining times
+    bool layers_only;       // Only emit messages at layer changes
+    Format format;
+
+    EmissionPolicy() : min_interval(0.0), min_lines(0), adaptive(false), layers_only(false), format(FORMAT_M117) {}
+
+    // Returns the step in seconds the remaining time is rounded to
+    inline float get_granularity(float remaining_time) const {
+        if (adaptive) {
+            if (remaining_time >= 3600)
+                return 60;
+            if (remaining_time >= 600)
+                return 10;
+        }
+        return 1;
+    }
+};
+
+#endif //__INCLUDE_EMISSIONPOLICY_H__
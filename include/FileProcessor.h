@@ -0,0 +1,113 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_FILEPROCESSOR_H__
+#define __INCLUDE_FILEPROCESSOR_H__
+
+#include <ostream>
+#include <string>
+#include <cstdint>
+#include <istream>
+#include <vector>
+
+#include "Config.h"
+#include "EmissionPolicy.h"
+#include "ResultCache.h"
+
+// Size of an estimated file. parsed is false if its estimate was taken from its header or the
+// cache, in which case the lines and moves are not known
+typedef struct _FILE_COUNTS {
+    bool parsed;
+    uint64_t lines, moves;
+} FILE_COUNTS;
+
+// Estimates and decorates single files with the settings given on the command line
+class FileProcessor {
+protected:
+    EmissionPolicy policy;
+    bool zero_copy;
+    ResultCache *cache;
+    bool memoize;
+    bool parallel;
+    bool compact;
+    float direction_tolerance;
+    const Config config;        // Snapshot taken at construction, used for every file
+    uint64_t settings_hash;     // See get_settings_hash()
+
+    bool estimate(const std::string &input_filename, std::istream *input, uint64_t move_count, float &estimated_time, const std::string &export_filename,
+                  const std::string &curves_filename, FILE_COUNTS *counts);
+    bool decorate(std::istream *input, std::ostream *output, float total_time, uint64_t &emitted_messages);
+    bool verify(std::istream *input, std::istream *output);
+
+public:
+    // If a cache is given, results are looked up there before parsing a file. memoize enables
+    // reusing the durations of repeated move sequences within a file (see MoveMemo.h), parallel
+    // decorating output files on all cores (see ChunkedDecorator.h) and compact writing shortened
+    // lines without comments (see GCodeCompactor.h), which bypasses the cache and the other two. A
+    // direction_tolerance of 0 or more estimates with a DirectionCache of that tolerance. The cache
+    // must have been created for the same config
+    FileProcessor(const EmissionPolicy &policy = EmissionPolicy(), bool zero_copy = false, ResultCache *cache = NULL, bool memoize = false,
+                  bool parallel = false, bool compact = false, float direction_tolerance = -1.0, const Config &config = *Config::get());
+
+    // Returns false if the file cannot be read. Files decorated by this version with the same
+    // settings are not parsed, their recorded estimate is returned. If export_filename is given,
+    // the per move records are written to it as well (see MoveExportWriter.h), and if
+    // curves_filename is given the override curves (see OverrideCurves.h). Both bypass the cache
+    // and the recorded estimate. If counts is given, it is set to the size of the file
+    bool estimate(const std::string &input_filename, float &estimated_time, const std::string &export_filename = std::string(),
+                  const std::string &curves_filename = std::string(), FILE_COUNTS *counts = NULL);
+
+    // Same for a file whose contents have already been read, for example by AsyncIO
+    bool estimate(const std::string &input_filename, const std::vector<char> &contents, float &estimated_time, const std::string &export_filename = std::string(),
+                  const std::string &curves_filename = std::string());
+
+    // Same for a file that is still being written, following it until it is complete (see
+    // FollowInputBuffer.h). Bypasses the cache lookup
+    bool follow(const std::string &input_filename, const std::string &sentinel, float idle_timeout, float &estimated_time);
+
+    // Writes the decorated file. Returns false if the input cannot be read or the output cannot be written
+    bool decorate(const std::string &input_filename, const std::string &output_filename, float total_time, uint64_t &emitted_messages);
+    bool decorate(const std::string &input_filename, std::ostream *output, float total_time, uint64_t &emitted_messages);
+
+    // Decorates contents that have already been read, to a stream or into memory
+    bool decorate(const std::vector<char> &contents, std::ostream *output, float total_time, uint64_t &emitted_messages);
+    bool decorate(const std::vector<char> &contents, std::vector<char> &output, float total_time, uint64_t &emitted_messages);
+
+    // Returns true if the output moves the printer exactly like the input, by comparing their moves
+    // as seen by the estimator
+    bool verify(const std::string &input_filename, const std::string &output_filename);
+    bool verify(const std::vector<char> &input, const std::vector<char> &output);
+
+    // Returns a hash of the config and of the approximations that estimates are made with, which
+    // is the hash of the config alone for exact estimates
+    static uint64_t get_settings_hash(const Config &config, bool memoize, float direction_tolerance);
+
+    // Returns the default output name, with a ".timed" suffix in front of the extension
+    static std::string get_output_filename(const std::string &input_filename);
+
+    // Returns the default move export name, with the extension replaced by ".moves"
+    static std::string get_export_filename(const std::string &input_filename);
+
+    // Returns the default override curves name, with the extension replaced by ".curves"
+    static std::string get_curves_filename(const std::string &input_filename);
+};
+
+#endif //__INCLUDE_FILEPROCESSOR_H__
@@ -0,0 +1,71 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_FOLLOWINPUTBUFFER_H__
+#define __INCLUDE_FOLLOWINPUTBUFFER_H__
+
+#include <chrono>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// Read only stream buffer over a file that is still being written, like tail -f. Reads wait for
+// more data at the end of the file, which ends the input once:
+//  - no process has the file open for writing anymore. This is checked with a read lease, which
+//    can only be taken while there are no writers, whenever the file changes (inotify) or every
+//    few milliseconds where inotify is not available
+//  - a line starting with the sentinel has been read, once the data after it has been read
+//  - nothing was appended for the idle timeout
+class FollowInputBuffer : public std::streambuf {
+protected:
+    static const size_t BUFFER_SIZE = 256 * 1024;
+    static const int POLL_INTERVAL_MS = 50;
+
+    std::string sentinel;
+    float idle_timeout;
+    int fd, inotify_fd;
+    std::vector<char> buffer;
+    std::string line_start;         // Start of the current line, up to the length of the sentinel
+    bool leases_supported, writer_closed, sentinel_found, failed;
+    std::chrono::steady_clock::time_point last_data;
+
+    virtual int_type underflow();
+    virtual std::streamsize xsgetn(char_type *s, std::streamsize count);
+
+    void find_sentinel(const char *data, size_t length);
+    bool has_writers();
+
+    // Waits for the file to change. Returns false once nothing was appended for the idle timeout
+    bool wait();
+
+public:
+    FollowInputBuffer(const std::string &sentinel, float idle_timeout);
+    ~FollowInputBuffer();
+
+    // Opens the file, waiting up to the idle timeout for it to be created. Returns false if it
+    // cannot be opened or the platform is not supported
+    bool open(const std::string &filename);
+
+    // Returns true if the input ended on a read error instead of the end of the file
+    bool is_failed() const;
+};
+
+#endif //__INCLUDE_FOLLOWINPUTBUFFER_H__
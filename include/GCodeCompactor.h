@@ -0,0 +1,95 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_GCODECOMPACTOR_H__
+#define __INCLUDE_GCODECOMPACTOR_H__
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "GCodeLexer.h"
+#include "GCodeProcessorBase.h"
+#include "Hasher.h"
+
+// Rewrites lines into a shorter form that moves the printer in exactly the same way, for --compact:
+//  - Comments, comment-only and empty lines are dropped, which includes thumbnails and config dumps
+//  - Numbers of G0/G1 moves lose their '+' and non-significant zeros ("X010.500" becomes "X10.5").
+//    They are never rounded, so any firmware parses the same value
+//  - In absolute mode, G1 coordinates equal to the last one given for the axis and F values equal
+//    to the last G1 feed rate are dropped, and G1 lines left without words
+//
+// Values are compared as text, and whatever the compactor does not know for sure forgets them:
+// relative modes, G0 moves (separate rapid feed rates), homing, tool changes, and every command
+// not known to leave the position alone. Lines with line numbers or checksums and commands with
+// string arguments (M117, M23, ...) are kept as they are
+class GCodeCompactor {
+protected:
+    typedef struct _WORD {
+        char letter;                // Upper case
+        std::string_view value;
+    } WORD;
+
+    std::string known[4];           // Normalized X, Y, Z and E of the last absolute G1, empty if unknown
+    std::string known_feedrate;     // Normalized F of the last G1, empty if unknown
+    bool absolute_xyz, absolute_e;  // Known to be in absolute mode
+    std::vector<WORD> words;
+    std::string text;
+
+    void forget();
+
+    // Splits the code of a line into words, the first one being the command. Returns false if
+    // there is anything but words with numeric values, or if a letter is repeated
+    bool split(std::string_view code);
+
+    // Appends the shortest form of a plain decimal number to output. Returns false and appends
+    // nothing for anything else
+    static bool normalize(std::string_view value, std::string &output);
+
+    // Returns false if the move can be dropped
+    bool compact_move(std::string_view code, int number, std::string_view &compacted);
+
+public:
+    GCodeCompactor();
+
+    // Returns false if the line can be dropped, otherwise sets compacted to the line without the
+    // '\n'. compacted is valid until the next call
+    bool compact(const GCODE_LINE &line, const GCODE_COMMAND &command, std::string_view &compacted);
+};
+
+// Digest of the moves of a file as seen by the estimator, for checking that a rewritten file moves
+// the printer in exactly the same way as the original one
+class MoveDigest : public GCodeProcessorBase {
+protected:
+    Hasher hasher;
+    double total_time;
+
+    virtual void process_line(const GCODE_LINE &line, const GCODE_COMMAND &command, float line_duration);
+
+public:
+    MoveDigest(std::istream *input, const Config &config = *Config::get());
+
+    uint64_t get_digest() const;
+    double get_total_time() const;
+};
+
+#endif //__INCLUDE_GCODECOMPACTOR_H__
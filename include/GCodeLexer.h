@@ -0,0 +1,64 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_GCODELEXER_H__
+#define __INCLUDE_GCODELEXER_H__
+
+#include <cstdint>
+#include <string_view>
+
+#include "Utils.h"
+
+// Parameter words that can be present on a command line
+enum GCodeParam {
+    PARAM_X = 1 << 0,
+    PARAM_Y = 1 << 1,
+    PARAM_Z = 1 << 2,
+    PARAM_E = 1 << 3,
+    PARAM_F = 1 << 4
+};
+
+typedef struct _GCODE_LINE {
+    std::string_view text;      // Raw bytes of the line without the '\n'. Only valid during the callback
+    uint64_t offset;            // Byte offset of the first character of the line in the input
+    uint64_t number;            // Line number, starting at 1
+} GCODE_LINE;
+
+typedef struct _GCODE_COMMAND {
+    char letter;                // Command letter ('G', 'M', 'T', ...) or 0 if the line holds no command
+    int number;                 // Command number (1 for G1), or -1 if missing or unsupported (G92.1)
+    unsigned int params;        // Bitmask of the GCodeParam words present on the line
+    COORDS values;              // Axis values. Only valid for the axes present in params
+    float feedrate;             // F value in mm/min. Only valid if PARAM_F is present
+
+    inline bool is(char l, int n) const {
+        return letter == l && number == n;
+    }
+} GCODE_COMMAND;
+
+class GCodeLexer {
+public:
+    // Parses a single line without allocating. Comments are skipped, parameter words without a
+    // value (as in "G28 X Y") are reported as present with a value of 0
+    static void parse_line(std::string_view line, GCODE_COMMAND &command);
+};
+
+#endif //__INCLUDE_GCODELEXER_H__
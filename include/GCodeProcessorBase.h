@@ -23,19 +23,125 @@
 #define __INCLUDE_GCODEPROCESSORBASE_H__
 
 #include <iostream>
-#include <fstream>
 #include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "Utils.h"
+#include "GCodeLexer.h"
+#include "Config.h"
+#include "Kinematics.h"
 
 class GCodeProcessorBase {
 protected:
-    std::ifstream *input;
+    static const size_t BUFFER_SIZE = 256 * 1024;
+
+    std::istream *input;
+    std::vector<char> buffer;       // Read buffer, allocated once and reused for every block
+
+    // Machine state
+    COORDS pos;                     // mm
+    float rate;                     // mm/s
+    uint64_t offset, line_number;
+    uint64_t move_count;            // Moves with a length greater than 0
+
+    const Config config;            // Snapshot taken at construction, later changes to the source do not apply
+
+    // Called for every line of the input, in order. The line text is a view into the read buffer
+    virtual void process_line(const GCODE_LINE &line, const GCODE_COMMAND &command, float line_duration) = 0;
+
+    GCodeProcessorBase(std::istream *input, const Config &config = *Config::get());
 
-    virtual void process_line(std::string line, float line_duration) = 0;
+    void reset();
 
-    GCodeProcessorBase(std::ifstream *input);
+    // Updates the machine state. Returns true and sets movement if the command is a move with
+    // a length greater than 0
+    bool update_state(const GCODE_COMMAND &command, COORDS &movement);
+
+    // The following are instantiated for every kinematics class, which can be any class with a
+    // get_move_duration(movement, rate) method (see Kinematics.h)
+
+    // Updates the machine state and returns the duration of the command
+    template <class K> float process_command(const GCODE_COMMAND &command, K &kinematics);
+
+    // Processes all complete lines in data and returns the number of bytes consumed. If
+    // at_eof is set, a trailing line without terminator is processed as well
+    template <class K> size_t process_buffer(const char *data, size_t length, bool at_eof, K &kinematics);
+
+    // Processes the whole input from the start
+    template <class K> void process_input(K &kinematics);
 
 public:
+    // Processes the whole input with the motion model of the config
     virtual void process_file();
+
+    // Lines and moves seen by the last process_file()
+    uint64_t get_line_count() const;
+    uint64_t get_move_count() const;
 };
 
+template <class K> float GCodeProcessorBase::process_command(const GCODE_COMMAND &command, K &kinematics) {
+    COORDS movement;
+    if (!update_state(command, movement))
+        return 0.0;
+    move_count++;
+    return kinematics.get_move_duration(movement, rate);
+}
+
+template <class K> size_t GCodeProcessorBase::process_buffer(const char *data, size_t length, bool at_eof, K &kinematics) {
+    GCODE_LINE line;
+    GCODE_COMMAND command;
+    size_t consumed = 0;
+
+    while (consumed < length) {
+        const char *start = data + consumed;
+        const char *newline = (const char *)memchr(start, '\n', length - consumed);
+        size_t line_length;
+        if (newline) {
+            line_length = newline - start;
+        } else if (at_eof) {
+            line_length = length - consumed;
+        } else {
+            break;
+        }
+
+        line.text = std::string_view(start, line_length);
+        line.offset = offset;
+        line.number = ++line_number;
+        GCodeLexer::parse_line(line.text, command);
+        process_line(line, command, process_command(command, kinematics));
+
+        size_t line_size = line_length + (newline ? 1 : 0);
+        consumed += line_size;
+        offset += line_size;
+    }
+
+    return consumed;
+}
+
+template <class K> void GCodeProcessorBase::process_input(K &kinematics) {
+    reset();
+
+    size_t filled = 0;
+    bool at_eof = false;
+    while (!at_eof) {
+        if (filled == buffer.size()) {
+            // A single line does not fit into the buffer
+            buffer.resize(buffer.size() * 2);
+        }
+
+        // Takes what the stream buffer returns at once instead of waiting for the whole block, so
+        // that a file that is still being written is processed as it grows
+        std::streamsize count = input->rdbuf()->sgetn(buffer.data() + filled, buffer.size() - filled);
+        filled += count;
+        at_eof = count <= 0;
+
+        size_t consumed = process_buffer(buffer.data(), filled, at_eof, kinematics);
+        filled -= consumed;
+        memmove(buffer.data(), buffer.data() + consumed, filled);
+    }
+}
+
 #endif //__INCLUDE_GCODEPROCESSORBASE_H__
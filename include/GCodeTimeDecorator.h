@@ -0,0 +1,154 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_GCODETIMEDECORATOR_H__
+#define __INCLUDE_GCODETIMEDECORATOR_H__
+
+#include <iostream>
+#include <ostream>
+#include <cstdint>
+#include <cmath>
+#include <string>
+
+#include "GCodeProcessorBase.h"
+#include "EmissionPolicy.h"
+#include "GCodeCompactor.h"
+
+// Copies the input to the output, inserting the remaining print time according to the emission policy
+class GCodeTimeDecorator : public GCodeProcessorBase {
+protected:
+    // What the last message was and when it was emitted
+    typedef struct _EMISSION_STATE {
+        float printed_time, emission_time;
+        uint64_t emission_line;
+    } EMISSION_STATE;
+
+    // Where the input is relative to the lines of an earlier decoration, which are dropped so
+    // that decorating again does not stack a second set of messages
+    enum HeaderState {
+        HEADER_START,           // Before the first line
+        HEADER_PENDING,         // The first line may start a header, it is held until the second one
+        HEADER_INSIDE,          // Inside the header comments
+        HEADER_END,             // After them, before the empty line that follows
+        HEADER_DECORATED,       // Messages are dropped for the rest of the file
+        HEADER_NONE             // The input is not decorated
+    };
+
+    enum LineKind {
+        LINE_KEPT,
+        LINE_STALE,             // Written by an earlier decoration
+        LINE_HELD               // Decided together with the next line
+    };
+
+    float total_time;
+    double current_time;        // Accumulated in double so long prints do not drift
+    std::ostream *output;
+
+    EmissionPolicy policy;
+    EMISSION_STATE emission;
+    float layer_z;              // Of the last extruding move
+    uint64_t emitted_messages;
+    GCodeCompactor *compactor;
+    uint64_t settings_hash;     // Recorded in the header
+
+    HeaderState header_state;
+    uint64_t stale_lines;       // Dropped so far, line numbers for the policy only count the others
+    std::string held_text;
+    GCODE_LINE held_line;
+    GCODE_COMMAND held_command;
+
+    // Returns the remaining time as printed, rounded to the granularity of the policy
+    static inline float get_printed_time(const EmissionPolicy &policy, float remaining_time) {
+        float granularity = policy.get_granularity(remaining_time);
+        return round(remaining_time / granularity) * granularity;
+    }
+
+    // Returns true and sets printed_time if a message is due after the given line, updating the state
+    static inline bool is_emission_due(const EmissionPolicy &policy, EMISSION_STATE &state, float total_time, float current_time,
+                                       uint64_t line_number, bool layer_change, float &printed_time) {
+        printed_time = get_printed_time(policy, total_time - current_time);
+        if (printed_time == state.printed_time
+                || (!layer_change && policy.layers_only)
+                || current_time - state.emission_time < policy.min_interval
+                || line_number - state.emission_line < policy.min_lines)
+            return false;
+        state.printed_time = printed_time;
+        state.emission_time = current_time;
+        state.emission_line = line_number;
+        return true;
+    }
+
+    // Returns true if the line starts a new layer, updating layer_z. Only moves that extrude along
+    // X or Y count, so that the travel moves of z-hops do not start layers
+    inline bool is_layer_change(const GCODE_COMMAND &command) {
+        if (command.letter != 'G' || command.number != 1 || !(command.params & PARAM_E) || !(command.params & (PARAM_X | PARAM_Y))
+                || pos.z == layer_z)
+            return false;
+        layer_z = pos.z;
+        return true;
+    }
+
+    // Writes the message for the given remaining time to the stream
+    static void write_message(std::ostream *stream, const EmissionPolicy &policy, float total_time, float current_time, float remaining_time);
+
+    void write_header();
+    // Writes the messages with the total time that follow the header comments
+    void write_totals();
+    void emit(float remaining_time);
+
+    // Returns the kind of the next line of the input and updates the header state. If the previous
+    // line was held, it is stale if this one is and kept otherwise
+    LineKind classify_line(const GCODE_LINE &line);
+
+    // Writes the original line to the output
+    virtual void echo_line(const GCODE_LINE &line);
+    // Leaves a stale line out of the output
+    virtual void drop_line(const GCODE_LINE &line);
+
+    // Writes the line and the message due after it
+    void keep_line(const GCODE_LINE &line, const GCODE_COMMAND &command, float line_duration);
+
+    virtual void process_line(const GCODE_LINE &line, const GCODE_COMMAND &command, float line_duration);
+
+public:
+    GCodeTimeDecorator(std::istream *input, std::ostream *output, float total_time, const EmissionPolicy &policy = EmissionPolicy(),
+                       const Config &config = *Config::get());
+
+    // Writes compacted lines instead of the original ones and leaves the settings out of the header
+    // (see GCodeCompactor.h). The compactor must outlive process_file()
+    void set_compactor(GCodeCompactor *compactor);
+
+    // Sets the hash of the settings recorded with the estimate in the header, which defaults to the
+    // one of the config. Estimates made with approximations must record them as well
+    void set_settings_hash(uint64_t settings_hash);
+
+    void process_file();
+
+    uint64_t get_emitted_messages();
+
+    // Reads the header of a file decorated by this version, looking at its first HEADER_SCAN_SIZE
+    // bytes only. Returns true and sets total_time to the recorded estimate if it was made with
+    // the given settings hash
+    static const size_t HEADER_SCAN_SIZE = 4096;
+    static bool read_header(std::istream *input, uint64_t settings_hash, float &total_time);
+};
+
+#endif //__INCLUDE_GCODETIMEDECORATOR_H__
@@ -0,0 +1,274 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_GCODETIMEESTIMATOR_H__
+#define __INCLUDE_GCODETIMEESTIMATOR_H__
+
+#include <iostream>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "GCodeProcessorBase.h"
+#include "MoveExportWriter.h"
+#include "MoveMemo.h"
+#include "DirectionCache.h"
+#include "OverrideCurves.h"
+
+class GCodeTimeEstimator : public GCodeProcessorBase {
+protected:
+    double estimated_time;      // Accumulated in double so long prints do not drift
+    MoveExportWriter *exporter;
+    MoveMemo *memo;
+    OverrideCurves *curves;
+    DirectionCache *direction_cache;
+
+    // Wraps a kinematics class, passing every move and its timing to the exporter
+    template <class K> class ExportingKinematics {
+    protected:
+        GCodeTimeEstimator &estimator;
+        K &kinematics;
+
+    public:
+        ExportingKinematics(GCodeTimeEstimator &estimator, K &kinematics) : estimator(estimator), kinematics(kinematics) {}
+
+        inline float get_move_duration(const COORDS &movement, float rate) {
+            float accel_time = 0.0;
+            float duration = kinematics.get_move_duration(movement, rate, accel_time);
+            estimator.exporter->add(estimator.offset, estimator.line_number, movement, rate, accel_time, duration);
+            return duration;
+        }
+    };
+
+    // Wraps a kinematics class, looking up the length independent part of the duration of every
+    // move in the direction cache. Models without such a part are passed on directly. Holds a copy
+    // of the kinematics, so that copies of the wrapper keep their own state
+    template <class K> class CachingKinematics {
+    protected:
+        K kinematics;
+        DirectionCache &cache;
+
+    public:
+        static const bool MEMORYLESS = K::MEMORYLESS;
+
+        CachingKinematics(K &kinematics, DirectionCache &cache) : kinematics(kinematics), cache(cache) {}
+
+        inline float get_move_duration(const COORDS &movement, float rate) {
+            float accel_time;
+            return get_move_duration(movement, rate, accel_time);
+        }
+
+        inline float get_move_duration(const COORDS &movement, float rate, float &accel_time) {
+            if constexpr (K::FACTORED) {
+                float length = Utils::get_euclidean_length(movement);
+                bool hit;
+                MOVE_FACTORS *factors = cache.find(movement, length, rate, hit);
+                if (!hit)
+                    kinematics.get_move_factors(movement, length, rate, *factors);
+                return K::get_factored_duration(*factors, length, accel_time);
+            } else {
+                return kinematics.get_move_duration(movement, rate, accel_time);
+            }
+        }
+    };
+
+    // Wraps a kinematics class, timing every move at all factors of the override curves as well.
+    // Every factor has its own copy of the kinematics, so stateful models keep the previous move
+    // of their factor. The durations at 100% are passed on
+    template <class K> class CurveKinematics {
+    protected:
+        GCodeTimeEstimator &estimator;
+        std::vector<K> kinematics;
+        double elapsed[OverrideCurves::FACTOR_COUNT];
+
+    public:
+        CurveKinematics(GCodeTimeEstimator &estimator, K &kinematics)
+            : estimator(estimator), kinematics(OverrideCurves::FACTOR_COUNT, kinematics), elapsed() {}
+
+        inline float get_move_duration(const COORDS &movement, float rate) {
+            float accel_time;
+            return get_move_duration(movement, rate, accel_time);
+        }
+
+        inline float get_move_duration(const COORDS &movement, float rate, float &accel_time) {
+            OverrideCurves &curves = *estimator.curves;
+            if (curves.needs_checkpoint(estimator.offset))
+                curves.add_checkpoint(estimator.offset, elapsed);
+
+            float duration = 0.0;
+            accel_time = 0.0;
+            for (size_t i = 0; i < OverrideCurves::FACTOR_COUNT; i++) {
+                float factor_accel_time;
+                float factor_duration = kinematics[i].get_move_duration(movement, rate * curves.get_factor(i), factor_accel_time);
+                elapsed[i] += factor_duration;
+                if (i == OverrideCurves::UNIT_FACTOR) {
+                    duration = factor_duration;
+                    accel_time = factor_accel_time;
+                }
+            }
+            return duration;
+        }
+
+        // Adds the end of the file to the curves
+        void finish() {
+            estimator.curves->finish(estimator.offset, elapsed);
+        }
+    };
+
+    // Wraps a memoryless kinematics class, reusing the durations of repeated runs of extruding
+    // moves from the memo. Travels and retractions end a run and are passed on directly. The moves
+    // of a run are held back until it ends, and their durations are added to the estimated time at
+    // that point. Files with few repetitions are passed on directly after a while, as the lookups
+    // would cost more than they save
+    template <class K> class MemoizingKinematics {
+    protected:
+        // Movements are compared in steps of 1 um, so that copies at different positions match
+        // despite the rounding of their absolute coordinates
+        static constexpr float QUANTUM_INVERSE = 1000.0f;
+
+        // Lookups after which the hit rate is checked, and the minimum hit rate to keep memoizing
+        static const uint64_t PROBE_LOOKUPS = 256;
+        static constexpr float MIN_HIT_RATE = 0.25f;
+
+        GCodeTimeEstimator &estimator;
+        K &kinematics;
+        MoveMemo &memo;
+
+        COORDS movements[MoveMemo::MAX_SEQUENCE_MOVES];
+        float rates[MoveMemo::MAX_SEQUENCE_MOVES];
+        MoveMemo::QUANTIZED_MOVE quantized[MoveMemo::MAX_SEQUENCE_MOVES];
+        float durations[MoveMemo::MAX_SEQUENCE_MOVES];
+        size_t count;
+        uint64_t hash;
+        bool bypass;
+
+        // One round of XXH64 per value, cheap enough to not outweigh the kinematics it saves
+        static inline uint64_t mix(uint64_t hash, uint64_t value) {
+            hash += value * 0xC2B2AE3D27D4EB4FULL;
+            hash = (hash << 31) | (hash >> 33);
+            return hash * 0x9E3779B185EBCA87ULL;
+        }
+
+        static inline int32_t quantize(float value) {
+            return (int32_t)(int64_t)(value * QUANTUM_INVERSE + (value >= 0.0f ? 0.5f : -0.5f));
+        }
+
+        inline void hash_move(const COORDS &movement, float rate, MoveMemo::QUANTIZED_MOVE &move) {
+            move.x = quantize(movement.x);
+            move.y = quantize(movement.y);
+            move.z = quantize(movement.z);
+            move.e = quantize(movement.e);
+            memcpy(&move.rate, &rate, sizeof(move.rate));
+            hash = mix(hash, (uint32_t)move.x);
+            hash = mix(hash, (uint32_t)move.y);
+            hash = mix(hash, (uint32_t)move.z);
+            hash = mix(hash, (uint32_t)move.e);
+            hash = mix(hash, move.rate);
+        }
+
+        // Final avalanche of XXH64, so that all bits of the key depend on all moves
+        inline uint64_t get_key() const {
+            uint64_t key = hash ^ count;
+            key ^= key >> 33;
+            key *= 0xC2B2AE3D27D4EB4FULL;
+            key ^= key >> 29;
+            key *= 0x165667B19E3779F9ULL;
+            key ^= key >> 32;
+            return key;
+        }
+
+    public:
+        MemoizingKinematics(GCodeTimeEstimator &estimator, K &kinematics, MoveMemo &memo)
+            : estimator(estimator), kinematics(kinematics), memo(memo), count(0), hash(0), bypass(false) {}
+
+        inline float get_move_duration(const COORDS &movement, float rate) {
+            if (bypass)
+                return kinematics.get_move_duration(movement, rate);
+            if (movement.e <= 0.0f) {
+                flush();
+                return kinematics.get_move_duration(movement, rate);
+            }
+
+            if (count == 0)
+                hash = 0x27D4EB2F165667C5ULL;
+            movements[count] = movement;
+            rates[count] = rate;
+            hash_move(movement, rate, quantized[count]);
+            if (++count == MoveMemo::MAX_SEQUENCE_MOVES)
+                flush();
+            return 0.0;
+        }
+
+        // Adds the durations of the held back moves to the estimated time
+        void flush() {
+            if (count == 0)
+                return;
+
+            const float *cached = count >= MoveMemo::MIN_SEQUENCE_MOVES ? memo.find(get_key(), quantized, count) : NULL;
+            if (cached) {
+                for (size_t i = 0; i < count; i++)
+                    estimator.estimated_time += cached[i];
+            } else {
+                for (size_t i = 0; i < count; i++) {
+                    durations[i] = kinematics.get_move_duration(movements[i], rates[i]);
+                    estimator.estimated_time += durations[i];
+                }
+                if (count >= MoveMemo::MIN_SEQUENCE_MOVES)
+                    memo.insert(get_key(), quantized, durations, count);
+            }
+            count = 0;
+
+            uint64_t lookups = memo.get_hits() + memo.get_misses();
+            if (lookups == PROBE_LOOKUPS && memo.get_hits() < MIN_HIT_RATE * lookups)
+                bypass = true;
+        }
+    };
+
+    virtual void process_line(const GCODE_LINE &line, const GCODE_COMMAND &command, float line_duration);
+
+    // Processes the input with the wrappers for the features that are set
+    template <class K> void process_with(K &kinematics);
+
+public:
+    GCodeTimeEstimator(std::istream *input, const Config &config = *Config::get());
+
+    // Passes every move to the exporter as well. The exporter must outlive process_file()
+    void set_exporter(MoveExportWriter *exporter);
+
+    // Reuses the durations of repeated move sequences from the memo, which must outlive
+    // process_file(). Ignored for the junction models and while an exporter or override curves are set
+    void set_memo(MoveMemo *memo);
+
+    // Builds the override curves of the file as well (see OverrideCurves.h). The curves must
+    // outlive process_file()
+    void set_curves(OverrideCurves *curves);
+
+    // Looks up the per move factors of the classic jerk model in the cache, which must outlive
+    // process_file(). Other motion models do not use it
+    void set_direction_cache(DirectionCache *direction_cache);
+
+    void process_file();
+
+    float get_estimated_time();
+};
+
+#endif //__INCLUDE_GCODETIMEESTIMATOR_H__
@@ -0,0 +1,166 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_HASHER_H__
+#define __INCLUDE_HASHER_H__
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Streaming implementation of the 64 bit xxHash algorithm (XXH64). Fast enough for hashing
+// whole gcode files, not suitable for cryptographic purposes
+class Hasher {
+protected:
+    static const uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+    static const uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+    static const uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
+    static const uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+    static const uint64_t PRIME_5 = 0x27D4EB2F165667C5ULL;
+
+    uint64_t seed, total_length;
+    uint64_t v1, v2, v3, v4;
+    unsigned char pending[32];
+    size_t pending_length;
+
+    static inline uint64_t rotl(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static inline uint64_t read64(const unsigned char *p) {
+        uint64_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static inline uint32_t read32(const unsigned char *p) {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static inline uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * PRIME_2;
+        acc = rotl(acc, 31);
+        return acc * PRIME_1;
+    }
+
+    static inline uint64_t merge_round(uint64_t acc, uint64_t value) {
+        acc ^= round(0, value);
+        return acc * PRIME_1 + PRIME_4;
+    }
+
+    inline void process_stripes(const unsigned char *p, size_t stripes) {
+        for (size_t i = 0; i < stripes; i++, p += 32) {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+        }
+    }
+
+public:
+    Hasher(uint64_t seed = 0) {
+        reset(seed);
+    }
+
+    inline void reset(uint64_t seed = 0) {
+        this->seed = seed;
+        total_length = 0;
+        v1 = seed + PRIME_1 + PRIME_2;
+        v2 = seed + PRIME_2;
+        v3 = seed;
+        v4 = seed - PRIME_1;
+        pending_length = 0;
+    }
+
+    inline void update(const void *data, size_t length) {
+        const unsigned char *p = (const unsigned char *)data;
+        total_length += length;
+
+        if (pending_length + length < 32) {
+            memcpy(pending + pending_length, p, length);
+            pending_length += length;
+            return;
+        }
+
+        if (pending_length > 0) {
+            size_t fill = 32 - pending_length;
+            memcpy(pending + pending_length, p, fill);
+            process_stripes(pending, 1);
+            p += fill;
+            length -= fill;
+            pending_length = 0;
+        }
+
+        process_stripes(p, length / 32);
+        pending_length = length % 32;
+        memcpy(pending, p + length - pending_length, pending_length);
+    }
+
+    template<typename T>
+    inline void update_value(const T &value) {
+        update(&value, sizeof(value));
+    }
+
+    inline void update_string(const std::string &value) {
+        update_value(value.size());
+        update(value.data(), value.size());
+    }
+
+    inline uint64_t digest() const {
+        uint64_t h;
+        if (total_length >= 32) {
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = merge_round(h, v1);
+            h = merge_round(h, v2);
+            h = merge_round(h, v3);
+            h = merge_round(h, v4);
+        } else {
+            h = seed + PRIME_5;
+        }
+        h += total_length;
+
+        const unsigned char *p = pending, *end = pending + pending_length;
+        for (; p + 8 <= end; p += 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * PRIME_1 + PRIME_4;
+        }
+        if (p + 4 <= end) {
+            h ^= (uint64_t)read32(p) * PRIME_1;
+            h = rotl(h, 23) * PRIME_2 + PRIME_3;
+            p += 4;
+        }
+        for (; p < end; p++) {
+            h ^= *p * PRIME_5;
+            h = rotl(h, 11) * PRIME_1;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME_2;
+        h ^= h >> 29;
+        h *= PRIME_3;
+        h ^= h >> 32;
+        return h;
+    }
+};
+
+#endif //__INCLUDE_HASHER_H__
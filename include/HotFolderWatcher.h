@@ -0,0 +1,73 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_HOTFOLDERWATCHER_H__
+#define __INCLUDE_HOTFOLDERWATCHER_H__
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FileProcessor.h"
+
+// Decorates every gcode file that is written or moved into a folder, using inotify to pick up
+// files as soon as they are closed. Files are handed to a pool of workers through a bounded
+// queue. Repeated events for a file coalesce, and a file is never processed by two workers at once
+class HotFolderWatcher {
+protected:
+    enum FileState {
+        FILE_QUEUED,
+        FILE_RUNNING,
+        FILE_RUNNING_CHANGED     // Changed again while being processed, runs once more afterwards
+    };
+
+    std::string folder;
+    FileProcessor &processor;
+    size_t worker_count, queue_capacity;
+
+    std::mutex mutex;
+    std::condition_variable work_available, space_available;
+    std::deque<std::string> queue;
+    std::map<std::string, FileState> states;
+    bool stopping;
+
+    std::mutex log_mutex;
+
+    static bool is_input(const std::string &name);
+
+    // Queues the files without an up to date output
+    void scan();
+    void enqueue(const std::string &name);
+    void run_worker();
+    void process(const std::string &name);
+
+public:
+    HotFolderWatcher(const std::string &folder, FileProcessor &processor, size_t worker_count, size_t queue_capacity);
+
+    // Watches the folder until SIGINT or SIGTERM is received. Returns false if the folder cannot be watched
+    bool run();
+};
+
+#endif //__INCLUDE_HOTFOLDERWATCHER_H__
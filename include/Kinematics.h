@@ -0,0 +1,331 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_KINEMATICS_H__
+#define __INCLUDE_KINEMATICS_H__
+
+#include <algorithm>
+#include <cmath>
+
+#include "Utils.h"
+#include "Config.h"
+#ifdef GCODETIMER_BAKED_PROFILE
+#include "BakedProfile.h"
+#endif
+
+// Parameter sources of the kinematics classes. ConfigParameters copies the values of a config at
+// construction, while BakedProfile (see BakedProfile.h.in) returns constants that are folded into
+// the formulas. Either way a kinematics instance never refers back to the config it was made from
+class ConfigParameters {
+protected:
+    COORDS print_accel, move_accel, jerk;
+    COORDS effective_print_accel_value, effective_move_accel_value;
+    float jerk_efficiency_value, accel_efficiency_value, speed_multiplier_value;
+    float junction_deviation_value, square_corner_velocity_value;
+
+public:
+    explicit ConfigParameters(const Config &config) : print_accel(config.max_print_accel), move_accel(config.max_move_accel), jerk(config.max_jerk),
+        effective_print_accel_value(Utils::map(config.max_print_accel, [&](float c) { return c * config.accel_efficiency; })),
+        effective_move_accel_value(Utils::map(config.max_move_accel, [&](float c) { return c * config.accel_efficiency; })),
+        jerk_efficiency_value(config.jerk_efficiency), accel_efficiency_value(config.accel_efficiency), speed_multiplier_value(config.speed_multiplier),
+        junction_deviation_value(config.junction_deviation), square_corner_velocity_value(config.square_corner_velocity) {}
+
+    inline const COORDS & max_print_accel() const { return print_accel; }
+    inline const COORDS & max_move_accel() const { return move_accel; }
+    inline const COORDS & max_jerk() const { return jerk; }
+    inline float jerk_efficiency() const { return jerk_efficiency_value; }
+    inline float accel_efficiency() const { return accel_efficiency_value; }
+    inline float speed_multiplier() const { return speed_multiplier_value; }
+    inline float junction_deviation() const { return junction_deviation_value; }
+    inline float square_corner_velocity() const { return square_corner_velocity_value; }
+
+    // Max accelerations scaled by the accel efficiency
+    inline const COORDS & effective_print_accel() const { return effective_print_accel_value; }
+    inline const COORDS & effective_move_accel() const { return effective_move_accel_value; }
+};
+
+// Values of a classic jerk move that only depend on its direction, feed rate and whether it
+// extrudes, but not on its length (see DirectionCache.h)
+typedef struct _MOVE_FACTORS {
+    float jerk_magnitude;       // mm/s
+    float accel_time;           // s
+    float accel_magnitude;      // mm/s^2
+    float speed_magnitude;      // mm/s
+} MOVE_FACTORS;
+
+// Motion models. Each one is a policy class with the same interface, the parse loop is
+// instantiated for every model (see with_kinematics()) so that no move goes through a virtual
+// call or a switch. Instances hold no state shared with other instances, so estimators with
+// different configs can run on separate threads
+
+// Marlin classic jerk: every move starts and ends at the jerk speed, independently of its
+// neighbours
+template <class Parameters> class BasicClassicJerkKinematics {
+protected:
+    Parameters parameters;
+    float max_jerk_magnitude;
+
+public:
+    // The duration of a move does not depend on the moves before it
+    static const bool MEMORYLESS = true;
+
+    // The duration is split into get_move_factors() and get_factored_duration()
+    static const bool FACTORED = true;
+
+    explicit BasicClassicJerkKinematics(const Config &config) : parameters(config), max_jerk_magnitude(Utils::get_euclidean_length(parameters.max_jerk())) {}
+
+    // Returns the duration in seconds of a move along the given movement vector at the
+    // given feed rate (mm/s). The length of the movement must be greater than 0
+    inline float get_move_duration(const COORDS &movement, float rate) {
+        float accel_time;
+        return get_move_duration(movement, rate, accel_time);
+    }
+
+    // As above, also returning the time spent accelerating (which equals the time spent decelerating)
+    inline float get_move_duration(const COORDS &movement, float rate, float &accel_time) {
+        float length = Utils::get_euclidean_length(movement);
+        MOVE_FACTORS factors;
+        get_move_factors(movement, length, rate, factors);
+        return get_factored_duration(factors, length, accel_time);
+    }
+
+    // Computes the part of the duration that does not depend on the length of the move
+    inline void get_move_factors(const COORDS &movement, float length, float rate, MOVE_FACTORS &factors) {
+        float rate_speed_factor = parameters.speed_multiplier() * rate / length;
+        COORDS target_speed_components = Utils::map(movement, [=](float c) { return c * rate_speed_factor; });
+
+        // Calculate the individual jerk components
+        float jerk_speed_factor = max_jerk_magnitude / length;
+        COORDS jerk_speed = Utils::map(movement, [=](float c) { return std::abs(c) * jerk_speed_factor; });
+
+        // Check if the components exceed the max jerk per component. If so, reduce all
+        // components by the required factor to comply with the max jerk settings
+        COORDS jerk_reduce_factor = Utils::map(jerk_speed, parameters.max_jerk(), [](float jc, float mc) { return jc > mc ? mc / jc : 1.0f; });
+        float jerk_multiplier = Utils::reduce(jerk_reduce_factor, [](float c, float factor) { return std::min (factor, c); }, 1.0);
+        float jerk_efficiency = parameters.jerk_efficiency();
+        jerk_speed = Utils::map(jerk_speed, [=](float c) { return c * jerk_multiplier * jerk_efficiency; });
+
+        // Calculate the magnitude of the final jerk vector
+        float jerk_magnitude = Utils::get_euclidean_length(jerk_speed);
+
+        // Calculate the speed delta for the acceleration and deceleration phase
+        COORDS speed_delta_components = Utils::map(target_speed_components, jerk_speed, [](float sc, float jc) { return Utils::pos(std::abs(sc) - jc); });
+
+        // Calculate the time required to complete the acceleration
+        const COORDS &max_accel = movement.e != 0.0 ? parameters.max_print_accel() : parameters.max_move_accel();
+        COORDS accel_time_components = Utils::map(speed_delta_components, max_accel, [] (float sc, float ac) { return sc / ac; });
+        float accel_time = Utils::reduce(accel_time_components, [] (float c, float t) { return std::max(c, t); }, accel_time_components.x);
+
+        float accel_magnitude = 0.0;
+        if (accel_time > EPSILON) {
+            // Calculate the actual acceleration per component based on accel_time and speed_delta_components
+            COORDS accel = Utils::map(speed_delta_components, [=] (float c) { return c / accel_time; });
+
+            // Calculate the magnitude of the acceleration vector
+            accel_magnitude = Utils::get_euclidean_length(accel) * parameters.accel_efficiency();
+        } else {
+            accel_time = 0.0;
+        }
+
+        factors.jerk_magnitude = jerk_magnitude;
+        factors.accel_time = accel_time;
+        factors.accel_magnitude = accel_magnitude;
+        factors.speed_magnitude = Utils::get_euclidean_length(target_speed_components);
+    }
+
+    // Returns the duration of a move of the given length from its factors
+    static inline float get_factored_duration(const MOVE_FACTORS &factors, float length, float &accel_time) {
+        float jerk_magnitude = factors.jerk_magnitude, accel_magnitude = factors.accel_magnitude, speed_magnitude = factors.speed_magnitude;
+        accel_time = factors.accel_time;
+
+        // Full acceleration (a*t^2 / 2) and deceleration (a*t^2 / 2) possible
+        if (length > (2 * jerk_magnitude + accel_magnitude * accel_time) * accel_time) {
+            return accel_time * 2 + (length - (2 * jerk_magnitude + accel_magnitude * accel_time) * accel_time) / speed_magnitude;
+        }
+
+        // l = 2 * (((t / 2) * a / 2 + js) * (t / 2)) = ((t / 4) * a + js) * t = t^2 * a / 4 + t * js
+        // t^2 * a / 4 + t * js - l = 0 => t = (-js + sqrt(js^2 + a*l)) / 2*(a / 4)
+        return (sqrt(jerk_magnitude * jerk_magnitude + accel_magnitude * length) - jerk_magnitude) / (accel_magnitude / 2);
+    }
+};
+
+
+// Common part of the junction based models. The junction speed between two moves only depends on
+// the angle between them, the move then accelerates from it to the feed rate. There is no look
+// ahead, so the move is assumed to decelerate to its entry speed again
+template <class Parameters> class BasicJunctionKinematics {
+protected:
+    Parameters parameters;
+    COORDS previous_direction;
+    float previous_speed;
+
+    // Returns sin(theta / 2) / (1 - sin(theta / 2)) for the angle theta between the previous
+    // move and the reversed current one, which is 0 for a reversal and infinite for a straight line
+    inline float get_junction_factor(const COORDS &direction) const {
+        float cos_theta = -(direction.x * previous_direction.x + direction.y * previous_direction.y
+                + direction.z * previous_direction.z + direction.e * previous_direction.e);
+        float sin_theta_d2 = std::sqrt(Utils::pos(0.5f * (1.0f - cos_theta)));
+        return sin_theta_d2 / (1.0f - sin_theta_d2);
+    }
+
+    // Returns the highest acceleration along the direction that no axis limit is exceeded with,
+    // scaled by the accel efficiency
+    inline float get_acceleration(const COORDS &direction) const {
+        const COORDS &max_accel = direction.e != 0.0 ? parameters.effective_print_accel() : parameters.effective_move_accel();
+        COORDS limits = Utils::map(direction, max_accel, [](float dc, float ac) {
+            return dc != 0.0f && ac > 0.0f ? ac / std::abs(dc) : INFINITY;
+        });
+        return Utils::reduce(limits, [](float c, float a) { return std::min(c, a); }, INFINITY);
+    }
+
+    // Duration of a move that starts and ends at entry_speed and cruises at speed in between
+    static inline float get_trapezoid_duration(float length, float speed, float entry_speed, float accel, float &accel_time) {
+        accel_time = 0.0;
+        if (entry_speed >= speed || !std::isfinite(accel))
+            return length / speed;
+
+        float accel_length = (speed * speed - entry_speed * entry_speed) / (2 * accel);
+        if (2 * accel_length <= length) {
+            accel_time = (speed - entry_speed) / accel;
+            return 2 * accel_time + (length - 2 * accel_length) / speed;
+        }
+
+        // The feed rate is not reached, v_peak^2 = v_entry^2 + 2 * a * (l / 2)
+        float peak_speed = std::sqrt(entry_speed * entry_speed + accel * length);
+        accel_time = (peak_speed - entry_speed) / accel;
+        return 2 * accel_time;
+    }
+
+    BasicJunctionKinematics(const Config &config) : parameters(config) {
+        reset();
+    }
+
+    // junction_speed2 converts the junction factor and acceleration to the squared junction speed
+    template <class JunctionSpeed2> inline float get_duration(const COORDS &movement, float rate, float &accel_time, JunctionSpeed2 junction_speed2) {
+        float length = Utils::get_euclidean_length(movement);
+        COORDS direction = Utils::map(movement, [=](float c) { return c / length; });
+        float speed = parameters.speed_multiplier() * rate;
+        float accel = get_acceleration(direction);
+
+        float entry_speed = 0.0;
+        if (previous_speed > 0.0) {
+            // A straight line is only limited by the feed rates
+            float factor = get_junction_factor(direction);
+            entry_speed = std::isinf(factor) ? INFINITY : std::sqrt(junction_speed2(factor, accel));
+            entry_speed = std::min(entry_speed, std::min(speed, previous_speed));
+        }
+
+        previous_direction = direction;
+        previous_speed = speed;
+        return get_trapezoid_duration(length, speed, entry_speed, accel, accel_time);
+    }
+
+public:
+    static const bool MEMORYLESS = false;
+
+    // The entry speed depends on the previous move, there are no per move factors
+    static const bool FACTORED = false;
+
+    // Forgets the previous move, the next move starts from a standstill
+    inline void reset() {
+        previous_direction = { 0.0, 0.0, 0.0, 0.0 };
+        previous_speed = 0.0;
+    }
+};
+
+// Marlin junction deviation: v^2 = a * d * sin(theta / 2) / (1 - sin(theta / 2))
+template <class Parameters> class BasicJunctionDeviationKinematics : public BasicJunctionKinematics<Parameters> {
+public:
+    explicit BasicJunctionDeviationKinematics(const Config &config) : BasicJunctionKinematics<Parameters>(config) {}
+
+    inline float get_move_duration(const COORDS &movement, float rate) {
+        float accel_time;
+        return get_move_duration(movement, rate, accel_time);
+    }
+
+    inline float get_move_duration(const COORDS &movement, float rate, float &accel_time) {
+        float deviation = this->parameters.junction_deviation();
+        return this->get_duration(movement, rate, accel_time, [=](float factor, float accel) { return accel * deviation * factor; });
+    }
+};
+
+// Klipper square corner velocity: the junction deviation is derived from the acceleration, so
+// that a 90 degree corner is taken at exactly the square corner velocity. The acceleration cancels
+// out, leaving v^2 = scv^2 * (sqrt(2) - 1) * sin(theta / 2) / (1 - sin(theta / 2))
+template <class Parameters> class BasicSquareCornerVelocityKinematics : public BasicJunctionKinematics<Parameters> {
+protected:
+    float scale;
+
+public:
+    explicit BasicSquareCornerVelocityKinematics(const Config &config) : BasicJunctionKinematics<Parameters>(config),
+        scale(this->parameters.square_corner_velocity() * this->parameters.square_corner_velocity() * (std::sqrt(2.0f) - 1.0f)) {}
+
+    inline float get_move_duration(const COORDS &movement, float rate) {
+        float accel_time;
+        return get_move_duration(movement, rate, accel_time);
+    }
+
+    inline float get_move_duration(const COORDS &movement, float rate, float &accel_time) {
+        float scv_scale = scale;
+        return this->get_duration(movement, rate, accel_time, [=](float factor, float accel) { return scv_scale * factor; });
+    }
+};
+
+typedef BasicClassicJerkKinematics<ConfigParameters> ClassicJerkKinematics;
+typedef BasicJunctionDeviationKinematics<ConfigParameters> JunctionDeviationKinematics;
+typedef BasicSquareCornerVelocityKinematics<ConfigParameters> SquareCornerVelocityKinematics;
+
+// Calls operation with a kinematics instance for the given motion model, reading the parameters
+// from the config through the given parameter source
+template <class Parameters, class Operation> inline void with_parameters(const Config &config, MotionModel model, Operation operation) {
+    switch (model) {
+        case MOTION_JUNCTION_DEVIATION: {
+            BasicJunctionDeviationKinematics<Parameters> kinematics (config);
+            operation(kinematics);
+            break;
+        }
+        case MOTION_SQUARE_CORNER_VELOCITY: {
+            BasicSquareCornerVelocityKinematics<Parameters> kinematics (config);
+            operation(kinematics);
+            break;
+        }
+        default: {
+            BasicClassicJerkKinematics<Parameters> kinematics (config);
+            operation(kinematics);
+            break;
+        }
+    }
+}
+
+// Calls operation with a kinematics instance for the motion model of the config. The model is only
+// selected here, operation is instantiated for each of them. In builds with a baked profile, configs
+// equal to it use the constant folded instances
+template <class Operation> inline void with_kinematics(const Config &config, Operation operation) {
+#ifdef GCODETIMER_BAKED_PROFILE
+    if (BakedProfile::matches(config)) {
+        with_parameters<BakedProfile>(config, BakedProfile::motion_model(), operation);
+        return;
+    }
+#endif
+    with_parameters<ConfigParameters>(config, config.motion_model, operation);
+}
+
+#endif //__INCLUDE_KINEMATICS_H__
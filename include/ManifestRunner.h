@@ -0,0 +1,75 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_MANIFESTRUNNER_H__
+#define __INCLUDE_MANIFESTRUNNER_H__
+
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+#include "FileProcessor.h"
+
+typedef struct _MANIFEST_ENTRY {
+    std::string path;
+    std::string output;         // Empty for the default output name
+    std::string profile;        // Empty for the default config
+} MANIFEST_ENTRY;
+
+// Processes the files listed in a manifest and writes one JSON object per file as soon as it is
+// done. Entries are separated by newlines or NULs, whichever comes first in the manifest, and hold
+// the path of the file, optionally followed by a tab and the output path, and another tab and the
+// name of a profile. In newline separated manifests, empty lines and lines starting with '#' are
+// skipped. The workers read the next entry only when they are done with the previous one, so
+// memory use does not depend on the length of the manifest
+class ManifestRunner {
+protected:
+    std::istream *manifest;
+    std::ostream *results;
+    FileProcessor &processor;
+    const std::map<std::string, FileProcessor *> &profiles;
+    bool info_only, verify;
+    size_t worker_count;
+
+    std::mutex manifest_mutex, results_mutex;
+    char separator;             // 0 until the first separator has been read
+    uint64_t failed;
+
+    // Returns false at the end of the manifest. Called with manifest_mutex held
+    bool read_entry(MANIFEST_ENTRY &entry);
+    void run_worker();
+    void process(const MANIFEST_ENTRY &entry);
+
+    static void write_string(std::ostream *stream, const std::string &text);
+
+public:
+    // profiles maps the profile names that may appear in the manifest to their processors
+    ManifestRunner(std::istream *manifest, std::ostream *results, FileProcessor &processor, const std::map<std::string, FileProcessor *> &profiles,
+                   bool info_only, bool verify, size_t worker_count);
+
+    // Processes all entries. Returns false if any file failed
+    bool run();
+};
+
+#endif //__INCLUDE_MANIFESTRUNNER_H__
@@ -0,0 +1,117 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_MOVEEXPORTWRITER_H__
+#define __INCLUDE_MOVEEXPORTWRITER_H__
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Utils.h"
+
+// Writes per move records as a columnar binary file, one contiguous array per field so that
+// analysis tools can mmap the file and scan single columns. All values are little endian:
+//
+//   char     magic[8]          "GCTMOVES"
+//   uint32_t version           1
+//   uint32_t column_count
+//   uint64_t record_count
+//   column_count times:
+//     char     name[16]        Zero padded, see COLUMN_NAMES in MoveExportWriter.cc
+//     uint32_t type            COLUMN_U64 or COLUMN_F32
+//     uint32_t element_size    Bytes per value
+//     uint64_t offset          Start of the array in the file, aligned to COLUMN_ALIGNMENT
+//
+// Every column gets room for a given capacity of records and its buffer is written straight to
+// its place in the file whenever it fills up, so memory use is bounded regardless of the number of
+// moves. When the room runs out, the capacity is doubled and the columns written so far are moved
+// apart in the file. Unused room is never written and stays a hole in the file
+class MoveExportWriter {
+public:
+    enum ColumnType {
+        COLUMN_U64 = 0,
+        COLUMN_F32 = 1
+    };
+
+    static const uint32_t VERSION = 1;
+    static const size_t COLUMN_ALIGNMENT = 64;
+
+protected:
+    enum Column {
+        OFFSET, LINE, DX, DY, DZ, DE, FEEDRATE, ACCEL_TIME, DURATION,
+        COLUMN_COUNT
+    };
+
+    static const size_t BUFFER_SIZE = 64 * 1024;
+
+    typedef struct _COLUMN_BUFFER {
+        std::vector<char> data;
+        size_t used;
+        uint64_t offset;            // File position of the next write
+    } COLUMN_BUFFER;
+
+    std::string filename;
+    std::fstream output;
+    COLUMN_BUFFER columns[COLUMN_COUNT];
+    uint64_t capacity, record_count;
+    bool failed;
+
+    template <typename T> inline void append(Column column, T value) {
+        COLUMN_BUFFER &buffer = columns[column];
+        if (buffer.used + sizeof(T) > buffer.data.size())
+            flush(buffer);
+        memcpy(buffer.data.data() + buffer.used, &value, sizeof(T));
+        buffer.used += sizeof(T);
+    }
+
+    void flush(COLUMN_BUFFER &buffer);
+
+    // Doubles the capacity, moving the columns to their new places
+    void grow();
+
+public:
+    // capacity is the expected number of records, a close guess keeps the columns from being moved
+    MoveExportWriter(const std::string &filename, uint64_t capacity);
+
+    // Adds a move. rate is the feed rate in mm/s, times are in seconds
+    inline void add(uint64_t offset, uint64_t line, const COORDS &movement, float rate, float accel_time, float duration) {
+        if (record_count == capacity)
+            grow();
+        append(OFFSET, offset);
+        append(LINE, line);
+        append(DX, movement.x);
+        append(DY, movement.y);
+        append(DZ, movement.z);
+        append(DE, movement.e);
+        append(FEEDRATE, rate);
+        append(ACCEL_TIME, accel_time);
+        append(DURATION, duration);
+        record_count++;
+    }
+
+    // Writes the remaining records and the header. Returns false if the file could not be written
+    bool close();
+};
+
+#endif //__INCLUDE_MOVEEXPORTWRITER_H__
@@ -0,0 +1,81 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_MOVEMEMO_H__
+#define __INCLUDE_MOVEMEMO_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+// Bounded memo of the durations of move sequences, keyed by a hash of their relative movements
+// and feed rates (see GCodeTimeEstimator::MemoizingKinematics). The moves and their durations are
+// stored in fixed size slots of an arena that grows up to a maximum size, after which the least
+// recently used slot is reused. A lookup only hits if the moves are the same as well, so that
+// sequences with the same key are not mixed up. Not thread safe, every estimator uses its own instance
+class MoveMemo {
+public:
+    static const size_t MIN_SEQUENCE_MOVES = 4;     // Shorter sequences are cheaper to recompute than to look up
+    static const size_t MAX_SEQUENCE_MOVES = 64;
+    static const size_t DEFAULT_SIZE = 16 * 1024 * 1024;
+
+    // A movement in steps of 1 um, enough for moves of up to 2 km, and the bits of its feed rate
+    typedef struct _QUANTIZED_MOVE {
+        int32_t x, y, z, e;
+        uint32_t rate;
+    } QUANTIZED_MOVE;
+
+protected:
+    static const uint32_t NONE = UINT32_MAX;
+
+    typedef struct _SLOT {
+        uint64_t key;
+        uint32_t count;
+        uint32_t previous, next;        // Neighbours in the LRU list
+    } SLOT;
+
+    size_t capacity;                    // Maximum number of slots
+    std::vector<SLOT> slots;
+    std::vector<QUANTIZED_MOVE> moves;  // MAX_SEQUENCE_MOVES per slot
+    std::vector<float> durations;       // MAX_SEQUENCE_MOVES per slot
+    std::unordered_map<uint64_t, uint32_t> index;
+    uint32_t most_recent, least_recent;
+    uint64_t hits, misses;
+
+    void unlink(uint32_t slot);
+    void link_front(uint32_t slot);
+
+public:
+    explicit MoveMemo(size_t max_size = DEFAULT_SIZE);
+
+    // Returns the durations stored for the key and the same moves, or NULL. A hit makes the entry
+    // the most recently used
+    const float * find(uint64_t key, const QUANTIZED_MOVE *sequence_moves, size_t count);
+
+    // Stores the moves and durations of a sequence of at most MAX_SEQUENCE_MOVES moves
+    void insert(uint64_t key, const QUANTIZED_MOVE *sequence_moves, const float *sequence_durations, size_t count);
+
+    uint64_t get_hits() const;
+    uint64_t get_misses() const;
+};
+
+#endif //__INCLUDE_MOVEMEMO_H__
@@ -0,0 +1,63 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_MOVETABLE_H__
+#define __INCLUDE_MOVETABLE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Utils.h"
+#include "Kinematics.h"
+
+typedef struct _MOVE {
+    COORDS movement;    // mm
+    float rate;         // mm/s
+} MOVE;
+
+// All moves of a gcode file, parsed once so that the file can be estimated repeatedly with
+// different configs without touching the gcode again
+class MoveTable {
+protected:
+    std::string filename;
+    std::vector<MOVE> moves;
+    std::vector<uint64_t> lines;    // Line number of every move
+
+public:
+    MoveTable(const std::string &filename);
+
+    const std::string & get_filename() const;
+    size_t size() const;
+    const std::vector<MOVE> & get_moves() const;
+    uint64_t get_line(size_t index) const;
+
+    // Parses the file. Returns false if it could not be opened
+    bool load();
+
+    // Returns the estimated time of the file in seconds. Matches GCodeTimeEstimator for the same config
+    float estimate(const Config &config) const;
+
+    // Sets the estimated duration of every move in seconds
+    void estimate_moves(const Config &config, std::vector<float> &durations) const;
+};
+
+#endif //__INCLUDE_MOVETABLE_H__
@@ -0,0 +1,49 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_OUTPUTASSEMBLER_H__
+#define __INCLUDE_OUTPUTASSEMBLER_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Replaces removed bytes of the input at offset with a range of the edit text
+typedef struct _EDIT {
+    uint64_t offset;            // Position in the input
+    uint64_t removed;           // Number of input bytes dropped at offset
+    size_t text_start, text_length;
+} EDIT;
+
+// Writes a copy of a file with a sorted list of edits applied. Long unchanged ranges are copied
+// inside the kernel (copy_file_range), the rest is written from a mapping of the input with
+// few vectored writes into a preallocated output file
+class OutputAssembler {
+public:
+    // Spans at least this long are copied kernel side
+    static const uint64_t KERNEL_COPY_THRESHOLD = 1 << 20;
+
+    // Returns false if the output could not be written, the input became shorter than when its edits
+    // were made, or the platform is not supported
+    static bool assemble(const std::string &input_filename, const std::string &output_filename, const std::vector<EDIT> &edits, const std::string &text);
+};
+
+#endif //__INCLUDE_OUTPUTASSEMBLER_H__
@@ -0,0 +1,87 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_OVERRIDECURVES_H__
+#define __INCLUDE_OVERRIDECURVES_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Remaining time of a file as a function of the position in the file and the feed rate override
+// (M220). While the file is estimated, every move is also timed at FACTOR_COUNT override factors,
+// and the time spent so far at each of them is recorded at a checkpoint every CHECKPOINT_BYTES.
+// A query interpolates between the two checkpoints around the offset and between the two sampled
+// factors around the override, so it takes a binary search and a few multiplications. The file
+// written by save() contains (native byte order):
+//
+//   char     magic[8]          "GCTCURVE"
+//   uint32_t version           1
+//   uint32_t factor_count
+//   uint64_t checkpoint_count
+//   uint64_t file_size         Size of the gcode file the curves were built from
+//   float    factors[factor_count]
+//   uint64_t offsets[checkpoint_count]
+//   float    remaining[checkpoint_count][factor_count]     Seconds
+class OverrideCurves {
+public:
+    static const uint32_t VERSION = 1;
+
+    // Factors from 10% to 1000% (Marlin's range of M220), evenly spaced on a log scale with 100%
+    // in the middle
+    static const size_t FACTOR_COUNT = 33;
+    static const size_t UNIT_FACTOR = 16;
+    static const uint64_t CHECKPOINT_BYTES = 32 * 1024;
+
+protected:
+    float factors[FACTOR_COUNT];
+    std::vector<uint64_t> offsets;
+    std::vector<float> remaining;   // FACTOR_COUNT values per checkpoint
+    std::vector<double> elapsed;    // Same layout, only used while building
+    uint64_t file_size;
+    uint64_t next_checkpoint;
+
+public:
+    OverrideCurves();
+
+    inline float get_factor(size_t index) const { return factors[index]; }
+
+    // Building: checkpoints are only added at offsets where needs_checkpoint() returns true, with
+    // the time spent before the offset at every factor. finish() is called with the totals
+    void reset();
+    inline bool needs_checkpoint(uint64_t offset) const { return offset >= next_checkpoint; }
+    void add_checkpoint(uint64_t offset, const double *elapsed_times);
+    void finish(uint64_t file_size, const double *total_times);
+
+    // Return false if the file cannot be written (printing an error) or read, or is not a valid
+    // curve file
+    bool save(const std::string &filename) const;
+    bool load(const std::string &filename);
+
+    uint64_t get_file_size() const;
+    size_t get_checkpoint_count() const;
+
+    // Returns the time in seconds from the line at the given byte offset to the end of the file,
+    // with the given override factor (1 for 100%). Factors outside the sampled range are clamped
+    float get_remaining_time(uint64_t offset, float factor) const;
+};
+
+#endif //__INCLUDE_OVERRIDECURVES_H__
@@ -0,0 +1,73 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_PROFILESET_H__
+#define __INCLUDE_PROFILESET_H__
+
+#include <string>
+#include <vector>
+
+#include "Utils.h"
+#include "Config.h"
+
+// Evaluates every move against several printer profiles at once. The profile parameters are
+// stored as one array per parameter (structure of arrays) padded to a multiple of LANES, so the
+// per profile loop in add_move() is vectorized by the compiler
+class ProfileSet {
+public:
+    static const size_t LANES = 8;
+
+protected:
+    enum Parameter {
+        PRINT_ACCEL_X, PRINT_ACCEL_Y, PRINT_ACCEL_Z, PRINT_ACCEL_E,
+        MOVE_ACCEL_X, MOVE_ACCEL_Y, MOVE_ACCEL_Z, MOVE_ACCEL_E,
+        MAX_JERK_X, MAX_JERK_Y, MAX_JERK_Z, MAX_JERK_E,
+        MAX_JERK_MAGNITUDE,
+        JERK_EFFICIENCY,
+        ACCEL_EFFICIENCY,
+        SPEED_MULTIPLIER,
+        PARAMETER_COUNT
+    };
+
+    std::vector<std::string> names;
+    size_t padded_size;
+    std::vector<float> parameters;  // PARAMETER_COUNT rows of padded_size values
+    std::vector<double> totals;     // Accumulated in double so long prints do not drift
+
+    inline const float * row(Parameter parameter) const {
+        return &parameters[parameter * padded_size];
+    }
+
+public:
+    ProfileSet(const std::vector<Config> &profiles, const std::vector<std::string> &names);
+
+    size_t size() const;
+    const std::string & get_name(size_t profile) const;
+    double get_total(size_t profile) const;
+
+    void reset();
+
+    // Adds the duration of a move with a length greater than 0 to the totals of all profiles.
+    // Gives the same durations as ClassicJerkKinematics::get_move_duration() for each profile
+    void add_move(const COORDS &movement, float rate);
+};
+
+#endif //__INCLUDE_PROFILESET_H__
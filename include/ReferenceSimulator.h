@@ -0,0 +1,152 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_REFERENCESIMULATOR_H__
+#define __INCLUDE_REFERENCESIMULATOR_H__
+
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Config.h"
+#include "MoveTable.h"
+
+// Deviation of the estimate of a single move from the reference
+typedef struct _MOVE_DEVIATION {
+    uint64_t line;
+    float estimate, reference;      // s
+} MOVE_DEVIATION;
+
+typedef struct _REFERENCE_REPORT {
+    std::string filename;
+    double estimated_time, reference_time;     // s
+    uint64_t moves, dropped_moves;
+    uint64_t steps, interrupts;
+    double mean_deviation;          // Mean absolute deviation per move, s
+    float p95_deviation;            // 95th percentile of the absolute deviation per move, s
+    double total_deviation;         // Sum of the absolute deviations per move, s
+    std::vector<MOVE_DEVIATION> worst_moves;
+    float load_seconds, estimate_seconds, simulate_seconds;
+} REFERENCE_REPORT;
+
+// Reference engine for validating the estimator. Instead of a formula per move, it simulates the
+// firmware of the motion model of a config:
+//
+//   - Marlin (classic jerk and junction deviation): moves are converted to integer steps and
+//     planned in a buffer of PLANNER_BUFFER_SIZE blocks, which is assumed to be kept full. A block
+//     is planned with the blocks behind it when it starts, so short moves cannot reach the speeds
+//     a longer look ahead would allow. Every block is then stepped with the trapezoid and the
+//     timer arithmetic of the stepper interrupt, including double and quad stepping. Moves of
+//     less than MIN_STEPS_PER_SEGMENT steps are dropped, their distance is added to the next move
+//   - Klipper (square corner velocity): moves are planned with the look ahead of Klipper over the
+//     whole file, including the centripetal junction limit and the smoothed acceleration to
+//     deceleration. Steps are scheduled at their exact times, so the trapezoids are the durations
+//
+// The per axis maxima of the config are used as the firmware would, without the efficiency
+// factors of the estimator. The stepping loop only iterates over the acceleration and
+// deceleration phases, a cruise phase is one event however many steps it takes
+class ReferenceSimulator {
+public:
+    // Marlin defaults
+    static const size_t PLANNER_BUFFER_SIZE = 16;           // One slot stays empty
+    static const uint32_t STEPPER_TIMER_RATE = 2000000;     // Hz
+    static const uint32_t MIN_STEPS_PER_SEGMENT = 6;
+    static const uint32_t MINIMAL_STEP_RATE = 120;          // steps/s
+    static const uint32_t MAX_STEP_FREQUENCY = 40000;       // steps/s
+    static const uint32_t DOUBLE_STEP_FREQUENCY = 10000;    // steps/s, stepping twice per interrupt above
+    static constexpr float MINIMUM_PLANNER_SPEED = 0.05f;   // mm/s
+
+    // Klipper defaults
+    static constexpr float MINIMUM_CRUISE_RATIO = 0.5f;
+    static constexpr float INSTANT_CORNER_VELOCITY = 1.0f;  // mm/s, extruder
+
+    // Moves with the largest deviation that are reported
+    static const size_t WORST_MOVE_COUNT = 5;
+
+protected:
+    typedef struct _BLOCK {
+        size_t move;                    // Index in the table
+        uint32_t steps[4];
+        uint32_t step_event_count;
+        float millimeters;
+        float acceleration;             // mm/s^2
+        uint32_t acceleration_steps_per_s2;
+        float nominal_speed;            // mm/s
+        uint32_t nominal_rate;          // steps/s
+        float max_entry_speed_sqr, entry_speed_sqr;
+        bool nominal_length;            // The nominal speed is reached from any entry speed
+        bool entry_fixed;               // The block before it has started
+    } BLOCK;
+
+    typedef struct _KLIPPER_MOVE {
+        float move_d, accel;
+        COORDS axes_r;                  // Direction, e relative to the xyz distance
+        bool kinematic;
+        float max_cruise_v2, max_start_v2, max_smoothed_v2;
+        float delta_v2, smooth_delta_v2;
+    } KLIPPER_MOVE;
+
+    const Config config;
+
+    // Marlin state
+    int64_t position[4];                // steps
+    double target[4];                   // mm, not rounded
+    float previous_speed[4], previous_nominal_speed, previous_safe_speed;
+    float previous_unit_vector[4];
+    std::deque<BLOCK> blocks;
+
+    uint64_t steps, interrupts;
+
+    // Returns the timer interval in ticks for the step rate and sets the steps per interrupt
+    static uint32_t calc_timer_interval(uint32_t step_rate, uint32_t &step_loops);
+
+    // Returns the entry speed limit of a block from its per axis speeds
+    float get_jerk_junction_speed_sqr(const BLOCK &block, const float *current_speed, float &safe_speed);
+    float get_deviation_junction_speed_sqr(const BLOCK &block, const float *unit_vector);
+
+    // Adds a move to the planner. Returns false if it is dropped
+    bool add_block(size_t index, const MOVE &move);
+    // Recalculates the entry speeds of the planned blocks
+    void recalculate();
+    // Steps the first block from its entry speed to the given exit speed, returns its duration in s
+    double execute_block(const BLOCK &block, float exit_speed_sqr);
+
+    double simulate_marlin(const MoveTable &table, std::vector<float> &durations, uint64_t &dropped);
+    double simulate_klipper(const MoveTable &table, std::vector<float> &durations);
+
+public:
+    ReferenceSimulator(const Config &config = *Config::get());
+
+    // Sets the reference duration of every move of the table in seconds, 0 for dropped moves,
+    // and returns the total
+    double simulate(const MoveTable &table, std::vector<float> &durations, uint64_t &dropped_moves);
+
+    uint64_t get_step_count() const;
+    uint64_t get_interrupt_count() const;
+
+    // Loads, estimates and simulates a file. Returns false if it cannot be read
+    static bool validate(const std::string &filename, const Config &config, REFERENCE_REPORT &report);
+    static void print_report(const REFERENCE_REPORT &report, std::ostream *stream);
+};
+
+#endif //__INCLUDE_REFERENCESIMULATOR_H__
@@ -0,0 +1,75 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_RESULTCACHE_H__
+#define __INCLUDE_RESULTCACHE_H__
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "Config.h"
+#include "EmissionPolicy.h"
+#include "OutputAssembler.h"
+
+// On-disk cache of estimation results, keyed by a hash of the file contents, the config values
+// and the program version. Identical files share their entries regardless of their names. A
+// stat index (device, inode, size, modification time) avoids rehashing unchanged files. The
+// cache is kept below a maximum size by evicting the least recently used entries
+class ResultCache {
+protected:
+    boost::filesystem::path folder;
+    uint64_t max_size;
+    uint64_t settings_hash;
+
+    std::mutex mutex;
+    uint64_t current_size;      // Only known after the first store
+    bool size_known;
+
+    bool get_content_key(const std::string &filename, std::string &key);
+    boost::filesystem::path get_entry_path(const std::string &key, const char *extension);
+
+    bool read_entry(const boost::filesystem::path &path, std::vector<char> &data);
+    void write_entry(const boost::filesystem::path &path, const std::vector<char> &data);
+    void evict();
+
+public:
+    ResultCache(const std::string &folder, uint64_t max_size, const Config &config);
+
+    // Estimated times are also keyed by estimator_settings, a hash of the approximations they
+    // were estimated with (see FileProcessor::get_settings_hash())
+    bool get_time(const std::string &filename, uint64_t estimator_settings, float &time);
+    void put_time(const std::string &filename, uint64_t estimator_settings, float time);
+
+    // The edits of a ZeroCopyDecorator, which rebuild the decorated file without parsing it. Keyed
+    // by the total time they were made for and the estimator settings recorded in the header as well
+    bool get_edits(const std::string &filename, uint64_t estimator_settings, const EmissionPolicy &policy, float total_time, std::vector<EDIT> &edits, std::string &text,
+                   uint64_t &emitted_messages);
+    void put_edits(const std::string &filename, uint64_t estimator_settings, const EmissionPolicy &policy, float total_time, const std::vector<EDIT> &edits, const std::string &text,
+                   uint64_t emitted_messages);
+
+    static std::string get_default_folder();
+};
+
+#endif //__INCLUDE_RESULTCACHE_H__
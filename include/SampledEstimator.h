@@ -0,0 +1,76 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_SAMPLEDESTIMATOR_H__
+#define __INCLUDE_SAMPLEDESTIMATOR_H__
+
+#include <iostream>
+#include <cstdint>
+#include <random>
+
+#include "GCodeProcessorBase.h"
+
+typedef struct _SAMPLED_ESTIMATE {
+    float time;                 // Estimated total time in seconds
+    float margin;               // Half width of the 95% confidence interval in seconds, 0 if exact
+    uint64_t sampled_bytes;
+    bool exact;                 // The whole file was processed
+} SAMPLED_ESTIMATE;
+
+// Approximate estimator for files too large to wait for. The file is split into equally sized
+// strata and a short byte range is processed at a random position inside each of them. Every
+// sample yields a time per byte, which is extrapolated to the size of the file. The lines before
+// a sample are processed as well but not counted, so that it starts with the positions, the feed
+// rate and the junction speed the printer has there instead of from a standstill
+class SampledEstimator : public GCodeProcessorBase {
+protected:
+    uint64_t input_size;
+    std::mt19937_64 random;
+
+    // State of the current sample. Lines are only counted from sample_start on, and once the
+    // position of every axis they move and the feed rate are known
+    uint8_t known_params;
+    uint64_t sample_start;
+    double sample_time;
+    uint64_t sample_bytes;
+
+    virtual void process_line(const GCODE_LINE &line, const GCODE_COMMAND &command, float line_duration);
+
+    // Processes up to SAMPLE_SIZE bytes starting at the first line after start, after the lead-in.
+    // Sets read_bytes to the bytes read. Returns false if the sample holds no complete line
+    template <class K> bool process_sample(uint64_t start, K &kinematics, uint64_t &read_bytes);
+
+    void estimate_exact(SAMPLED_ESTIMATE &result);
+
+public:
+    static const uint64_t SAMPLE_SIZE = 64 * 1024;
+    static const uint64_t LEAD_IN_SIZE = 8 * 1024;
+    static const size_t INITIAL_SAMPLE_COUNT = 32;
+
+    // input_size is the size of the input in bytes, the input must be seekable
+    SampledEstimator(std::istream *input, uint64_t input_size, const Config &config = *Config::get());
+
+    // Estimates the total time from sample_count samples, or exactly if they would cover half of
+    // the file or more. Every call draws new sample positions
+    void estimate(size_t sample_count, SAMPLED_ESTIMATE &result);
+};
+
+#endif //__INCLUDE_SAMPLEDESTIMATOR_H__
@@ -0,0 +1,108 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_SHARDCOORDINATOR_H__
+#define __INCLUDE_SHARDCOORDINATOR_H__
+
+#include <chrono>
+#include <deque>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "FileProcessor.h"
+
+// Processes a batch of files in separate worker processes, so that a file that crashes or hangs a
+// worker does not take down the rest of the batch. Workers are started with --worker, either by
+// running this executable or through a command template (e.g. a wrapper that runs them inside a
+// container), and read the NUL-terminated names of the files to process from stdin. Files are
+// handed out in shards, and the workers write one result line per file to stdout:
+//
+//   ok|error <estimated seconds> <emitted messages> <input bytes>
+//
+// The files of a worker that exits or exceeds the time budget are handed to the other workers, and
+// a replacement is started. A file that was being processed by a crashing worker is retried once,
+// one that timed out fails right away. Results are printed in the order of the inputs
+class ShardCoordinator {
+protected:
+    static const size_t MAX_SHARD_SIZE = 64;
+    static const unsigned MAX_ATTEMPTS = 2;
+    static const unsigned MAX_STARTUP_FAILURES = 4;    // Per process, for workers that exit without any result
+
+    typedef struct _WORKER {
+        int pid;                        // -1 once exited
+        int input_fd, output_fd;        // Its stdin and stdout, -1 once closed
+        std::deque<size_t> assigned;    // Inputs handed to the worker without a result yet, in order
+        std::string received;           // Incomplete result line
+        std::chrono::steady_clock::time_point file_start, busy_start;
+        bool produced;                  // Has sent at least one result
+        uint64_t files, bytes, restarts;
+        double busy_seconds;
+    } WORKER;
+
+    typedef struct _FILE_RESULT {
+        bool done, success;
+        unsigned attempts;
+        float estimated_time;
+        uint64_t bytes;
+    } FILE_RESULT;
+
+    const std::vector<std::string> &inputs;
+    size_t process_count;
+    std::vector<std::string> worker_args;
+    std::string command_template;
+    float timeout;
+    bool info_only;
+
+    std::vector<WORKER> workers;
+    std::vector<FILE_RESULT> results;
+    std::deque<size_t> pending;
+    size_t shard_size, next_output, failed;
+    unsigned startup_failures;
+
+    bool start_worker(size_t index);
+    void assign_shard(size_t index);
+    void read_results(size_t index);
+    void complete_file(size_t index, const std::string &result);
+    // Requeues the files of a worker that exited or was killed, and starts a replacement
+    void handle_exit(size_t index, bool timed_out);
+    void fail(size_t file);
+    // Prints the results that are done, in the order of the inputs
+    void print_results();
+    void print_report(double seconds);
+
+public:
+    ShardCoordinator(const std::vector<std::string> &inputs, size_t process_count, const std::vector<std::string> &worker_args,
+                     const std::string &command_template, float timeout, bool info_only);
+
+    // Processes all inputs. Returns false if any file failed or if the platform is not supported
+    bool run();
+
+    // Processes the files named on the input until it ends, writing one result line per file. With
+    // verify, outputs that do not move like their input fail (see FileProcessor::verify())
+    static void run_worker(FileProcessor &processor, bool info_only, bool export_moves, bool curves, bool verify, std::istream *input, std::ostream *output);
+
+    // Returns the name of the temporary file that workers write an output to before renaming it
+    static std::string get_temp_filename(const std::string &output_filename);
+};
+
+#endif //__INCLUDE_SHARDCOORDINATOR_H__
@@ -27,9 +27,13 @@
 #include <fstream>
 #include <iomanip>
 
-#include <functional>
-
 #include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 
 #define EPSILON 0.0000005f
 
@@ -46,6 +50,32 @@ public:
         *stream << std::setw(2) << std::setfill('0') << h << "h" << std::setw(2) << std::setfill('0') << m << "m" << std::setw(2) << std::setfill('0') << s << "s";
     }
 
+    // Parses a time as written by format_time ("01h02m03s"), as "01:02:03" or as seconds
+    static inline bool parse_time(const std::string &text, float &time) {
+        int h, m, s, n = 0;
+        if ((sscanf(text.c_str(), "%dh%dm%ds%n", &h, &m, &s, &n) == 3 || sscanf(text.c_str(), "%d:%d:%d%n", &h, &m, &s, &n) == 3) && n == (int)text.size()) {
+            time = 3600 * h + 60 * m + s;
+            return true;
+        }
+        return sscanf(text.c_str(), "%f%n", &time, &n) == 1 && n == (int)text.size();
+    }
+
+    // Runs op(i) for every i in [0, count) on all available cores
+    template<typename Op>
+    static inline void parallel_for(size_t count, Op op) {
+        size_t thread_count = std::min((size_t)std::max(std::thread::hardware_concurrency(), 1u), count);
+        std::atomic<size_t> next (0);
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < thread_count; t++) {
+            threads.emplace_back([&]() {
+                for (size_t i = next++; i < count; i = next++)
+                    op(i);
+            });
+        }
+        for (std::vector<std::thread>::iterator it = threads.begin(); it != threads.end(); ++it)
+            it->join();
+    }
+
     static inline float pos(float input) {
         return input > 0.0 ? input : 0.0;
     }
@@ -58,16 +88,20 @@ public:
         return sqrt(coords.x * coords.x + coords.y * coords.y + coords.z * coords.z + coords.e * coords.e);
     }
 
-    static inline COORDS map(COORDS input, std::function<float (float)> op) {
+    // The operations are template parameters rather than std::function so that the lambdas in the
+    // per-move code get inlined and never allocate
+    template<typename Op>
+    static inline COORDS map(COORDS input, Op op) {
         return { op(input.x), op(input.y), op(input.z), op(input.e) };
     }
 
-
-    static inline COORDS map(COORDS a, COORDS b, std::function<float (float, float)> op) {
+    template<typename Op>
+    static inline COORDS map(COORDS a, COORDS b, Op op) {
         return { op(a.x, b.x), op(a.y, b.y), op(a.z, b.z), op(a.e, b.e) };
     }
 
-    static inline float reduce(COORDS input, std::function<float (float, float)> op, float acc) {
+    template<typename Op>
+    static inline float reduce(COORDS input, Op op, float acc) {
         acc = op(input.x, acc);
         acc = op(input.y, acc);
         acc = op(input.z, acc);
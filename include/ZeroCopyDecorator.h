@@ -0,0 +1,66 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INCLUDE_ZEROCOPYDECORATOR_H__
+#define __INCLUDE_ZEROCOPYDECORATOR_H__
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "GCodeTimeDecorator.h"
+#include "OutputAssembler.h"
+
+// Decorator that only collects the inserted text and where it goes. The output file is then
+// assembled by OutputAssembler, which copies the unchanged bytes without passing them through
+// a stream
+class ZeroCopyDecorator : public GCodeTimeDecorator {
+protected:
+    std::ostringstream messages;
+    uint64_t input_size;
+    size_t text_end;            // End of the message text already assigned to an edit
+
+    std::vector<EDIT> edits;
+    std::string text;
+
+    // Inserts the messages written since the last edit at the given input offset, in place of
+    // removed input bytes
+    void add_edit(uint64_t offset, uint64_t removed = 0);
+
+    virtual void echo_line(const GCODE_LINE &line);
+    virtual void drop_line(const GCODE_LINE &line);
+
+public:
+    ZeroCopyDecorator(std::istream *input, uint64_t input_size, float total_time, const EmissionPolicy &policy = EmissionPolicy(),
+                      const Config &config = *Config::get());
+
+    void process_file();
+
+    const std::vector<EDIT> & get_edits();
+    const std::string & get_text();
+
+    // Writes the decorated file. Returns false on errors or if the platform is not supported
+    bool write(const std::string &input_filename, const std::string &output_filename);
+};
+
+#endif //__INCLUDE_ZEROCOPYDECORATOR_H__
@@ -0,0 +1,465 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "AsyncIO.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define ASYNCIO_URING
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+AsyncIO::AsyncIO(const vector<string> &inputs, size_t read_ahead, uint64_t max_buffered) : inputs(inputs),
+        read_ahead(max(read_ahead, (size_t)1)), max_buffered(max_buffered), next_read(0), next_input(0), buffered(0),
+        writes_in_flight(0), write_failed(false), stopping(false), ring(NULL) {
+    if (start_ring()) {
+        threads.push_back(thread(&AsyncIO::run_ring, this));
+    } else {
+        for (size_t i = 0; i < max(this->read_ahead, (size_t)2); i++)
+            threads.push_back(thread(&AsyncIO::run_threads, this));
+    }
+}
+
+AsyncIO::~AsyncIO() {
+    {
+        lock_guard<std::mutex> lock (mutex);
+        stopping = true;
+    }
+    wake();
+    for (vector<thread>::iterator it = threads.begin(); it != threads.end(); ++it)
+        it->join();
+    if (ring)
+        close_ring();
+
+    for (map<size_t, REQUEST *>::iterator it = finished_reads.begin(); it != finished_reads.end(); ++it)
+        delete it->second;
+    for (deque<REQUEST *>::iterator it = queued_writes.begin(); it != queued_writes.end(); ++it)
+        delete *it;
+}
+
+bool AsyncIO::is_using_io_uring() {
+    return ring != NULL;
+}
+
+AsyncIO::REQUEST * AsyncIO::take_request() {
+    REQUEST *request = NULL;
+    if (!queued_writes.empty()) {
+        // Writes first, they free memory
+        request = queued_writes.front();
+        queued_writes.pop_front();
+        writes_in_flight++;
+    } else if (!stopping && next_read < inputs.size() && next_read < next_input + read_ahead && buffered < max_buffered) {
+        request = new REQUEST { false, next_read, inputs[next_read], vector<char>(), -1, 0, 0, false, false };
+        next_read++;
+    }
+    return request;
+}
+
+void AsyncIO::complete(REQUEST *request) {
+    if (request->write) {
+        writes_in_flight--;
+        buffered -= request->data.size();
+        if (request->failed) {
+            cerr << "Cannot write " << request->filename << endl;
+            write_failed = true;
+        }
+        delete request;
+    } else {
+        if (request->failed)
+            request->data.clear();
+        buffered += request->data.size();
+        finished_reads[request->index] = request;
+    }
+    changed.notify_all();
+}
+
+bool AsyncIO::next(FILE_BUFFER &buffer) {
+    unique_lock<std::mutex> lock (mutex);
+    if (next_input >= inputs.size())
+        return false;
+
+    changed.wait(lock, [this]() { return finished_reads.count(next_input) > 0; });
+    REQUEST *request = finished_reads[next_input];
+    finished_reads.erase(next_input);
+    next_input++;
+    buffered -= request->data.size();
+    lock.unlock();
+
+    buffer.filename = request->filename;
+    buffer.data.swap(request->data);
+    buffer.valid = !request->failed;
+    delete request;
+
+    // Room for the next read
+    wake();
+    return true;
+}
+
+void AsyncIO::write(const string &filename, vector<char> &&data) {
+    REQUEST *request = new REQUEST { true, 0, filename, move(data), -1, 0, 0, false, false };
+    {
+        unique_lock<std::mutex> lock (mutex);
+        changed.wait(lock, [this]() { return buffered <= max_buffered || (queued_writes.empty() && writes_in_flight == 0); });
+        queued_writes.push_back(request);
+        buffered += request->data.size();
+    }
+    wake();
+}
+
+bool AsyncIO::finish() {
+    unique_lock<std::mutex> lock (mutex);
+    changed.wait(lock, [this]() { return queued_writes.empty() && writes_in_flight == 0; });
+    return !write_failed;
+}
+
+void AsyncIO::run_request(REQUEST *request) {
+    if (request->write) {
+        ofstream output (request->filename, ios::binary | ios::trunc);
+        output.write(request->data.data(), request->data.size());
+        output.close();
+        request->failed = !output;
+    } else {
+        ifstream input (request->filename, ios::binary);
+        if (!input.is_open()) {
+            request->failed = true;
+            return;
+        }
+
+        // Pipes and other inputs that cannot seek have no size, they are read in blocks until their end
+        input.seekg(0, ios::end);
+        streamoff size = input.tellg();
+        if (size >= 0) {
+            input.seekg(0);
+            request->data.resize(size);
+            input.read(request->data.data(), request->data.size());
+            request->data.resize(input.gcount());
+        } else {
+            input.clear();
+            size_t used = 0;
+            while (input) {
+                request->data.resize(used + STREAM_BLOCK_SIZE);
+                input.read(request->data.data() + used, STREAM_BLOCK_SIZE);
+                used += input.gcount();
+            }
+            request->data.resize(used);
+        }
+        request->failed = input.bad();
+    }
+}
+
+void AsyncIO::run_threads() {
+    unique_lock<std::mutex> lock (mutex);
+    while (true) {
+        REQUEST *request = take_request();
+        if (request) {
+            lock.unlock();
+            run_request(request);
+            lock.lock();
+            complete(request);
+        } else if (stopping) {
+            break;
+        } else {
+            changed.wait(lock);
+        }
+    }
+}
+
+#ifdef ASYNCIO_URING
+
+// Operations of a request, stored in the low bits of the completion's user data
+enum RingOperation {
+    RING_OPEN, RING_STAT, RING_TRANSFER, RING_CLOSE,
+    RING_OPERATION_MASK = 7
+};
+
+static const unsigned RING_ENTRIES = 64;
+static const uint64_t MAX_TRANSFER = 1 << 30;
+static const uint64_t WAKE_USER_DATA = 0;
+
+struct AsyncRing {
+    int fd, wake_fd;
+    uint64_t wake_value;
+    unsigned *sq_tail, sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, cq_mask;
+    io_uring_sqe *sqes;
+    io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned to_submit;
+    size_t active;                  // Requests started and not completed
+    map<void *, struct statx> stats;    // Stat results of the reads being opened
+};
+
+static int ring_setup(unsigned entries, io_uring_params *params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int ring_register(int fd, unsigned opcode, void *arg, unsigned count) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+// Returns a cleared submission queue entry, which is submitted on the next ring_enter()
+static io_uring_sqe * get_sqe(AsyncRing *ring, uint8_t opcode, int fd, const void *addr, uint32_t len, uint64_t offset, uint64_t user_data) {
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & ring->sq_mask;
+    io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)addr;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+    return sqe;
+}
+
+static inline uint64_t get_user_data(void *request, RingOperation operation) {
+    return (uint64_t)request | operation;
+}
+
+bool AsyncIO::start_ring() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = ring_setup(RING_ENTRIES, &params);
+    if (fd < 0)
+        return false;
+
+    // Opening and closing files through the ring needs Linux 5.6
+    vector<char> probe_buffer (sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+    io_uring_probe *probe = (io_uring_probe *)probe_buffer.data();
+    bool supported = (params.features & IORING_FEAT_SINGLE_MMAP) && ring_register(fd, IORING_REGISTER_PROBE, probe, 256) >= 0;
+    const uint8_t operations[] = { IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE };
+    for (size_t i = 0; supported && i < sizeof(operations); i++)
+        supported = operations[i] <= probe->last_op && (probe->ops[operations[i]].flags & IO_URING_OP_SUPPORTED);
+    int wake_fd = supported ? eventfd(0, EFD_CLOEXEC) : -1;
+    if (wake_fd < 0) {
+        close(fd);
+        return false;
+    }
+
+    AsyncRing *ring = new AsyncRing;
+    ring->fd = fd;
+    ring->wake_fd = wake_fd;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring->sq_ring_size = ring->cq_ring_size = max(ring->sq_ring_size, ring->cq_ring_size);
+    ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = ring->sq_ring;
+    ring->sqes = (io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->sq_ring != MAP_FAILED)
+            munmap(ring->sq_ring, ring->sq_ring_size);
+        close(wake_fd);
+        close(fd);
+        delete ring;
+        return false;
+    }
+
+    char *sq = (char *)ring->sq_ring, *cq = (char *)ring->cq_ring;
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+    ring->to_submit = 0;
+    ring->active = 0;
+    this->ring = ring;
+    return true;
+}
+
+void AsyncIO::run_ring() {
+    // Each request has at most two operations in flight, plus one for the wake up read
+    const size_t max_active = (RING_ENTRIES - 1) / 2;
+
+    get_sqe(ring, IORING_OP_READ, ring->wake_fd, &ring->wake_value, sizeof(ring->wake_value), 0, WAKE_USER_DATA);
+    while (true) {
+        // Start new requests. Reads open and stat the file at the same time, writes only open it
+        {
+            lock_guard<std::mutex> lock (mutex);
+            REQUEST *request;
+            while (ring->active < max_active && (request = take_request())) {
+                ring->active++;
+                if (request->write) {
+                    request->pending = 1;
+                    get_sqe(ring, IORING_OP_OPENAT, AT_FDCWD, request->filename.c_str(), 0666, 0, get_user_data(request, RING_OPEN))
+                        ->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+                } else {
+                    request->pending = 2;
+                    get_sqe(ring, IORING_OP_OPENAT, AT_FDCWD, request->filename.c_str(), 0, 0, get_user_data(request, RING_OPEN))
+                        ->open_flags = O_RDONLY | O_CLOEXEC;
+                    get_sqe(ring, IORING_OP_STATX, AT_FDCWD, request->filename.c_str(), STATX_TYPE | STATX_SIZE, (uint64_t)&ring->stats[request],
+                        get_user_data(request, RING_STAT));
+                }
+            }
+            if (stopping && ring->active == 0)
+                break;
+        }
+
+        // Submit everything prepared in one call and wait for at least one completion
+        int submitted = ring_enter(ring->fd, ring->to_submit, 1, IORING_ENTER_GETEVENTS);
+        if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            cerr << "io_uring_enter failed: " << strerror(errno) << endl;
+            break;
+        }
+        if (submitted > 0)
+            ring->to_submit -= submitted;
+
+        unsigned head = *ring->cq_head;
+        while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            io_uring_cqe cqe = ring->cqes[head & ring->cq_mask];
+            head++;
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+            if (cqe.user_data == WAKE_USER_DATA) {
+                get_sqe(ring, IORING_OP_READ, ring->wake_fd, &ring->wake_value, sizeof(ring->wake_value), 0, WAKE_USER_DATA);
+                continue;
+            }
+
+            REQUEST *request = (REQUEST *)(cqe.user_data & ~(uint64_t)RING_OPERATION_MASK);
+            RingOperation operation = (RingOperation)(cqe.user_data & RING_OPERATION_MASK);
+            request->pending--;
+            bool transfer = false, done = false;
+            switch (operation) {
+                case RING_OPEN:
+                    if (cqe.res < 0)
+                        request->failed = true;
+                    else
+                        request->fd = cqe.res;
+                    transfer = request->pending == 0;
+                    break;
+                case RING_STAT:
+                    if (cqe.res < 0) {
+                        request->failed = true;
+                    } else if (!S_ISREG(ring->stats[request].stx_mode)) {
+                        // Pipes and other inputs that cannot seek have no size
+                        request->streaming = true;
+                        request->data.resize(STREAM_BLOCK_SIZE);
+                    } else {
+                        request->data.resize(ring->stats[request].stx_size);
+                    }
+                    ring->stats.erase(request);
+                    transfer = request->pending == 0;
+                    break;
+                case RING_TRANSFER:
+                    if (cqe.res < 0 || (cqe.res == 0 && request->write)) {
+                        request->failed = true;
+                    } else if (cqe.res == 0) {
+                        // The end of a stream, or the file was truncated after the stat
+                        request->data.resize(request->transferred);
+                    } else {
+                        request->transferred += cqe.res;
+                        // A stream is read until a read returns nothing, growing the buffer whenever it is full
+                        if (request->streaming && request->transferred == request->data.size())
+                            request->data.resize(request->data.size() * 2);
+                    }
+                    transfer = true;
+                    break;
+                case RING_CLOSE:
+                    done = true;
+                    break;
+                default:
+                    break;
+            }
+
+            if (transfer) {
+                uint64_t remaining = request->data.size() - request->transferred;
+                if (request->failed || remaining == 0) {
+                    if (request->fd >= 0) {
+                        request->pending++;
+                        get_sqe(ring, IORING_OP_CLOSE, request->fd, NULL, 0, 0, get_user_data(request, RING_CLOSE));
+                    } else {
+                        done = true;
+                    }
+                } else {
+                    request->pending++;
+                    get_sqe(ring, request->write ? IORING_OP_WRITE : IORING_OP_READ, request->fd, request->data.data() + request->transferred,
+                        min(remaining, MAX_TRANSFER), request->streaming ? (uint64_t)-1 : request->transferred, get_user_data(request, RING_TRANSFER));
+                }
+            }
+
+            if (done) {
+                ring->active--;
+                lock_guard<std::mutex> lock (mutex);
+                complete(request);
+            }
+        }
+    }
+}
+
+void AsyncIO::close_ring() {
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->wake_fd);
+    close(ring->fd);
+    delete ring;
+    ring = NULL;
+}
+
+void AsyncIO::wake() {
+    changed.notify_all();
+    if (ring) {
+        uint64_t value = 1;
+        if (::write(ring->wake_fd, &value, sizeof(value)) < 0) {
+            // The counter cannot overflow with one increment per call, nothing to do
+        }
+    }
+}
+
+#else
+
+struct AsyncRing {};
+
+bool AsyncIO::start_ring() {
+    return false;
+}
+
+void AsyncIO::run_ring() {}
+
+void AsyncIO::close_ring() {}
+
+void AsyncIO::wake() {
+    changed.notify_all();
+}
+
+#endif
@@ -0,0 +1,324 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "Calibrator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+#include <boost/filesystem.hpp>
+
+#include "Utils.h"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+// Nelder-Mead coefficients
+static const double REFLECTION = 1.0;
+static const double EXPANSION = 2.0;
+static const double CONTRACTION = 0.5;
+static const double SHRINK = 0.5;
+
+static const double INITIAL_STEP = 0.2;             // Initial simplex size in log space, roughly 20%
+static const double TOLERANCE = 1e-10;              // Stop once all simplex errors are this close
+static const int MAX_ITERATIONS_PER_PARAMETER = 200;
+
+// Indices into get_all_parameters(). The base parameters come first, then the per axis ones
+enum {
+    JERK_EFFICIENCY, ACCEL_EFFICIENCY, SPEED_MULTIPLIER, JUNCTION_DEVIATION, SQUARE_CORNER_VELOCITY,
+    BASE_PARAMETER_COUNT,
+    FIRST_MAX_JERK = BASE_PARAMETER_COUNT + 7
+};
+
+Calibrator::Calibrator(const Config &config, bool fit_axes)
+    : initial_config(config), config(config), base_config(config), accel_folded(false), evaluations(0) {
+    // The accel efficiency scales all accelerations, fitting both would leave the fit free to move
+    // along a direction that does not change the error, so it is not fitted with the axes. The
+    // junction models only use the product, which is fitted directly. The classic model applies
+    // the efficiency to the acceleration but not to the acceleration time, so it is kept as it is
+    if (fit_axes && config.motion_model != MOTION_CLASSIC_JERK) {
+        accel_folded = true;
+        float efficiency = base_config.accel_efficiency;
+        base_config.max_print_accel = Utils::map(base_config.max_print_accel, [=](float c) { return c * efficiency; });
+        base_config.max_move_accel = Utils::map(base_config.max_move_accel, [=](float c) { return c * efficiency; });
+        base_config.accel_efficiency = 1.0;
+    }
+
+    // Parameters are fitted in log space, which keeps them positive. Disabled (zero) values stay disabled
+    vector<float *> all = get_all_parameters(base_config);
+    size_t count = fit_axes ? all.size() : (size_t)BASE_PARAMETER_COUNT;
+    for (size_t i = 0; i < count; i++) {
+        if (fit_axes && i == ACCEL_EFFICIENCY)
+            continue;
+        if (*all[i] > 0.0 && is_used(i, config.motion_model))
+            active_parameters.push_back(i);
+    }
+}
+
+const Config & Calibrator::get_config() const { return config; }
+
+vector<float *> Calibrator::get_all_parameters(Config &target) {
+    return {
+        &target.jerk_efficiency, &target.accel_efficiency, &target.speed_multiplier,
+        &target.junction_deviation, &target.square_corner_velocity,
+        &target.max_print_accel.x, &target.max_print_accel.y, &target.max_print_accel.z, &target.max_print_accel.e,
+        &target.max_move_accel.x, &target.max_move_accel.y, &target.max_move_accel.z,
+        &target.max_jerk.x, &target.max_jerk.y, &target.max_jerk.z, &target.max_jerk.e
+    };
+}
+
+bool Calibrator::is_used(size_t parameter, MotionModel model) {
+    // Jerk settings only affect the classic model, each junction model has its own parameter
+    if (parameter == JERK_EFFICIENCY || parameter >= FIRST_MAX_JERK)
+        return model == MOTION_CLASSIC_JERK;
+    if (parameter == JUNCTION_DEVIATION)
+        return model == MOTION_JUNCTION_DEVIATION;
+    if (parameter == SQUARE_CORNER_VELOCITY)
+        return model == MOTION_SQUARE_CORNER_VELOCITY;
+    return true;
+}
+
+vector<float *> Calibrator::get_parameters(Config &target) const {
+    vector<float *> all = get_all_parameters(target), parameters;
+    for (vector<size_t>::const_iterator it = active_parameters.begin(); it != active_parameters.end(); ++it)
+        parameters.push_back(all[*it]);
+    return parameters;
+}
+
+Calibrator::POINT Calibrator::get_point(const Config &source) const {
+    Config copy (source);
+    vector<float *> parameters = get_parameters(copy);
+    POINT point;
+    for (vector<float *>::iterator it = parameters.begin(); it != parameters.end(); ++it)
+        point.push_back(log(**it));
+    return point;
+}
+
+Config Calibrator::get_config(const POINT &point) const {
+    Config result (base_config);
+    vector<float *> parameters = get_parameters(result);
+    for (size_t i = 0; i < parameters.size(); i++)
+        *parameters[i] = exp(point[i]);
+
+    // Back to the efficiency of the user, with the same effective accelerations
+    if (accel_folded) {
+        float efficiency = initial_config.accel_efficiency;
+        result.max_print_accel = Utils::map(result.max_print_accel, [=](float c) { return c / efficiency; });
+        result.max_move_accel = Utils::map(result.max_move_accel, [=](float c) { return c / efficiency; });
+        result.accel_efficiency = efficiency;
+    }
+    return result;
+}
+
+bool Calibrator::load_manifest(const string &filename) {
+    ifstream manifest (filename);
+    if (!manifest.is_open()) {
+        cerr << "Cannot open manifest " << filename << endl;
+        return false;
+    }
+
+    fs::path base = fs::path(filename).parent_path();
+    bool valid = true;
+    string line;
+    for (int line_number = 1; getline(manifest, line); line_number++) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == string::npos || line[start] == '#')
+            continue;
+
+        size_t separator = line.find_first_of(" \t", start);
+        size_t path_start = separator == string::npos ? string::npos : line.find_first_not_of(" \t", separator);
+        size_t path_end = line.find_last_not_of(" \t\r");
+        float actual_time;
+        if (path_start == string::npos || !Utils::parse_time(line.substr(start, separator - start), actual_time) || actual_time <= 0.0) {
+            cerr << filename << ":" << line_number << ": expected \"<actual time> <gcode file>\"" << endl;
+            valid = false;
+            continue;
+        }
+
+        fs::path path (line.substr(path_start, path_end - path_start + 1));
+        if (path.is_relative())
+            path = base / path;
+
+        tables.push_back(MoveTable(path.string()));
+        actual_times.push_back(actual_time);
+    }
+
+    vector<char> loaded (tables.size());
+    Utils::parallel_for(tables.size(), [&](size_t i) { loaded[i] = tables[i].load(); });
+    for (size_t i = 0; i < tables.size(); i++) {
+        if (!loaded[i]) {
+            cerr << "Cannot open " << tables[i].get_filename() << endl;
+            valid = false;
+        }
+    }
+
+    return valid && !tables.empty();
+}
+
+vector<float> Calibrator::estimate(const vector<Config> &candidates) {
+    // One work item per candidate and file, so that a batch keeps all cores busy even with few candidates
+    vector<float> estimates (candidates.size() * tables.size());
+    Utils::parallel_for(estimates.size(), [&](size_t i) {
+        estimates[i] = tables[i % tables.size()].estimate(candidates[i / tables.size()]);
+    });
+    evaluations += candidates.size();
+    return estimates;
+}
+
+double Calibrator::get_error(const float *estimates) const {
+    // Mean squared relative error, so that long prints do not dominate the fit
+    double error = 0.0;
+    for (size_t i = 0; i < tables.size(); i++) {
+        double relative_error = (estimates[i] - actual_times[i]) / actual_times[i];
+        error += relative_error * relative_error;
+    }
+    error /= tables.size();
+    return isfinite(error) ? error : numeric_limits<double>::infinity();
+}
+
+vector<double> Calibrator::evaluate(const vector<POINT> &points) {
+    vector<Config> candidates;
+    for (vector<POINT>::const_iterator it = points.begin(); it != points.end(); ++it)
+        candidates.push_back(get_config(*it));
+
+    vector<float> estimates = estimate(candidates);
+    vector<double> errors;
+    for (size_t i = 0; i < points.size(); i++)
+        errors.push_back(get_error(&estimates[i * tables.size()]));
+    return errors;
+}
+
+void Calibrator::fit() {
+    size_t n = active_parameters.size();
+    if (n == 0)
+        return;
+
+    // Initial simplex around the current config
+    vector<POINT> simplex (n + 1, get_point(base_config));
+    for (size_t i = 0; i < n; i++)
+        simplex[i + 1][i] += INITIAL_STEP;
+    vector<double> errors = evaluate(simplex);
+
+    for (size_t iteration = 0; iteration < MAX_ITERATIONS_PER_PARAMETER * n; iteration++) {
+        vector<size_t> order (n + 1);
+        for (size_t i = 0; i <= n; i++)
+            order[i] = i;
+        sort(order.begin(), order.end(), [&](size_t a, size_t b) { return errors[a] < errors[b]; });
+
+        size_t best = order[0], second_worst = order[n - 1], worst = order[n];
+        if (errors[worst] - errors[best] <= TOLERANCE)
+            break;
+
+        POINT centroid (n, 0.0);
+        for (size_t i = 0; i < n; i++) {
+            for (size_t j = 0; j < n; j++)
+                centroid[j] += simplex[order[i]][j] / n;
+        }
+
+        // All candidates of a step are evaluated speculatively in a single parallel batch
+        vector<POINT> candidates (4, centroid);
+        for (size_t j = 0; j < n; j++) {
+            double direction = centroid[j] - simplex[worst][j];
+            candidates[0][j] += REFLECTION * direction;
+            candidates[1][j] += EXPANSION * direction;
+            candidates[2][j] += CONTRACTION * REFLECTION * direction;      // Outside contraction
+            candidates[3][j] -= CONTRACTION * direction;                   // Inside contraction
+        }
+        vector<double> candidate_errors = evaluate(candidates);
+        double reflected = candidate_errors[0], expanded = candidate_errors[1];
+        double outside = candidate_errors[2], inside = candidate_errors[3];
+
+        int replacement = -1;
+        if (reflected < errors[best]) {
+            replacement = expanded < reflected ? 1 : 0;
+        } else if (reflected < errors[second_worst]) {
+            replacement = 0;
+        } else if (reflected < errors[worst]) {
+            if (outside <= reflected)
+                replacement = 2;
+        } else if (inside < errors[worst]) {
+            replacement = 3;
+        }
+
+        if (replacement >= 0) {
+            simplex[worst] = candidates[replacement];
+            errors[worst] = candidate_errors[replacement];
+        } else {
+            // Shrink towards the best point
+            vector<POINT> shrunk;
+            for (size_t i = 1; i <= n; i++) {
+                POINT &point = simplex[order[i]];
+                for (size_t j = 0; j < n; j++)
+                    point[j] = simplex[best][j] + SHRINK * (point[j] - simplex[best][j]);
+                shrunk.push_back(point);
+            }
+            vector<double> shrunk_errors = evaluate(shrunk);
+            for (size_t i = 1; i <= n; i++)
+                errors[order[i]] = shrunk_errors[i - 1];
+        }
+    }
+
+    size_t best = min_element(errors.begin(), errors.end()) - errors.begin();
+    config = get_config(simplex[best]);
+}
+
+void Calibrator::print_report(ostream *stream) {
+    vector<Config> configs = { initial_config, config };
+    vector<float> estimates = estimate(configs);
+    const float *initial_estimates = &estimates[0], *fitted_estimates = &estimates[tables.size()];
+
+    for (size_t i = 0; i < tables.size(); i++) {
+        *stream << tables[i].get_filename() << ": actual ";
+        Utils::format_time(stream, round(actual_times[i]));
+        *stream << ", estimated ";
+        Utils::format_time(stream, round(initial_estimates[i]));
+        *stream << " -> ";
+        Utils::format_time(stream, round(fitted_estimates[i]));
+        *stream << " (" << fixed << setprecision(1) << showpos
+            << 100.0 * (initial_estimates[i] - actual_times[i]) / actual_times[i] << "% -> "
+            << 100.0 * (fitted_estimates[i] - actual_times[i]) / actual_times[i] << "%)"
+            << noshowpos << endl;
+    }
+
+    *stream << "RMS error: " << 100.0 * sqrt(get_error(initial_estimates)) << "% -> " << 100.0 * sqrt(get_error(fitted_estimates)) << "%, "
+        << tables.size() << " files, " << evaluations << " config evaluations" << endl;
+    stream->unsetf(ios_base::floatfield);
+    *stream << setprecision(6);
+
+    if (config.motion_model == MOTION_CLASSIC_JERK)
+        *stream << "jerk_efficiency: " << initial_config.jerk_efficiency << " -> " << config.jerk_efficiency << endl;
+    else if (config.motion_model == MOTION_JUNCTION_DEVIATION)
+        *stream << "junction_deviation: " << initial_config.junction_deviation << " -> " << config.junction_deviation << endl;
+    else
+        *stream << "square_corner_velocity: " << initial_config.square_corner_velocity << " -> " << config.square_corner_velocity << endl;
+    *stream << "accel_efficiency: " << initial_config.accel_efficiency << " -> " << config.accel_efficiency << endl;
+    *stream << "speed_multiplier: " << initial_config.speed_multiplier << " -> " << config.speed_multiplier << endl;
+    if (!active_parameters.empty() && active_parameters.back() >= BASE_PARAMETER_COUNT) {
+        *stream << "max_print_accel: (" << config.max_print_accel.x << ", " << config.max_print_accel.y << ", " << config.max_print_accel.z << ", " << config.max_print_accel.e << ")" << endl;
+        *stream << "max_move_accel: (" << config.max_move_accel.x << ", " << config.max_move_accel.y << ", " << config.max_move_accel.z << ")" << endl;
+        if (config.motion_model == MOTION_CLASSIC_JERK)
+            *stream << "max_jerk: (" << config.max_jerk.x << ", " << config.max_jerk.y << ", " << config.max_jerk.z << ", " << config.max_jerk.e << ")" << endl;
+    }
+}
@@ -0,0 +1,243 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ChunkedDecorator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "AsyncIO.h"
+#include "Utils.h"
+
+using namespace std;
+
+ChunkedDecorator::ChunkedDecorator(float total_time, const EmissionPolicy &policy, const Config &config)
+    : GCodeTimeDecorator(NULL, &header, total_time, policy, config), input_data(NULL), input_size(0) {}
+
+void ChunkedDecorator::process_line(const GCODE_LINE &line, const GCODE_COMMAND &command, float line_duration) {
+    if (chunks.empty() || line.offset - chunks.back().offset >= CHUNK_SIZE)
+        chunks.push_back({ line.offset, durations.size(), current_time });
+
+    bool held = header_state == HEADER_PENDING;
+    LineKind kind = classify_line(line);
+    if (held && kind == LINE_STALE)
+        flags.back() |= LINE_DROPPED;
+
+    // Like the stream decorator, a held line takes no time
+    bool layer_change = is_layer_change(command);
+    if (kind != LINE_KEPT)
+        line_duration = 0.0;
+    current_time += line_duration;
+    durations.push_back(line_duration);
+    flags.push_back((layer_change ? LINE_LAYER_CHANGE : 0) | (kind == LINE_STALE ? LINE_DROPPED : 0));
+}
+
+bool ChunkedDecorator::is_stateless() const {
+    return policy.min_interval <= 0.0 && policy.min_lines == 0 && !policy.layers_only;
+}
+
+void ChunkedDecorator::decide_emissions() {
+    EMISSION_STATE state = emission;
+    uint64_t kept_lines = 0;
+    for (size_t index = 0; index < chunks.size(); index++) {
+        size_t end_line = index + 1 < chunks.size() ? chunks[index + 1].first_line : durations.size();
+        double current = chunks[index].start_time;
+        for (size_t line = chunks[index].first_line; line < end_line; line++) {
+            if (flags[line] & LINE_DROPPED)
+                continue;
+            current += durations[line];
+            float printed_time;
+            if (is_emission_due(policy, state, total_time, (float)current, ++kept_lines, flags[line] & LINE_LAYER_CHANGE, printed_time))
+                flags[line] |= LINE_EMISSION;
+        }
+    }
+}
+
+uint64_t ChunkedDecorator::format_chunk(size_t index, vector<char> &buffer) const {
+    const CHUNK &chunk = chunks[index];
+    uint64_t end = index + 1 < chunks.size() ? chunks[index + 1].offset : input_size;
+    size_t end_line = index + 1 < chunks.size() ? chunks[index + 1].first_line : durations.size();
+
+    buffer.clear();
+    buffer.reserve(end - chunk.offset + (end - chunk.offset) / 8);
+    MemoryOutputBuffer messages (buffer);
+    ostream stream (&messages);
+
+    // Without state, the previous message is the one for the time at the start of the chunk
+    bool stateless = is_stateless();
+    EMISSION_STATE state = emission;
+    if (index > 0)
+        state.printed_time = get_printed_time(policy, total_time - (float)chunk.start_time);
+
+    const char *p = input_data + chunk.offset, *limit = input_data + end;
+    double current = chunk.start_time;
+    uint64_t emitted = 0;
+    for (size_t line = chunk.first_line; line < end_line; line++) {
+        // Every line is terminated, including an unterminated last one
+        const char *newline = (const char *)memchr(p, '\n', limit - p);
+        const char *line_end = newline ? newline : limit, *line_start = p;
+        p = newline ? newline + 1 : limit;
+        if (flags[line] & LINE_DROPPED)
+            continue;
+        buffer.insert(buffer.end(), line_start, line_end);
+        buffer.push_back('\n');
+
+        current += durations[line];
+        float printed_time;
+        bool due;
+        if (stateless) {
+            due = is_emission_due(policy, state, total_time, (float)current, line + 1, flags[line] & LINE_LAYER_CHANGE, printed_time);
+        } else {
+            due = flags[line] & LINE_EMISSION;
+            printed_time = get_printed_time(policy, total_time - (float)current);
+        }
+        if (due) {
+            write_message(&stream, policy, total_time, (float)current, printed_time);
+            emitted++;
+        }
+    }
+    return emitted;
+}
+
+#ifdef __linux__
+
+static bool write_at(int fd, const char *data, size_t length, uint64_t offset) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, offset);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data += written;
+        length -= written;
+        offset += written;
+    }
+    return true;
+}
+
+bool ChunkedDecorator::write(int output_fd) {
+    string header_text = header.str();
+    if (!write_at(output_fd, header_text.data(), header_text.size(), 0))
+        return false;
+    uint64_t position = header_text.size();
+
+    // A few chunks per core are formatted at a time, which bounds the memory used for the buffers
+    size_t window = min((size_t)2 * max(thread::hardware_concurrency(), 1u), max(chunks.size(), (size_t)1));
+    vector<vector<char>> buffers (window);
+    vector<uint64_t> offsets (window), emitted (window);
+    for (size_t first = 0; first < chunks.size(); first += window) {
+        size_t count = min(window, chunks.size() - first);
+        Utils::parallel_for(count, [&](size_t i) {
+            emitted[i] = format_chunk(first + i, buffers[i]);
+        });
+
+        for (size_t i = 0; i < count; i++) {
+            offsets[i] = position;
+            position += buffers[i].size();
+            emitted_messages += emitted[i];
+        }
+
+        atomic<bool> failed (false);
+        Utils::parallel_for(count, [&](size_t i) {
+            if (!write_at(output_fd, buffers[i].data(), buffers[i].size(), offsets[i]))
+                failed = true;
+        });
+        if (failed)
+            return false;
+    }
+    return true;
+}
+
+bool ChunkedDecorator::decorate(const string &input_filename, const string &output_filename) {
+    int input_fd = open(input_filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (input_fd < 0)
+        return false;
+
+    struct stat input_stat;
+    if (fstat(input_fd, &input_stat) != 0) {
+        close(input_fd);
+        return false;
+    }
+    input_size = input_stat.st_size;
+    input_data = NULL;
+    if (input_size > 0) {
+        void *mapping = mmap(NULL, input_size, PROT_READ, MAP_PRIVATE, input_fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(input_fd);
+            return false;
+        }
+        input_data = (const char *)mapping;
+    }
+
+    // Timing pass over the mapped file
+    durations.clear();
+    flags.clear();
+    chunks.clear();
+    layer_z = 0.0;
+    current_time = 0.0;
+    header_state = HEADER_START;
+    with_kinematics(config, [this](auto &kinematics) {
+        reset();
+        process_buffer(input_data, input_size, true, kinematics);
+    });
+
+    emission = { get_printed_time(policy, total_time), 0.0, 0 };
+    if (!is_stateless())
+        decide_emissions();
+
+    header.str("");
+    write_header();
+    emitted_messages = 0;
+
+    bool success = false;
+    int output_fd = open(output_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (output_fd >= 0) {
+        success = write(output_fd);
+        success = close(output_fd) == 0 && success;
+    }
+
+    if (input_data)
+        munmap((void *)input_data, input_size);
+    close(input_fd);
+    return success;
+}
+
+#else
+
+bool ChunkedDecorator::write(int output_fd) {
+    return false;
+}
+
+bool ChunkedDecorator::decorate(const string &input_filename, const string &output_filename) {
+    return false;
+}
+
+#endif
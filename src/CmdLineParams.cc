@@ -23,12 +23,20 @@
 
 #include <iostream>
 #include <cstring>
+#include <cstdlib>
 
 #include "versioninfo.h"
 
 using namespace std;
 
-CmdLineParams::CmdLineParams() : inputs(vector<string> ()), info_only(false), use_stdout(false), create_config(false), output() {}
+static const uint64_t DEFAULT_CACHE_SIZE = 1024ULL * 1024 * 1024;
+static const float DEFAULT_IDLE_TIMEOUT = 60.0;
+
+CmdLineParams::CmdLineParams() : inputs(vector<string> ()), info_only(false), use_stdout(false), output(), create_config(false), calibration_manifest(), calibrate_axes(false), profiles(), emission_policy(), print_stats(false), zero_copy(false), memoize(false), direction_tolerance(-1.0), parallel(false), export_moves(false), curves(false), async_io(false), watch_folder(), workers(0),
+    use_cache(false), cache_folder(), cache_size(DEFAULT_CACHE_SIZE), fast(false), refine_budget(0.0),
+    processes(0), worker_command(), timeout(0.0), worker(false), worker_args(),
+    follow(false), idle_timeout(DEFAULT_IDLE_TIMEOUT), sentinel(), compact(false), verify(false),
+    reference(false), max_deviation(-1.0), query_curves(), manifest(), valid_options(true) {}
 
 const vector<string> & CmdLineParams::get_inputs() {
     return inputs;
@@ -38,19 +46,171 @@ const string & CmdLineParams::get_output() { return output; }
 bool CmdLineParams::get_info_only() { return info_only; }
 bool CmdLineParams::get_use_stdout() { return use_stdout; }
 bool CmdLineParams::get_create_config() { return create_config; }
+const string & CmdLineParams::get_calibration_manifest() { return calibration_manifest; }
+bool CmdLineParams::get_calibrate_axes() { return calibrate_axes; }
+const vector<string> & CmdLineParams::get_profiles() { return profiles; }
+const EmissionPolicy & CmdLineParams::get_emission_policy() { return emission_policy; }
+bool CmdLineParams::get_print_stats() { return print_stats; }
+bool CmdLineParams::get_zero_copy() { return zero_copy; }
+bool CmdLineParams::get_memoize() { return memoize; }
+float CmdLineParams::get_direction_tolerance() { return direction_tolerance; }
+bool CmdLineParams::get_parallel() { return parallel; }
+bool CmdLineParams::get_export_moves() { return export_moves; }
+bool CmdLineParams::get_curves() { return curves; }
+bool CmdLineParams::get_async_io() { return async_io; }
+const string & CmdLineParams::get_watch_folder() { return watch_folder; }
+size_t CmdLineParams::get_workers() { return workers; }
+bool CmdLineParams::get_use_cache() { return use_cache; }
+const string & CmdLineParams::get_cache_folder() { return cache_folder; }
+uint64_t CmdLineParams::get_cache_size() { return cache_size; }
+bool CmdLineParams::get_fast() { return fast; }
+float CmdLineParams::get_refine_budget() { return refine_budget; }
+size_t CmdLineParams::get_processes() { return processes; }
+const string & CmdLineParams::get_worker_command() { return worker_command; }
+float CmdLineParams::get_timeout() { return timeout; }
+bool CmdLineParams::get_worker() { return worker; }
+const vector<string> & CmdLineParams::get_worker_args() { return worker_args; }
+bool CmdLineParams::get_follow() { return follow; }
+float CmdLineParams::get_idle_timeout() { return idle_timeout; }
+const string & CmdLineParams::get_sentinel() { return sentinel; }
+bool CmdLineParams::get_compact() { return compact; }
+bool CmdLineParams::get_verify() { return verify; }
+bool CmdLineParams::get_reference() { return reference; }
+float CmdLineParams::get_max_deviation() { return max_deviation; }
+const string & CmdLineParams::get_query_curves() { return query_curves; }
+const string & CmdLineParams::get_manifest() { return manifest; }
 
 bool CmdLineParams::is_valid() {
+    if (!valid_options)
+        return false;
+
+    // The modes exclude each other, -p is also an option of --manifest
+    vector<const char *> modes;
+    if (create_config) modes.push_back("--create-config");
+    if (!calibration_manifest.empty()) modes.push_back("--calibrate");
+    if (!watch_folder.empty()) modes.push_back("--watch");
+    if (!query_curves.empty()) modes.push_back("--query");
+    if (!manifest.empty()) modes.push_back("--manifest");
+    if (!profiles.empty() && manifest.empty()) modes.push_back("--profile");
+    if (fast) modes.push_back("--fast");
+    if (reference) modes.push_back("--reference");
+    if (worker) modes.push_back("--worker");
+    if (processes > 0) modes.push_back("--processes");
+    if (follow) modes.push_back("--follow");
+    if (modes.size() > 1) {
+        cerr << modes[0] << " cannot be combined with " << modes[1] << endl;
+        return false;
+    }
+
+    // Both need every move evaluated, the memo would be ignored
+    if (memoize && (export_moves || curves)) {
+        cerr << "--memo cannot be combined with " << (export_moves ? "--export-moves" : "--curves") << endl;
+        return false;
+    }
+
+    if (!watch_folder.empty() || !calibration_manifest.empty() || !query_curves.empty() || worker)
+        return inputs.size() == 0;
+    if (!manifest.empty())
+        return inputs.size() == 0 && output.empty() && !use_stdout;
+    if (!profiles.empty() || fast || reference)
+        return inputs.size() > 0;
+    if (processes > 0)
+        return inputs.size() > 0 && output.empty() && !use_stdout;
     return (create_config && inputs.size() == 0) || (inputs.size() > 0 && ((output.empty() && !use_stdout) || inputs.size() == 1));
 }
 
 void CmdLineParams::print_usage(string programName) {
     cout << Project_NAME << " version " << Project_VERSION_STRING << endl << endl;
-    cout << "Usage: " << programName << " ([-i|--info] [-o|--output <output file>] [-s|--stdout] <gcode file> [<gcode file> ...] | --create-config)" << endl;
+    cout << "Usage: " << programName << " ([-i|--info] [-o|--output <output file>] [-s|--stdout] [<message options>] [<cache options>] [--zero-copy] [--parallel] [--compact] [--verify] [--async-io] [--memo] [--direction-cache <tolerance>] [--export-moves] [--curves] [--stats]" << endl
+            << "          [--follow [--idle-timeout <seconds>] [--sentinel <text>]] <gcode file> [<gcode file> ...]" << endl
+            << "      | [<message options>] [<cache options>] [--zero-copy] [--compact] [--memo] --watch <folder> [--workers <count>]" << endl
+            << "      | [-i|--info] [<message options>] [<cache options>] [--zero-copy] [--parallel] [--compact] [--verify] [--memo] [--export-moves] [--curves] --processes <count>" << endl
+            << "          [--worker-command <command>] [--timeout <seconds>] <gcode file> [<gcode file> ...]" << endl
+            << "      | --fast [--refine <seconds>] <gcode file> [<gcode file> ...]" << endl
+            << "      | --reference [--max-deviation <percent>] <gcode file> [<gcode file> ...]" << endl
+            << "      | [-i|--info] [<message options>] [<cache options>] [--zero-copy] [--parallel] [--compact] [--verify] [--memo] [--direction-cache <tolerance>]" << endl
+            << "          [-p|--profile <config file> ...] [--workers <count>] --manifest <manifest file>|-" << endl
+            << "      | --query <curves file>" << endl
+            << "      | -p|--profile <config file> [-p <config file> ...] <gcode file> [<gcode file> ...] | --create-config | --calibrate <manifest> [--calibrate-axes])" << endl;
     cout << "  -i, --info: Only print the estimated time for each file, do not generate gcode" << endl;
     cout << "  -o, --output: Sets the output filename. Can only be used with a single input file" << endl;
     cout << "  -s, --stdout: Prints the generated gcode to stdout instead of saving it to a file." << endl
             << "                   Can only be used with a single input file. -o will be ignored" << endl;
+    cout << "  --zero-copy: Computes the inserted messages first and then copies the unchanged parts of the file" << endl
+            << "                   inside the kernel where possible. Ignored with -s" << endl;
+    cout << "  --parallel: Formats and writes each output file on all cores, in chunks that are written at their" << endl
+            << "                   final offsets. Ignored with -s and --async-io" << endl;
+    cout << "  --compact: Leaves out comments, empty lines and G1 coordinates and feed rates that do not change, and" << endl
+            << "                   writes numbers without non-significant zeros, for faster transfers to the printer." << endl
+            << "                   --zero-copy, --parallel and the cache are not used for the output" << endl;
+    cout << "  --verify: Re-estimates every output and fails if any of its moves differs from the input" << endl;
+    cout << "  --async-io: Reads the next input files ahead while the current one is processed and writes the" << endl
+            << "                   outputs in the background, using io_uring where available. --zero-copy is ignored" << endl;
+    cout << "  --memo: Reuses the durations of move sequences that repeat within a file (e.g. several copies of a" << endl
+            << "                   part) instead of evaluating every move. Results may differ in the last digits. Only" << endl
+            << "                   applies to classic_jerk, cannot be combined with --export-moves and --curves" << endl;
+    cout << "  --direction-cache <tolerance>: Reuses the jerk and acceleration factors of classic jerk moves with the" << endl
+            << "                   same feed rate and a direction that differs by less than the tolerance per component" << endl
+            << "                   of the unit vector, e.g. 0.0001. 0 only reuses them for exactly the same direction" << endl;
+    cout << "  --export-moves: Writes the position, feed rate, acceleration time and duration of every move to" << endl
+            << "                   a columnar binary file with a '.moves' extension next to each input file" << endl;
+    cout << "  --follow: Estimates files while they are still being written, e.g. by the slicer, reading lines as they" << endl
+            << "                   are appended. A file is complete once no process has it open for writing anymore." << endl
+            << "                   --async-io and --export-moves are ignored" << endl;
+    cout << "  --idle-timeout <seconds>: With --follow, also considers a file complete if nothing was appended for" << endl
+            << "                   this long, 60 seconds by default" << endl;
+    cout << "  --sentinel <text>: With --follow, also considers a file complete after a line starting with the text" << endl;
+    cout << "  --watch: Decorates every gcode file that is written or moved into the folder until interrupted." << endl
+            << "                   Files without an up to date '.timed' output are decorated on startup" << endl;
+    cout << "  --workers: Number of files decorated in parallel in --watch and --manifest mode. Defaults to the number of cores" << endl;
+    cout << "  --manifest <manifest file>|-: Processes the files listed in the manifest (or stdin), separated by newlines or" << endl
+            << "                   NULs. An entry may add a tab and the output path, and another tab and the name of a" << endl
+            << "                   profile given with -p. Prints one JSON object per file as soon as it is done" << endl;
+    cout << "  --processes: Processes the files in the given number of worker processes, which get the files in" << endl
+            << "                   shards. The files of a worker that crashes or exceeds the time budget are passed on" << endl
+            << "                   to the other workers, and the throughput of every worker is printed at the end" << endl;
+    cout << "  --worker-command: Starts the workers with this shell command instead of running them locally, with {}" << endl
+            << "                   replaced by the number of the worker (e.g. \"docker exec node{} gcodetimer\"). A timeout kills the" << endl
+            << "                   local processes of the command, a remote wrapper must pass this on" << endl;
+    cout << "  --timeout: Time budget of a worker for a single file. The worker is restarted and the file fails" << endl;
+    cout << "  --stats: Prints the number of messages, the output size and the throughput of each decorated file." << endl
+            << "                   With -i and --direction-cache, compares the estimate and the time per move of each file" << endl
+            << "                   with and without the direction cache" << endl;
+    cout << "  Message options, which control how often remaining time messages are inserted:" << endl;
+    cout << "  --min-interval <seconds>: Minimum print time between two messages" << endl;
+    cout << "  --min-lines <lines>: Minimum number of gcode lines between two messages" << endl;
+    cout << "  --adaptive: Rounds the remaining time to minutes above one hour and to 10 seconds above 10 minutes" << endl;
+    cout << "  --layers-only: Only inserts messages at layer changes, i.e. the first extruding move at a new height" << endl
+            << "                   (z-hops do not count)" << endl;
+    cout << "  --progress <m117|m73|both>: Inserts M117 ETR messages (default), M73 progress/remaining time" << endl
+            << "                   commands or both" << endl;
+    cout << "  Cache options, for reusing the results of files that have been processed before:" << endl;
+    cout << "  --cache: Stores and looks up results in the cache folder of the user. Results are kept apart by" << endl;
+    cout << "                   version, config and the approximations they were made with" << endl;
+    cout << "  --cache-dir <folder>: Uses the given cache folder. Implies --cache" << endl;
+    cout << "  --cache-size <MB>: Maximum size of the cache folder, 1024 MB by default" << endl;
+    cout << "  --fast: Prints an approximate time of each file with a 95% confidence interval, estimated from" << endl
+            << "                   short samples spread over the file. Takes milliseconds even for very large files" << endl;
+    cout << "  --refine <seconds>: Keeps doubling the number of samples and printing the improved estimate until" << endl
+            << "                   the time is up or the exact time is known. Implies --fast" << endl;
+    cout << "  --curves: Also writes the remaining time of each file at every feed rate override (M220) to a file with" << endl
+            << "                   the extension replaced by \".curves\". Describes the output file, or the input with -i." << endl
+            << "                   Ignored with -s, and with --follow and -i" << endl;
+    cout << "  --query <curves file>: Reads lines of \"<byte offset> <override percent>\" from stdin and prints the" << endl
+            << "                   remaining time in seconds from that offset of the gcode file for each of them" << endl;
+    cout << "  --reference: Simulates the firmware of the motion model down to single steps, and prints how far the" << endl
+            << "                   estimate of each file and of its moves is from the simulation. Files are simulated in" << endl
+            << "                   parallel. Uses the steps_per_mm of the config" << endl;
+    cout << "  --max-deviation <percent>: With --reference, fails if the estimate of a file deviates more than" << endl
+            << "                   the given percentage from the simulation. Implies --reference" << endl;
+    cout << "  -p, --profile: Prints the estimated time of each file for every given printer profile (a config file" << endl
+            << "                   like the one created by --create-config). All profiles are evaluated in a single pass" << endl;
     cout << "  --create-config: Generates or completes the config file with any missing defaults" << endl;
+    cout << "  --calibrate: Fits accel_efficiency, speed_multiplier and the corner setting of the motion model" << endl
+            << "                   (jerk_efficiency, junction_deviation or square_corner_velocity) to measured print times" << endl
+            << "                   and saves them to the config file. Each line of the manifest holds the actual" << endl
+            << "                   print time (seconds, 01:02:03 or 01h02m03s) followed by the gcode file" << endl;
+    cout << "  --calibrate-axes: Also fits the per axis acceleration and jerk settings" << endl;
     cout << endl;
     cout << "If -o is not specified, the program will create a file of the new name with a '.timed' suffix" << endl
             << "  for each input file" << endl;
@@ -60,6 +220,8 @@ void CmdLineParams::parse(int argc, char **argv) {
     int state = STATE_MAIN;
 
     for (int i = 1; i < argc; i++) {
+        // Everything but the inputs and the options of the coordinator is passed on to the workers
+        bool worker_arg = true;
         switch (state) {
             case STATE_MAIN:
                 if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) {
@@ -68,16 +230,184 @@ void CmdLineParams::parse(int argc, char **argv) {
                     info_only = true;
                 } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--stdout") == 0) {
                     use_stdout = true;
+                } else if (strcmp(argv[i], "--zero-copy") == 0) {
+                    zero_copy = true;
+                } else if (strcmp(argv[i], "--parallel") == 0) {
+                    parallel = true;
+                } else if (strcmp(argv[i], "--memo") == 0) {
+                    memoize = true;
+                } else if (strcmp(argv[i], "--direction-cache") == 0) {
+                    state = STATE_DIRECTION_CACHE;
+                } else if (strcmp(argv[i], "--async-io") == 0) {
+                    async_io = true;
+                } else if (strcmp(argv[i], "--export-moves") == 0) {
+                    export_moves = true;
+                } else if (strcmp(argv[i], "--curves") == 0) {
+                    curves = true;
+                } else if (strcmp(argv[i], "--query") == 0) {
+                    state = STATE_QUERY;
+                } else if (strcmp(argv[i], "--manifest") == 0) {
+                    state = STATE_MANIFEST;
+                } else if (strcmp(argv[i], "--watch") == 0) {
+                    state = STATE_WATCH;
+                } else if (strcmp(argv[i], "--workers") == 0) {
+                    state = STATE_WORKERS;
+                } else if (strcmp(argv[i], "--cache") == 0) {
+                    use_cache = true;
+                } else if (strcmp(argv[i], "--cache-dir") == 0) {
+                    state = STATE_CACHE_FOLDER;
+                } else if (strcmp(argv[i], "--cache-size") == 0) {
+                    state = STATE_CACHE_SIZE;
+                } else if (strcmp(argv[i], "--fast") == 0) {
+                    fast = true;
+                } else if (strcmp(argv[i], "--refine") == 0) {
+                    state = STATE_REFINE;
+                } else if (strcmp(argv[i], "--stats") == 0) {
+                    print_stats = true;
+                } else if (strcmp(argv[i], "--min-interval") == 0) {
+                    state = STATE_MIN_INTERVAL;
+                } else if (strcmp(argv[i], "--min-lines") == 0) {
+                    state = STATE_MIN_LINES;
+                } else if (strcmp(argv[i], "--adaptive") == 0) {
+                    emission_policy.adaptive = true;
+                } else if (strcmp(argv[i], "--layers-only") == 0) {
+                    emission_policy.layers_only = true;
+                } else if (strcmp(argv[i], "--progress") == 0) {
+                    state = STATE_PROGRESS_FORMAT;
+                } else if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--profile") == 0) {
+                    state = STATE_PROFILE;
                 } else if (strcmp(argv[i], "--create-config") == 0) {
                     create_config = true;
+                } else if (strcmp(argv[i], "--calibrate") == 0) {
+                    state = STATE_CALIBRATE;
+                } else if (strcmp(argv[i], "--calibrate-axes") == 0) {
+                    calibrate_axes = true;
+                } else if (strcmp(argv[i], "--processes") == 0) {
+                    state = STATE_PROCESSES;
+                    worker_arg = false;
+                } else if (strcmp(argv[i], "--worker-command") == 0) {
+                    state = STATE_WORKER_COMMAND;
+                    worker_arg = false;
+                } else if (strcmp(argv[i], "--timeout") == 0) {
+                    state = STATE_TIMEOUT;
+                    worker_arg = false;
+                } else if (strcmp(argv[i], "--compact") == 0) {
+                    compact = true;
+                } else if (strcmp(argv[i], "--verify") == 0) {
+                    verify = true;
+                } else if (strcmp(argv[i], "--follow") == 0) {
+                    follow = true;
+                } else if (strcmp(argv[i], "--idle-timeout") == 0) {
+                    state = STATE_IDLE_TIMEOUT;
+                } else if (strcmp(argv[i], "--sentinel") == 0) {
+                    state = STATE_SENTINEL;
+                } else if (strcmp(argv[i], "--reference") == 0) {
+                    reference = true;
+                } else if (strcmp(argv[i], "--max-deviation") == 0) {
+                    state = STATE_MAX_DEVIATION;
+                } else if (strcmp(argv[i], "--worker") == 0) {
+                    worker = true;
                 } else {
                     inputs.push_back(string(argv[i]));
+                    worker_arg = false;
                 }
                 break;
             case STATE_OUTPUT:
                 output = string(argv[i]);
                 state = STATE_MAIN;
                 break;
+            case STATE_WATCH:
+                watch_folder = string(argv[i]);
+                state = STATE_MAIN;
+                break;
+            case STATE_WORKERS:
+                workers = strtoul(argv[i], NULL, 10);
+                state = STATE_MAIN;
+                break;
+            case STATE_CACHE_FOLDER:
+                cache_folder = string(argv[i]);
+                use_cache = true;
+                state = STATE_MAIN;
+                break;
+            case STATE_CACHE_SIZE:
+                cache_size = strtoull(argv[i], NULL, 10) * 1024 * 1024;
+                state = STATE_MAIN;
+                break;
+            case STATE_REFINE:
+                refine_budget = atof(argv[i]);
+                fast = true;
+                state = STATE_MAIN;
+                break;
+            case STATE_MIN_INTERVAL:
+                emission_policy.min_interval = atof(argv[i]);
+                state = STATE_MAIN;
+                break;
+            case STATE_MIN_LINES:
+                emission_policy.min_lines = strtoull(argv[i], NULL, 10);
+                state = STATE_MAIN;
+                break;
+            case STATE_PROGRESS_FORMAT:
+                if (strcmp(argv[i], "m117") == 0) {
+                    emission_policy.format = EmissionPolicy::FORMAT_M117;
+                } else if (strcmp(argv[i], "m73") == 0) {
+                    emission_policy.format = EmissionPolicy::FORMAT_M73;
+                } else if (strcmp(argv[i], "both") == 0) {
+                    emission_policy.format = EmissionPolicy::FORMAT_BOTH;
+                } else {
+                    valid_options = false;
+                }
+                state = STATE_MAIN;
+                break;
+            case STATE_PROFILE:
+                profiles.push_back(string(argv[i]));
+                state = STATE_MAIN;
+                break;
+            case STATE_CALIBRATE:
+                calibration_manifest = string(argv[i]);
+                state = STATE_MAIN;
+                break;
+            case STATE_PROCESSES:
+                processes = strtoul(argv[i], NULL, 10);
+                state = STATE_MAIN;
+                worker_arg = false;
+                break;
+            case STATE_WORKER_COMMAND:
+                worker_command = string(argv[i]);
+                state = STATE_MAIN;
+                worker_arg = false;
+                break;
+            case STATE_TIMEOUT:
+                timeout = atof(argv[i]);
+                state = STATE_MAIN;
+                worker_arg = false;
+                break;
+            case STATE_IDLE_TIMEOUT:
+                idle_timeout = atof(argv[i]);
+                state = STATE_MAIN;
+                break;
+            case STATE_SENTINEL:
+                sentinel = string(argv[i]);
+                state = STATE_MAIN;
+                break;
+            case STATE_MAX_DEVIATION:
+                max_deviation = atof(argv[i]);
+                reference = true;
+                state = STATE_MAIN;
+                break;
+            case STATE_DIRECTION_CACHE:
+                direction_tolerance = atof(argv[i]);
+                state = STATE_MAIN;
+                break;
+            case STATE_MANIFEST:
+                manifest = string(argv[i]);
+                state = STATE_MAIN;
+                break;
+            case STATE_QUERY:
+                query_curves = string(argv[i]);
+                state = STATE_MAIN;
+                break;
         }
+        if (worker_arg)
+            worker_args.push_back(string(argv[i]));
     }
 }
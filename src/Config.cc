@@ -32,17 +32,24 @@
 
 #include <boost/filesystem.hpp>
 
+#include "Hasher.h"
 #include "versioninfo.h"
+#ifdef GCODETIMER_BAKED_PROFILE
+#include "BakedProfile.h"
+#endif
 #include "cfgpath.h"
 
 using namespace std;
 namespace pt = boost::property_tree;
 namespace fs = boost::filesystem;
 
+const string Config::CONFIG_FILENAME = "config.xml";
+
+static const char * const MOTION_MODEL_NAMES[] = { "classic_jerk", "junction_deviation", "square_corner_velocity" };
+static const COORDS DEFAULT_STEPS_PER_MM = { 80.0, 80.0, 400.0, 93.0 };
 
-void Config::load() {
-    string filename = get_path();
 
+void Config::load(const string &filename) {
     // Create empty property tree object
     pt::ptree tree;
 
@@ -72,6 +79,24 @@ void Config::load() {
     accel_efficiency = tree.get("config.accel_efficiency", 1.0f);
 
     speed_multiplier = tree.get("config.speed_multiplier", 1.0f);
+
+    string model = tree.get("config.motion_model", string(MOTION_MODEL_NAMES[MOTION_CLASSIC_JERK]));
+    motion_model = MOTION_CLASSIC_JERK;
+    if (model == MOTION_MODEL_NAMES[MOTION_JUNCTION_DEVIATION])
+        motion_model = MOTION_JUNCTION_DEVIATION;
+    else if (model == MOTION_MODEL_NAMES[MOTION_SQUARE_CORNER_VELOCITY])
+        motion_model = MOTION_SQUARE_CORNER_VELOCITY;
+    else if (model != MOTION_MODEL_NAMES[MOTION_CLASSIC_JERK])
+        cerr << filename << ": unknown motion model " << model << ", using " << MOTION_MODEL_NAMES[MOTION_CLASSIC_JERK] << endl;
+    junction_deviation = tree.get("config.junction_deviation", 0.013f);
+    square_corner_velocity = tree.get("config.square_corner_velocity", 5.0f);
+
+    steps_per_mm = {
+        tree.get("config.steps_per_mm.x", DEFAULT_STEPS_PER_MM.x),
+        tree.get("config.steps_per_mm.y", DEFAULT_STEPS_PER_MM.y),
+        tree.get("config.steps_per_mm.z", DEFAULT_STEPS_PER_MM.z),
+        tree.get("config.steps_per_mm.e", DEFAULT_STEPS_PER_MM.e)
+        };
 }
 
 
@@ -97,6 +122,15 @@ void Config::save() const {
 
     tree.put("config.speed_multiplier", speed_multiplier);
 
+    tree.put("config.motion_model", MOTION_MODEL_NAMES[motion_model]);
+    tree.put("config.junction_deviation", junction_deviation);
+    tree.put("config.square_corner_velocity", square_corner_velocity);
+
+    tree.put("config.steps_per_mm.x", steps_per_mm.x);
+    tree.put("config.steps_per_mm.y", steps_per_mm.y);
+    tree.put("config.steps_per_mm.z", steps_per_mm.z);
+    tree.put("config.steps_per_mm.e", steps_per_mm.e);
+
     // Write property tree to XML file
     ofstream f (filename);
     pt::write_xml(f, tree, pt::xml_parser::xml_writer_make_settings<std::string>(' ', 4));
@@ -104,16 +138,37 @@ void Config::save() const {
 
 }
 
-Config * Config::instance = NULL;
-
 Config::Config() {
-    load();
+#ifdef GCODETIMER_BAKED_PROFILE
+    steps_per_mm = DEFAULT_STEPS_PER_MM;
+    BakedProfile::apply(*this);
+#else
+    load(get_path());
+#endif
+}
+
+Config::Config(const string &filename) {
+    load(filename);
 }
 
 const Config* Config::get() {
-    if (!instance)
-        instance = new Config;
-    return instance;
+    // The initialization of a local static is thread safe
+    static const Config instance;
+    return &instance;
+}
+
+uint64_t Config::get_hash() const {
+    Hasher hasher;
+    const COORDS *coords[] = { &max_print_accel, &max_move_accel, &max_jerk };
+    for (int i = 0; i < 3; i++)
+        hasher.update_value(*coords[i]);
+    hasher.update_value(jerk_efficiency);
+    hasher.update_value(accel_efficiency);
+    hasher.update_value(speed_multiplier);
+    hasher.update_value(motion_model);
+    hasher.update_value(junction_deviation);
+    hasher.update_value(square_corner_velocity);
+    return hasher.digest();
 }
 
 string Config::get_path() const {
@@ -0,0 +1,39 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "DirectionCache.h"
+
+using namespace std;
+
+DirectionCache::DirectionCache(float tolerance, size_t entry_count) : index_shift(63),
+        quantum_inverse(tolerance > 0.0f ? 1.0f / tolerance : 0.0f), hits(0), misses(0) {
+    // At least two entries, the index is taken from the top bits of the hash
+    size_t size = 2;
+    while (size < entry_count) {
+        size *= 2;
+        index_shift--;
+    }
+    // Value initialized, so no entry is valid
+    entries.resize(size);
+}
+
+uint64_t DirectionCache::get_hits() const { return hits; }
+uint64_t DirectionCache::get_misses() const { return misses; }
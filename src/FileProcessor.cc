@@ -0,0 +1,261 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "FileProcessor.h"
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+#include <memory>
+
+#include <boost/filesystem.hpp>
+
+#include "AsyncIO.h"
+#include "ChunkedDecorator.h"
+#include "FollowInputBuffer.h"
+#include "GCodeCompactor.h"
+#include "GCodeTimeEstimator.h"
+#include "GCodeTimeDecorator.h"
+#include "Hasher.h"
+#include "ZeroCopyDecorator.h"
+
+using namespace std;
+
+// Bytes per move of files from common slicers, a little less so that the export rarely has to grow
+static const uint64_t EXPORT_BYTES_PER_MOVE = 24;
+
+FileProcessor::FileProcessor(const EmissionPolicy &policy, bool zero_copy, ResultCache *cache, bool memoize, bool parallel, bool compact, float direction_tolerance,
+                             const Config &config)
+    : policy(policy), zero_copy(zero_copy), cache(cache), memoize(memoize), parallel(parallel), compact(compact), direction_tolerance(direction_tolerance),
+      config(config), settings_hash(get_settings_hash(config, memoize, direction_tolerance)) {}
+
+uint64_t FileProcessor::get_settings_hash(const Config &config, bool memoize, float direction_tolerance) {
+    // The memo is only used with classic jerk (see GCodeTimeEstimator::set_memo())
+    memoize = memoize && config.motion_model == MOTION_CLASSIC_JERK;
+    if (!memoize && direction_tolerance < 0.0)
+        return config.get_hash();
+    Hasher hasher;
+    hasher.update_value(config.get_hash());
+    hasher.update_value(memoize);
+    hasher.update_value(direction_tolerance < 0.0 ? -1.0f : direction_tolerance);
+    return hasher.digest();
+}
+
+bool FileProcessor::estimate(const string &input_filename, float &estimated_time, const string &export_filename, const string &curves_filename,
+                             FILE_COUNTS *counts) {
+    ifstream input (input_filename);
+    if (!input.is_open())
+        return false;
+    if (export_filename.empty() && curves_filename.empty()) {
+        // The recorded estimate is checked first, the cache may have to hash the whole file
+        if (GCodeTimeDecorator::read_header(&input, settings_hash, estimated_time)
+                || (cache && cache->get_time(input_filename, settings_hash, estimated_time))) {
+            if (counts)
+                *counts = { false, 0, 0 };
+            return true;
+        }
+        input.clear();
+        input.seekg(0);
+    }
+    boost::system::error_code error;
+    uint64_t size = export_filename.empty() ? 0 : boost::filesystem::file_size(input_filename, error);
+    uint64_t move_count = error ? 0 : size / EXPORT_BYTES_PER_MOVE;
+    return estimate(input_filename, &input, move_count, estimated_time, export_filename, curves_filename, counts);
+}
+
+bool FileProcessor::estimate(const string &input_filename, const vector<char> &contents, float &estimated_time, const string &export_filename,
+                             const string &curves_filename) {
+    if (export_filename.empty() && curves_filename.empty()) {
+        MemoryInputBuffer header_buffer (contents);
+        istream header (&header_buffer);
+        if (GCodeTimeDecorator::read_header(&header, settings_hash, estimated_time)
+                || (cache && cache->get_time(input_filename, settings_hash, estimated_time)))
+            return true;
+    }
+
+    MemoryInputBuffer buffer (contents);
+    istream input (&buffer);
+    return estimate(input_filename, &input, contents.size() / EXPORT_BYTES_PER_MOVE, estimated_time, export_filename, curves_filename, NULL);
+}
+
+bool FileProcessor::follow(const string &input_filename, const string &sentinel, float idle_timeout, float &estimated_time) {
+    FollowInputBuffer buffer (sentinel, idle_timeout);
+    if (!buffer.open(input_filename))
+        return false;
+    istream input (&buffer);
+    return estimate(input_filename, &input, 0, estimated_time, string(), string(), NULL) && !buffer.is_failed();
+}
+
+bool FileProcessor::estimate(const string &input_filename, istream *input, uint64_t move_count, float &estimated_time, const string &export_filename,
+                             const string &curves_filename, FILE_COUNTS *counts) {
+    GCodeTimeEstimator estimator (input, config);
+    unique_ptr<MoveMemo> memo;
+    if (memoize) {
+        memo.reset(new MoveMemo);
+        estimator.set_memo(memo.get());
+    }
+    unique_ptr<MoveExportWriter> exporter;
+    if (!export_filename.empty()) {
+        exporter.reset(new MoveExportWriter(export_filename, move_count));
+        estimator.set_exporter(exporter.get());
+    }
+    unique_ptr<DirectionCache> directions;
+    if (direction_tolerance >= 0.0) {
+        directions.reset(new DirectionCache(direction_tolerance));
+        estimator.set_direction_cache(directions.get());
+    }
+    unique_ptr<OverrideCurves> curves;
+    if (!curves_filename.empty()) {
+        curves.reset(new OverrideCurves);
+        estimator.set_curves(curves.get());
+    }
+    estimator.process_file();
+    estimated_time = estimator.get_estimated_time();
+    if (input->bad() || (exporter && !exporter->close()) || (curves && !curves->save(curves_filename)))
+        return false;
+    if (counts)
+        *counts = { true, estimator.get_line_count(), estimator.get_move_count() };
+
+    if (cache)
+        cache->put_time(input_filename, settings_hash, estimated_time);
+    return true;
+}
+
+bool FileProcessor::decorate(const string &input_filename, const string &output_filename, float total_time, uint64_t &emitted_messages) {
+    if (cache && !compact) {
+        vector<EDIT> edits;
+        string text;
+        if (cache->get_edits(input_filename, settings_hash, policy, total_time, edits, text, emitted_messages)
+                && OutputAssembler::assemble(input_filename, output_filename, edits, text))
+            return true;
+    }
+
+    if (parallel && !compact) {
+        ChunkedDecorator decorator (total_time, policy, config);
+        decorator.set_settings_hash(settings_hash);
+        if (decorator.decorate(input_filename, output_filename)) {
+            emitted_messages = decorator.get_emitted_messages();
+            return true;
+        }
+        // Fall back to the other decorators
+    }
+
+    if ((zero_copy || cache) && !compact) {
+        ifstream input (input_filename);
+        if (!input.is_open())
+            return false;
+
+        ZeroCopyDecorator decorator (&input, boost::filesystem::file_size(input_filename), total_time, policy, config);
+        decorator.set_settings_hash(settings_hash);
+        decorator.process_file();
+        if (cache)
+            cache->put_edits(input_filename, settings_hash, policy, total_time, decorator.get_edits(), decorator.get_text(), decorator.get_emitted_messages());
+        if (decorator.write(input_filename, output_filename)) {
+            emitted_messages = decorator.get_emitted_messages();
+            return true;
+        }
+        // Fall back to the stream decorator
+    }
+
+    ofstream output (output_filename);
+    if (!output.is_open())
+        return false;
+    bool success = decorate(input_filename, &output, total_time, emitted_messages);
+    output.close();
+    return success && !output.fail();
+}
+
+bool FileProcessor::decorate(const string &input_filename, ostream *output, float total_time, uint64_t &emitted_messages) {
+    ifstream input (input_filename);
+    if (!input.is_open())
+        return false;
+    return decorate(&input, output, total_time, emitted_messages);
+}
+
+bool FileProcessor::decorate(const vector<char> &contents, ostream *output, float total_time, uint64_t &emitted_messages) {
+    MemoryInputBuffer buffer (contents);
+    istream input (&buffer);
+    return decorate(&input, output, total_time, emitted_messages);
+}
+
+bool FileProcessor::decorate(const vector<char> &contents, vector<char> &output, float total_time, uint64_t &emitted_messages) {
+    output.clear();
+    output.reserve(contents.size() + contents.size() / 8);
+    MemoryOutputBuffer buffer (output);
+    ostream stream (&buffer);
+    return decorate(contents, &stream, total_time, emitted_messages);
+}
+
+bool FileProcessor::decorate(istream *input, ostream *output, float total_time, uint64_t &emitted_messages) {
+    GCodeTimeDecorator decorator (input, output, total_time, policy, config);
+    decorator.set_settings_hash(settings_hash);
+    GCodeCompactor compactor;
+    if (compact)
+        decorator.set_compactor(&compactor);
+    decorator.process_file();
+    output->flush();
+    emitted_messages = decorator.get_emitted_messages();
+    return !input->bad() && !output->fail();
+}
+
+bool FileProcessor::verify(const string &input_filename, const string &output_filename) {
+    ifstream input (input_filename), output (output_filename);
+    if (!input.is_open() || !output.is_open())
+        return false;
+    return verify(&input, &output);
+}
+
+bool FileProcessor::verify(const vector<char> &input, const vector<char> &output) {
+    MemoryInputBuffer input_buffer (input), output_buffer (output);
+    istream input_stream (&input_buffer), output_stream (&output_buffer);
+    return verify(&input_stream, &output_stream);
+}
+
+bool FileProcessor::verify(istream *input, istream *output) {
+    MoveDigest input_digest (input, config), output_digest (output, config);
+    input_digest.process_file();
+    output_digest.process_file();
+    return !input->bad() && !output->bad() && input_digest.get_move_count() == output_digest.get_move_count()
+        && input_digest.get_digest() == output_digest.get_digest() && input_digest.get_total_time() == output_digest.get_total_time();
+}
+
+// Replaces the extension of the file name, or appends it if there is none
+static string replace_extension(const string &filename, const string &extension) {
+    size_t pos = filename.rfind(".");
+    if (pos == string::npos || filename.find('/', pos) != string::npos)
+        return filename + extension;
+    return filename.substr(0, pos) + extension;
+}
+
+string FileProcessor::get_export_filename(const string &input_filename) {
+    return replace_extension(input_filename, ".moves");
+}
+
+string FileProcessor::get_curves_filename(const string &input_filename) {
+    return replace_extension(input_filename, ".curves");
+}
+
+string FileProcessor::get_output_filename(const string &input_filename) {
+    size_t pos = input_filename.rfind(".");
+    if (pos == string::npos)
+        return input_filename + ".timed";
+    return input_filename.substr(0, pos) + ".timed" + input_filename.substr(pos, input_filename.size() - pos);
+}
@@ -0,0 +1,213 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "FollowInputBuffer.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+FollowInputBuffer::FollowInputBuffer(const string &sentinel, float idle_timeout)
+    : sentinel(sentinel), idle_timeout(idle_timeout), fd(-1), inotify_fd(-1), buffer(BUFFER_SIZE), leases_supported(true),
+      writer_closed(false), sentinel_found(false), failed(false) {}
+
+bool FollowInputBuffer::is_failed() const {
+    return failed;
+}
+
+void FollowInputBuffer::find_sentinel(const char *data, size_t length) {
+    if (sentinel.empty())
+        return;
+    for (size_t i = 0; i < length && !sentinel_found; ) {
+        const char *newline = (const char *)memchr(data + i, '\n', length - i);
+        size_t end = newline ? newline - data : length;
+
+        // Once the start of a line is as long as the sentinel, the rest of the line is skipped
+        if (line_start.size() < sentinel.size()) {
+            size_t count = min(sentinel.size() - line_start.size(), end - i);
+            line_start.append(data + i, count);
+            sentinel_found = line_start == sentinel;
+        }
+
+        if (!newline)
+            break;
+        line_start.clear();
+        i = end + 1;
+    }
+}
+
+#ifdef __linux__
+
+FollowInputBuffer::~FollowInputBuffer() {
+    if (inotify_fd >= 0)
+        close(inotify_fd);
+    if (fd >= 0)
+        close(fd);
+}
+
+bool FollowInputBuffer::open(const string &filename) {
+    // The writer may not have created the file yet
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    while ((fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC)) < 0) {
+        if (errno != ENOENT || chrono::duration<float>(chrono::steady_clock::now() - start).count() > idle_timeout)
+            return false;
+        poll(NULL, 0, POLL_INTERVAL_MS);
+    }
+
+    // Without inotify, the file is polled instead
+    inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd >= 0 && inotify_add_watch(inotify_fd, filename.c_str(), IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+
+    last_data = chrono::steady_clock::now();
+    return true;
+}
+
+bool FollowInputBuffer::has_writers() {
+    if (!leases_supported)
+        return true;
+
+    // A writer that opens the file while the lease is held would terminate the process with SIGIO
+    struct sigaction ignore, previous;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGIO, &ignore, &previous);
+    bool leased = fcntl(fd, F_SETLEASE, F_RDLCK) == 0;
+    int error = errno;
+    if (leased)
+        fcntl(fd, F_SETLEASE, F_UNLCK);
+    sigaction(SIGIO, &previous, NULL);
+    if (leased)
+        return false;
+
+    // Not the owner of the file, or a file system without leases
+    if (error != EAGAIN)
+        leases_supported = false;
+    return true;
+}
+
+bool FollowInputBuffer::wait() {
+    if (!has_writers()) {
+        writer_closed = true;
+        return true;
+    }
+
+    float idle = chrono::duration<float>(chrono::steady_clock::now() - last_data).count();
+    if (idle >= idle_timeout) {
+        cerr << "Nothing appended for " << idle_timeout << "s, assuming the file is complete" << endl;
+        return false;
+    }
+    int timeout_ms = (int)ceil((idle_timeout - idle) * 1000);
+
+    if (inotify_fd < 0) {
+        poll(NULL, 0, min(timeout_ms, POLL_INTERVAL_MS));
+        return true;
+    }
+
+    // Without leases, the writer closing the file ends the input
+    alignas(struct inotify_event) char events[4096];
+    struct pollfd events_fd = { inotify_fd, POLLIN, 0 };
+    if (poll(&events_fd, 1, leases_supported ? timeout_ms : min(timeout_ms, POLL_INTERVAL_MS)) <= 0)
+        return true;
+    ssize_t length = read(inotify_fd, events, sizeof(events));
+    for (char *p = events; p < events + length; ) {
+        struct inotify_event *event = (struct inotify_event *)p;
+        if ((event->mask & IN_CLOSE_WRITE) && !leases_supported)
+            writer_closed = true;
+        p += sizeof(struct inotify_event) + event->len;
+    }
+    return true;
+}
+
+FollowInputBuffer::int_type FollowInputBuffer::underflow() {
+    if (fd < 0)
+        return traits_type::eof();
+
+    while (true) {
+        ssize_t length = read(fd, buffer.data(), buffer.size());
+        if (length > 0) {
+            last_data = chrono::steady_clock::now();
+            find_sentinel(buffer.data(), length);
+            setg(buffer.data(), buffer.data(), buffer.data() + length);
+            return traits_type::to_int_type(*gptr());
+        }
+        if (length < 0 && errno == EINTR)
+            continue;
+        if (length < 0) {
+            failed = true;
+            return traits_type::eof();
+        }
+
+        // Everything written so far has been read
+        if (writer_closed || sentinel_found || !wait())
+            return traits_type::eof();
+    }
+}
+
+streamsize FollowInputBuffer::xsgetn(char_type *s, streamsize count) {
+    // Returns after the first read that yields data instead of waiting until count bytes are appended
+    if (gptr() == egptr() && underflow() == traits_type::eof())
+        return 0;
+    streamsize length = min(count, (streamsize)(egptr() - gptr()));
+    memcpy(s, gptr(), length);
+    gbump((int)length);
+    return length;
+}
+
+#else
+
+FollowInputBuffer::~FollowInputBuffer() {}
+
+bool FollowInputBuffer::open(const string &filename) {
+    cerr << "--follow is only supported on Linux" << endl;
+    return false;
+}
+
+bool FollowInputBuffer::has_writers() {
+    return true;
+}
+
+bool FollowInputBuffer::wait() {
+    return false;
+}
+
+FollowInputBuffer::int_type FollowInputBuffer::underflow() {
+    return traits_type::eof();
+}
+
+streamsize FollowInputBuffer::xsgetn(char_type *s, streamsize count) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,259 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "GCodeCompactor.h"
+
+#include <cstring>
+
+using namespace std;
+
+static inline bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Commands whose argument is a string that may contain ';'
+static bool has_string_argument(int number) {
+    switch (number) {
+        case 23: case 28: case 30: case 32: case 33: case 117: case 118: case 928:
+            return true;
+    }
+    return false;
+}
+
+// M commands that neither move the printer nor change its position or feed rate
+static bool leaves_position(int number) {
+    switch (number) {
+        case 18: case 73: case 84: case 104: case 105: case 106: case 107: case 109: case 140: case 141: case 190: case 191:
+        case 201: case 203: case 204: case 205: case 220: case 221: case 400: case 900:
+            return true;
+    }
+    return false;
+}
+
+GCodeCompactor::GCodeCompactor() : absolute_xyz(false), absolute_e(false) {}
+
+void GCodeCompactor::forget() {
+    for (size_t i = 0; i < 4; i++)
+        known[i].clear();
+    known_feedrate.clear();
+}
+
+bool GCodeCompactor::split(string_view code) {
+    words.clear();
+    uint32_t seen = 0;
+    for (size_t i = 0; i < code.size(); ) {
+        if (is_blank(code[i])) {
+            i++;
+            continue;
+        }
+
+        char letter = code[i] & ~0x20;
+        if (letter < 'A' || letter > 'Z')
+            return false;
+        size_t start = ++i;
+        while (i < code.size() && (is_digit(code[i]) || code[i] == '.' || code[i] == '-' || code[i] == '+'))
+            i++;
+        // "X1E3" may be read as X1000
+        if (i == start || (i < code.size() && (code[i] & ~0x20) == 'E'))
+            return false;
+
+        // Firmwares disagree on which of several values of a letter counts
+        uint32_t bit = 1u << (letter - 'A');
+        if (!words.empty() && (seen & bit))
+            return false;
+        if (!words.empty())
+            seen |= bit;
+        WORD word = { letter, code.substr(start, i - start) };
+        words.push_back(word);
+    }
+    return !words.empty();
+}
+
+bool GCodeCompactor::normalize(string_view value, string &output) {
+    size_t i = 0;
+    bool negative = i < value.size() && value[i] == '-';
+    if (i < value.size() && (value[i] == '+' || value[i] == '-'))
+        i++;
+
+    size_t integer_start = i;
+    while (i < value.size() && is_digit(value[i]))
+        i++;
+    size_t integer_end = i, fraction_start = i, fraction_end = i;
+    if (i < value.size() && value[i] == '.') {
+        fraction_start = ++i;
+        while (i < value.size() && is_digit(value[i]))
+            i++;
+        fraction_end = i;
+    }
+    if (i != value.size() || (integer_start == integer_end && fraction_start == fraction_end))
+        return false;
+
+    while (integer_start < integer_end && value[integer_start] == '0')
+        integer_start++;
+    while (fraction_end > fraction_start && value[fraction_end - 1] == '0')
+        fraction_end--;
+
+    if (negative)
+        output += '-';
+    if (integer_start == integer_end)
+        output += '0';
+    else
+        output.append(value.data() + integer_start, integer_end - integer_start);
+    if (fraction_end > fraction_start) {
+        output += '.';
+        output.append(value.data() + fraction_start, fraction_end - fraction_start);
+    }
+    return true;
+}
+
+bool GCodeCompactor::compact_move(string_view code, int number, string_view &compacted) {
+    if (!split(code)) {
+        forget();
+        return true;
+    }
+
+    text = number == 0 ? "G0" : "G1";
+    for (size_t i = 1; i < words.size(); i++) {
+        const WORD &word = words[i];
+        int axis = word.letter == 'X' ? 0 : word.letter == 'Y' ? 1 : word.letter == 'Z' ? 2 : word.letter == 'E' ? 3 : -1;
+
+        // The value is normalized right into the line, and removed again if it is redundant
+        size_t word_start = text.size();
+        text += ' ';
+        text += word.letter;
+        size_t value_start = text.size();
+        if ((axis < 0 && word.letter != 'F') || !normalize(word.value, text)) {
+            text.append(word.value.data(), word.value.size());
+            if (axis >= 0)
+                known[axis].clear();
+            else if (word.letter == 'F')
+                known_feedrate.clear();
+            continue;
+        }
+        string_view value (text.data() + value_start, text.size() - value_start);
+
+        // G0 may have a feed rate of its own, and the estimator ignores it
+        string &known_value = axis >= 0 ? known[axis] : known_feedrate;
+        bool tracked = number == 1 && (axis < 0 || (axis < 3 ? absolute_xyz : absolute_e));
+        if (tracked && value == known_value)
+            text.resize(word_start);
+        else if (tracked)
+            known_value.assign(value.data(), value.size());
+        else
+            known_value.clear();
+    }
+
+    // A move without words does nothing
+    if (text.size() == 2)
+        return false;
+    compacted = text;
+    return true;
+}
+
+bool GCodeCompactor::compact(const GCODE_LINE &line, const GCODE_COMMAND &command, string_view &compacted) {
+    if (command.letter == 'M' && has_string_argument(command.number)) {
+        compacted = line.text;
+        return true;
+    }
+
+    string_view code = line.text.substr(0, line.text.find(';'));
+    while (!code.empty() && is_blank(code.back()))
+        code.remove_suffix(1);
+    while (!code.empty() && is_blank(code.front()))
+        code.remove_prefix(1);
+    if (code.empty())
+        return false;
+    compacted = code;
+
+    // Line numbers and checksums must stay as they are
+    if ((code[0] & ~0x20) == 'N' || code.find('*') != string_view::npos) {
+        forget();
+        return true;
+    }
+
+    if (command.letter == 'G') {
+        switch (command.number) {
+            case 0:
+            case 1:
+                return compact_move(code, command.number, compacted);
+            case 4:
+                return true;
+            case 90:
+                // Whether G90 and G91 apply to E as well depends on the firmware
+                absolute_xyz = true;
+                absolute_e = false;
+                return true;
+            case 91:
+                absolute_xyz = absolute_e = false;
+                return true;
+            case 92:
+                // Without axes, firmwares differ in what is reset
+                if (!split(code) || !(command.params & (PARAM_X | PARAM_Y | PARAM_Z | PARAM_E))) {
+                    forget();
+                    return true;
+                }
+                for (size_t i = 1; i < words.size(); i++) {
+                    const char *axes = "XYZE";
+                    const char *axis = strchr(axes, words[i].letter);
+                    if (!axis)
+                        continue;
+                    string &known_value = known[axis - axes];
+                    known_value.clear();
+                    if (!normalize(words[i].value, known_value))
+                        known_value.clear();
+                }
+                return true;
+        }
+    } else if (command.letter == 'M') {
+        if (command.number == 82 || command.number == 83) {
+            absolute_e = command.number == 82;
+            return true;
+        }
+        if (leaves_position(command.number))
+            return true;
+    }
+
+    forget();
+    return true;
+}
+
+MoveDigest::MoveDigest(istream *input, const Config &config) : GCodeProcessorBase(input, config), total_time(0.0) {}
+
+void MoveDigest::process_line(const GCODE_LINE &line, const GCODE_COMMAND &command, float line_duration) {
+    if (line_duration <= 0)
+        return;
+    hasher.update_value(pos);
+    hasher.update_value(rate);
+    hasher.update_value(line_duration);
+    total_time += line_duration;
+}
+
+uint64_t MoveDigest::get_digest() const {
+    return hasher.digest();
+}
+
+double MoveDigest::get_total_time() const {
+    return total_time;
+}
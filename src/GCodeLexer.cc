@@ -0,0 +1,113 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "GCodeLexer.h"
+
+#include <charconv>
+#include <cstring>
+
+using namespace std;
+
+static inline bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char * skip_word(const char *p, const char *end) {
+    while (p < end && !is_blank(*p))
+        p++;
+    return p;
+}
+
+// Parses a number at p. Returns the position after the number, or p if there is none
+static inline const char * parse_float(const char *p, const char *end, float &value) {
+    const char *start = p;
+    if (p < end && *p == '+')       // from_chars does not accept an explicit plus sign
+        start++;
+    from_chars_result result = from_chars(start, end, value);
+    if (result.ec != errc()) {
+        value = 0.0;
+        return p;
+    }
+    return result.ptr;
+}
+
+void GCodeLexer::parse_line(string_view line, GCODE_COMMAND &command) {
+    const char *p = line.data();
+    const char *end = p + line.size();
+
+    const char *comment = (const char *)memchr(p, ';', line.size());
+    if (comment)
+        end = comment;
+
+    command.letter = 0;
+    command.number = -1;
+    command.params = 0;
+
+    while (p < end && is_blank(*p))
+        p++;
+    if (p == end)
+        return;
+
+    // The first word is the command
+    command.letter = *p & ~0x20;     // Upper case
+    int number;
+    from_chars_result result = from_chars(++p, end, number);
+    if (result.ec == errc()) {
+        p = result.ptr;
+        if (p < end && *p == '.') {
+            // Subcommands like G92.1 have different semantics than their base command
+            p = skip_word(p, end);
+        } else {
+            command.number = number;
+        }
+    } else {
+        p = skip_word(p, end);
+    }
+
+    while (p < end) {
+        if (is_blank(*p)) {
+            p++;
+            continue;
+        }
+
+        char op = *p & ~0x20;
+        float value;
+        const char *next = parse_float(p + 1, end, value);
+        bool has_value = next != p + 1;
+        if (has_value || next == end || is_blank(*next)) {
+            switch(op) {
+                case 'X': command.params |= PARAM_X; command.values.x = value; break;
+                case 'Y': command.params |= PARAM_Y; command.values.y = value; break;
+                case 'Z': command.params |= PARAM_Z; command.values.z = value; break;
+                case 'E': command.params |= PARAM_E; command.values.e = value; break;
+                case 'F':
+                    if (has_value) {
+                        command.params |= PARAM_F;
+                        command.feedrate = value;
+                    }
+                    break;
+            }
+        }
+
+        // Words may be written without separators ("X10Y20")
+        p = (has_value && next < end && !is_blank(*next)) ? next : skip_word(next, end);
+    }
+}
@@ -0,0 +1,255 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "GCodeTimeDecorator.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+#include <vector>
+
+#include "Utils.h"
+#include "Config.h"
+#include "versioninfo.h"
+
+using namespace std;
+
+static const string_view HEADER_RULE = "; ---";
+static const string_view HEADER_TITLE = "; Decorated with timestamps by ";
+static const string_view HEADER_ESTIMATE = "; Estimate in s: ";
+
+static inline bool starts_with(string_view text, string_view prefix) {
+    return text.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Removes the '\r' of CRLF line ends
+static inline string_view trim_line(string_view text) {
+    if (!text.empty() && text.back() == '\r')
+        text.remove_suffix(1);
+    return text;
+}
+
+// Returns true for the messages written by write_totals() and write_message()
+static bool is_message(string_view text) {
+    if (starts_with(text, "M117 ETR ") || starts_with(text, "M117 TTL "))
+        return true;
+
+    // M73 P<progress> R<minutes>
+    if (!starts_with(text, "M73 P"))
+        return false;
+    size_t p = 5;
+    while (p < text.size() && isdigit((unsigned char)text[p]))
+        p++;
+    if (p == 5 || text.compare(p, 2, " R") != 0)
+        return false;
+    size_t r = p + 2;
+    p = r;
+    while (p < text.size() && isdigit((unsigned char)text[p]))
+        p++;
+    return p > r && p == text.size();
+}
+
+GCodeTimeDecorator::GCodeTimeDecorator(istream *input, ostream *output, float total_time, const EmissionPolicy &policy, const Config &config)
+    : GCodeProcessorBase(input, config), total_time(total_time), current_time(0.0), output(output), policy(policy),
+      emission({ get_printed_time(policy, total_time), 0.0, 0 }), layer_z(0.0), emitted_messages(0), compactor(NULL),
+      settings_hash(config.get_hash()), header_state(HEADER_START), stale_lines(0) {}
+
+void GCodeTimeDecorator::set_compactor(GCodeCompactor *compactor) {
+    this->compactor = compactor;
+}
+
+void GCodeTimeDecorator::set_settings_hash(uint64_t settings_hash) {
+    this->settings_hash = settings_hash;
+}
+
+uint64_t GCodeTimeDecorator::get_emitted_messages() {
+    return emitted_messages;
+}
+
+void GCodeTimeDecorator::write_header() {
+    *output << HEADER_RULE << endl;
+    *output << HEADER_TITLE << Project_NAME << " " << Project_VERSION_STRING << endl;
+
+    // A compact output only keeps the estimate, which marks it as decorated and can be reused
+    if (!compactor) {
+        *output << "; Print acceleration settings (X,Y,Z,E) in mm/(s^2): ("
+            << config.max_print_accel.x << ", " << config.max_print_accel.y << ", " << config.max_print_accel.z << ", " << config.max_print_accel.e << "), "
+            << (int)round(config.accel_efficiency * 100) << "% avg efficiency" << endl;
+
+        *output << "; Move acceleration settings (X,Y,Z) in mm/(s^2): ("
+            << config.max_move_accel.x << ", " << config.max_move_accel.y << ", " << config.max_move_accel.z << "), "
+            << (int)round(config.accel_efficiency * 100) << "% avg efficiency" << endl;
+
+        *output << "; Max jerk settings (X,Y,Z,E) in mm/s: (" << config.max_jerk.x << ", " << config.max_jerk.y << ", " << config.max_jerk.z << ", " << config.max_jerk.e << "), "
+            << (int)round(config.jerk_efficiency * 100) << "% avg efficiency" << endl;
+    }
+
+    // The total and all settings it was estimated with, for read_header()
+    char estimate[64];
+    snprintf(estimate, sizeof(estimate), "%.9g, settings %016llx", total_time, (unsigned long long)settings_hash);
+    *output << HEADER_ESTIMATE << estimate << endl;
+
+    *output << HEADER_RULE << endl << endl;
+    write_totals();
+}
+
+void GCodeTimeDecorator::write_totals() {
+    *output << "M117 TTL ";
+    Utils::format_time(output, total_time);
+    *output << endl;
+    if (policy.format != EmissionPolicy::FORMAT_M117)
+        *output << "M73 P0 R" << (int)round(total_time / 60) << endl;
+}
+
+void GCodeTimeDecorator::write_message(ostream *stream, const EmissionPolicy &policy, float total_time, float current_time, float remaining_time) {
+    if (policy.format != EmissionPolicy::FORMAT_M73) {
+        *stream << "M117 ETR ";
+        Utils::format_time(stream, remaining_time);
+        *stream << '\n';
+    }
+    if (policy.format != EmissionPolicy::FORMAT_M117) {
+        int progress = total_time > 0 ? (int)round(100 * current_time / total_time) : 100;
+        *stream << "M73 P" << progress << " R" << (int)round(remaining_time / 60) << '\n';
+    }
+}
+
+void GCodeTimeDecorator::emit(float remaining_time) {
+    write_message(output, policy, total_time, (float)current_time, remaining_time);
+    emitted_messages++;
+}
+
+GCodeTimeDecorator::LineKind GCodeTimeDecorator::classify_line(const GCODE_LINE &line) {
+    string_view text = trim_line(line.text);
+    switch (header_state) {
+    case HEADER_START:
+        header_state = text == HEADER_RULE ? HEADER_PENDING : HEADER_NONE;
+        return header_state == HEADER_PENDING ? LINE_HELD : LINE_KEPT;
+    case HEADER_PENDING:
+        header_state = starts_with(text, HEADER_TITLE) ? HEADER_INSIDE : HEADER_NONE;
+        return header_state == HEADER_INSIDE ? LINE_STALE : LINE_KEPT;
+    case HEADER_INSIDE:
+        if (text == HEADER_RULE)
+            header_state = HEADER_END;
+        return LINE_STALE;
+    case HEADER_END:
+        header_state = HEADER_DECORATED;
+        if (text.empty())
+            return LINE_STALE;
+        return is_message(text) ? LINE_STALE : LINE_KEPT;
+    case HEADER_DECORATED:
+        return is_message(text) ? LINE_STALE : LINE_KEPT;
+    default:
+        return LINE_KEPT;
+    }
+}
+
+void GCodeTimeDecorator::echo_line(const GCODE_LINE &line) {
+    output->write(line.text.data(), line.text.size());
+    output->put('\n');
+}
+
+void GCodeTimeDecorator::drop_line(const GCODE_LINE &line) {}
+
+void GCodeTimeDecorator::keep_line(const GCODE_LINE &line, const GCODE_COMMAND &command, float line_duration) {
+    string_view compacted;
+    if (!compactor) {
+        echo_line(line);
+    } else if (compactor->compact(line, command, compacted)) {
+        output->write(compacted.data(), compacted.size());
+        output->put('\n');
+    }
+
+    current_time += line_duration;
+
+    float printed_time;
+    if (is_emission_due(policy, emission, total_time, (float)current_time, line.number - stale_lines, is_layer_change(command), printed_time))
+        emit(printed_time);
+}
+
+void GCodeTimeDecorator::process_line(const GCODE_LINE &line, const GCODE_COMMAND &command, float line_duration) {
+    bool held = header_state == HEADER_PENDING;
+    LineKind kind = classify_line(line);
+
+    if (held && kind == LINE_STALE) {
+        drop_line(held_line);
+        stale_lines++;
+    } else if (held) {
+        keep_line(held_line, held_command, 0.0);
+    }
+
+    if (kind == LINE_HELD) {
+        // The view into the read buffer does not outlive this call
+        held_text = string(line.text);
+        held_line = line;
+        held_line.text = held_text;
+        held_command = command;
+    } else if (kind == LINE_STALE) {
+        // Messages take no time and do not move the head
+        drop_line(line);
+        stale_lines++;
+    } else {
+        keep_line(line, command, line_duration);
+    }
+}
+
+void GCodeTimeDecorator::process_file() {
+    header_state = HEADER_START;
+    stale_lines = 0;
+    write_header();
+    GCodeProcessorBase::process_file();
+
+    // A header rule as the only line
+    if (header_state == HEADER_PENDING)
+        keep_line(held_line, held_command, 0.0);
+}
+
+bool GCodeTimeDecorator::read_header(istream *input, uint64_t settings_hash, float &total_time) {
+    vector<char> buffer (HEADER_SCAN_SIZE);
+    input->read(buffer.data(), buffer.size());
+    string_view data (buffer.data(), input->gcount());
+
+    // The rule, the title with this version, the settings and the estimate up to the closing rule
+    string title = string(HEADER_TITLE) + Project_NAME + " " + Project_VERSION_STRING;
+    for (size_t start = 0, index = 0; start < data.size(); index++) {
+        size_t end = data.find('\n', start);
+        if (end == string_view::npos)
+            return false;
+        string_view text = trim_line(data.substr(start, end - start));
+        start = end + 1;
+
+        if (index == 0 ? text != HEADER_RULE : index == 1 ? text != title : text == HEADER_RULE)
+            return false;
+        if (!starts_with(text, HEADER_ESTIMATE))
+            continue;
+
+        string estimate (text.substr(HEADER_ESTIMATE.size()));
+        char *rest;
+        float time = strtof(estimate.c_str(), &rest);
+        unsigned long long hash;
+        if (rest == estimate.c_str() || sscanf(rest, ", settings %llx", &hash) != 1 || hash != settings_hash)
+            return false;
+        total_time = time;
+        return true;
+    }
+    return false;
+}
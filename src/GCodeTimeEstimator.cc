@@ -0,0 +1,90 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "GCodeTimeEstimator.h"
+
+#include <type_traits>
+
+using namespace std;
+
+GCodeTimeEstimator::GCodeTimeEstimator(istream *input, const Config &config) : GCodeProcessorBase(input, config), estimated_time(0.0), exporter(NULL), memo(NULL), curves(NULL), direction_cache(NULL) {}
+
+void GCodeTimeEstimator::set_exporter(MoveExportWriter *exporter) {
+    this->exporter = exporter;
+}
+
+void GCodeTimeEstimator::set_memo(MoveMemo *memo) {
+    this->memo = memo;
+}
+
+void GCodeTimeEstimator::set_curves(OverrideCurves *curves) {
+    this->curves = curves;
+}
+
+void GCodeTimeEstimator::set_direction_cache(DirectionCache *direction_cache) {
+    this->direction_cache = direction_cache;
+}
+
+void GCodeTimeEstimator::process_line(const GCODE_LINE &line, const GCODE_COMMAND &command, float line_duration) {
+    estimated_time += line_duration;
+}
+
+template <class K> void GCodeTimeEstimator::process_with(K &kinematics) {
+    if (curves) {
+        curves->reset();
+        CurveKinematics<K> curving (*this, kinematics);
+        if (exporter) {
+            ExportingKinematics<CurveKinematics<K>> exporting (*this, curving);
+            process_input(exporting);
+        } else {
+            process_input(curving);
+        }
+        curving.finish();
+    } else if (exporter) {
+        ExportingKinematics<K> exporting (*this, kinematics);
+        process_input(exporting);
+    } else if (memo && K::MEMORYLESS) {
+        // The junction models make every run depend on the move before it, and memoizing them
+        // gained nothing over the lookups it costs
+        MemoizingKinematics<K> memoizing (*this, kinematics, *memo);
+        process_input(memoizing);
+        memoizing.flush();
+    } else {
+        process_input(kinematics);
+    }
+}
+
+void GCodeTimeEstimator::process_file() {
+    estimated_time = 0;
+    with_kinematics(config, [this](auto &kinematics) {
+        typedef typename remove_reference<decltype(kinematics)>::type Kinematics;
+        if (direction_cache) {
+            CachingKinematics<Kinematics> caching (kinematics, *direction_cache);
+            process_with(caching);
+        } else {
+            process_with(kinematics);
+        }
+    });
+}
+
+float GCodeTimeEstimator::get_estimated_time() {
+    return estimated_time;
+}
@@ -0,0 +1,211 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "HotFolderWatcher.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+
+#ifdef __linux__
+#include <csignal>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+#endif
+
+#include "Utils.h"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+HotFolderWatcher::HotFolderWatcher(const string &folder, FileProcessor &processor, size_t worker_count, size_t queue_capacity)
+    : folder(folder), processor(processor), worker_count(max(worker_count, (size_t)1)), queue_capacity(max(queue_capacity, (size_t)1)), stopping(false) {}
+
+bool HotFolderWatcher::is_input(const string &name) {
+    // Skips hidden (temporary) files and our own outputs
+    if (name.empty() || name[0] == '.' || name.find(".timed.") != string::npos || boost::algorithm::ends_with(name, ".timed"))
+        return false;
+    return boost::algorithm::iends_with(name, ".gcode") || boost::algorithm::iends_with(name, ".gco") || boost::algorithm::iends_with(name, ".g");
+}
+
+void HotFolderWatcher::scan() {
+    boost::system::error_code error;
+    for (fs::directory_iterator it (folder, error), end; !error && it != end; it.increment(error)) {
+        string name = it->path().filename().string();
+        if (!is_input(name) || !fs::is_regular_file(it->status()))
+            continue;
+
+        fs::path output (FileProcessor::get_output_filename(it->path().string()));
+        if (!fs::exists(output) || fs::last_write_time(output) < fs::last_write_time(it->path()))
+            enqueue(name);
+    }
+}
+
+void HotFolderWatcher::enqueue(const string &name) {
+    unique_lock<std::mutex> lock (mutex);
+    map<string, FileState>::iterator state = states.find(name);
+    if (state != states.end()) {
+        // Already queued, or running and to be repeated once done
+        if (state->second == FILE_RUNNING)
+            state->second = FILE_RUNNING_CHANGED;
+        return;
+    }
+
+    space_available.wait(lock, [&]() { return queue.size() < queue_capacity; });
+    queue.push_back(name);
+    states[name] = FILE_QUEUED;
+    work_available.notify_one();
+}
+
+void HotFolderWatcher::run_worker() {
+    unique_lock<std::mutex> lock (mutex);
+    while (true) {
+        work_available.wait(lock, [&]() { return stopping || !queue.empty(); });
+        if (stopping)
+            return;
+
+        string name = queue.front();
+        queue.pop_front();
+        states[name] = FILE_RUNNING;
+        space_available.notify_one();
+
+        lock.unlock();
+        process(name);
+        lock.lock();
+
+        if (states[name] == FILE_RUNNING_CHANGED) {
+            // Requeued even if the queue is full, workers must never wait for space
+            queue.push_back(name);
+            states[name] = FILE_QUEUED;
+            work_available.notify_one();
+        } else {
+            states.erase(name);
+        }
+    }
+}
+
+void HotFolderWatcher::process(const string &name) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    fs::path input = fs::path(folder) / name;
+    fs::path output (FileProcessor::get_output_filename(input.string()));
+
+    // Written to a hidden file first so that readers of the folder never see partial outputs
+    fs::path temp = output.parent_path() / ("." + output.filename().string() + ".tmp");
+
+    float estimated_time;
+    uint64_t emitted_messages;
+    bool success = processor.estimate(input.string(), estimated_time)
+        && processor.decorate(input.string(), temp.string(), estimated_time, emitted_messages)
+        && rename(temp.string().c_str(), output.string().c_str()) == 0;
+
+    lock_guard<std::mutex> lock (log_mutex);
+    if (success) {
+        cout << input.string() << " total time: ";
+        Utils::format_time(&cout, round(estimated_time));
+        cout << " (decorated in " << chrono::duration<float>(chrono::steady_clock::now() - start).count() << "s)" << endl;
+    } else {
+        boost::system::error_code error;
+        fs::remove(temp, error);
+        cerr << "Cannot decorate " << input.string() << endl;
+    }
+}
+
+#ifdef __linux__
+
+bool HotFolderWatcher::run() {
+    int inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd < 0 || inotify_add_watch(inotify_fd, folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+        cerr << "Cannot watch " << folder << endl;
+        if (inotify_fd >= 0)
+            close(inotify_fd);
+        return false;
+    }
+
+    // The signals are blocked before the workers are started so that only the signalfd receives them
+    sigset_t signals, previous_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous_signals);
+    int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+
+    vector<thread> workers;
+    for (size_t i = 0; i < worker_count; i++)
+        workers.emplace_back(&HotFolderWatcher::run_worker, this);
+
+    cout << "Watching " << folder << " with " << worker_count << " workers" << endl;
+    scan();
+
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    struct pollfd fds[] = { { inotify_fd, POLLIN, 0 }, { signal_fd, POLLIN, 0 } };
+    bool watching = true;
+    while (watching) {
+        if (poll(fds, 2, -1) < 0)
+            continue;
+        if (fds[1].revents)
+            break;
+
+        ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+        for (char *p = buffer; p < buffer + length; ) {
+            struct inotify_event *event = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events have been lost
+                scan();
+            } else if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                cerr << folder << " is no longer available" << endl;
+                watching = false;
+            } else if (event->len > 0 && !(event->mask & IN_ISDIR) && is_input(event->name)) {
+                enqueue(event->name);
+            }
+        }
+    }
+
+    // Running jobs are completed, queued ones are dropped
+    {
+        lock_guard<std::mutex> lock (mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (vector<thread>::iterator it = workers.begin(); it != workers.end(); ++it)
+        it->join();
+
+    close(signal_fd);
+    close(inotify_fd);
+    pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+    return true;
+}
+
+#else
+
+bool HotFolderWatcher::run() {
+    cerr << "Watching folders is only supported on Linux" << endl;
+    return false;
+}
+
+#endif
@@ -0,0 +1,192 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ManifestRunner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+ManifestRunner::ManifestRunner(istream *manifest, ostream *results, FileProcessor &processor, const map<string, FileProcessor *> &profiles,
+                               bool info_only, bool verify, size_t worker_count)
+    : manifest(manifest), results(results), processor(processor), profiles(profiles), info_only(info_only), verify(verify),
+      worker_count(max(worker_count, (size_t)1)), separator(0), failed(0) {}
+
+bool ManifestRunner::read_entry(MANIFEST_ENTRY &entry) {
+    string record;
+    while (true) {
+        if (separator == 0) {
+            // The first NUL or newline decides how the rest of the manifest is separated
+            record.clear();
+            int c;
+            while ((c = manifest->get()) != EOF && c != '\0' && c != '\n')
+                record += (char)c;
+            if (c == EOF && record.empty())
+                return false;
+            if (c != EOF)
+                separator = (char)c;
+        } else if (!getline(*manifest, record, separator)) {
+            return false;
+        }
+
+        if (separator != '\0' && !record.empty() && record.back() == '\r')
+            record.pop_back();
+        if (record.empty() || (separator != '\0' && record[0] == '#'))
+            continue;
+        break;
+    }
+
+    size_t path_end = record.find('\t');
+    entry.path = record.substr(0, path_end);
+    entry.output.clear();
+    entry.profile.clear();
+    if (path_end != string::npos) {
+        size_t output_end = record.find('\t', path_end + 1);
+        entry.output = record.substr(path_end + 1, output_end == string::npos ? string::npos : output_end - path_end - 1);
+        if (output_end != string::npos)
+            entry.profile = record.substr(output_end + 1, record.find('\t', output_end + 1) - output_end - 1);
+    }
+    return true;
+}
+
+void ManifestRunner::write_string(ostream *stream, const string &text) {
+    *stream << '"';
+    for (string::const_iterator it = text.begin(); it != text.end(); ++it) {
+        unsigned char c = *it;
+        if (c == '"' || c == '\\') {
+            *stream << '\\' << c;
+        } else if (c == '\n') {
+            *stream << "\\n";
+        } else if (c == '\t') {
+            *stream << "\\t";
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            *stream << escaped;
+        } else {
+            *stream << c;
+        }
+    }
+    *stream << '"';
+}
+
+void ManifestRunner::process(const MANIFEST_ENTRY &entry) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    FileProcessor *selected = &processor;
+    string error, output_name;
+    float estimated_time = 0.0;
+    FILE_COUNTS counts = { false, 0, 0 };
+    uint64_t emitted_messages = 0;
+    bool estimated = false;
+
+    if (!entry.profile.empty()) {
+        map<string, FileProcessor *>::const_iterator profile = profiles.find(entry.profile);
+        if (profile == profiles.end())
+            error = "Unknown profile " + entry.profile;
+        else
+            selected = profile->second;
+    }
+    if (error.empty()) {
+        estimated = selected->estimate(entry.path, estimated_time, string(), string(), &counts);
+        if (!estimated)
+            error = "Cannot read " + entry.path;
+    }
+    if (error.empty() && !info_only) {
+        output_name = entry.output.empty() ? FileProcessor::get_output_filename(entry.path) : entry.output;
+        if (!selected->decorate(entry.path, output_name, estimated_time, emitted_messages))
+            error = "Cannot decorate " + entry.path;
+        else if (verify && !selected->verify(entry.path, output_name))
+            error = "The moves of " + output_name + " differ from the ones of " + entry.path;
+    }
+
+    boost::system::error_code size_error;
+    uintmax_t bytes = fs::file_size(entry.path, size_error);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    // Formatted first, so that the results of the workers never interleave
+    ostringstream result;
+    result << "{\"path\":";
+    write_string(&result, entry.path);
+    if (!entry.profile.empty()) {
+        result << ",\"profile\":";
+        write_string(&result, entry.profile);
+    }
+    if (!output_name.empty()) {
+        result << ",\"output\":";
+        write_string(&result, output_name);
+        result << ",\"messages\":" << emitted_messages;
+    }
+    result << ",\"total_seconds\":";
+    if (estimated)
+        result << fixed << setprecision(3) << estimated_time;
+    else
+        result << "null";
+    result << ",\"bytes\":";
+    if (size_error)
+        result << "null";
+    else
+        result << bytes;
+    if (counts.parsed)
+        result << ",\"lines\":" << counts.lines << ",\"moves\":" << counts.moves;
+    else
+        result << ",\"lines\":null,\"moves\":null";
+    result << ",\"processing_seconds\":" << fixed << setprecision(6) << seconds << ",\"error\":";
+    if (error.empty())
+        result << "null";
+    else
+        write_string(&result, error);
+    result << "}\n";
+
+    lock_guard<std::mutex> lock (results_mutex);
+    *results << result.str() << flush;
+    if (!error.empty())
+        failed++;
+}
+
+void ManifestRunner::run_worker() {
+    MANIFEST_ENTRY entry;
+    while (true) {
+        {
+            lock_guard<std::mutex> lock (manifest_mutex);
+            if (!read_entry(entry))
+                return;
+        }
+        process(entry);
+    }
+}
+
+bool ManifestRunner::run() {
+    vector<thread> workers;
+    for (size_t i = 0; i < worker_count; i++)
+        workers.emplace_back(&ManifestRunner::run_worker, this);
+    for (vector<thread>::iterator it = workers.begin(); it != workers.end(); ++it)
+        it->join();
+    return failed == 0;
+}
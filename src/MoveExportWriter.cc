@@ -0,0 +1,142 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MoveExportWriter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+static const char MAGIC[8] = { 'G', 'C', 'T', 'M', 'O', 'V', 'E', 'S' };
+static const size_t NAME_SIZE = 16;
+static const size_t HEADER_SIZE = sizeof(MAGIC) + 2 * sizeof(uint32_t) + sizeof(uint64_t);
+static const size_t DESCRIPTOR_SIZE = NAME_SIZE + 2 * sizeof(uint32_t) + sizeof(uint64_t);
+
+// Same order as the Column enum
+static const char * const COLUMN_NAMES[] = {
+    "offset", "line", "dx", "dy", "dz", "de", "feedrate", "accel_time", "duration"
+};
+static const MoveExportWriter::ColumnType COLUMN_TYPES[] = {
+    MoveExportWriter::COLUMN_U64, MoveExportWriter::COLUMN_U64,
+    MoveExportWriter::COLUMN_F32, MoveExportWriter::COLUMN_F32, MoveExportWriter::COLUMN_F32, MoveExportWriter::COLUMN_F32,
+    MoveExportWriter::COLUMN_F32, MoveExportWriter::COLUMN_F32, MoveExportWriter::COLUMN_F32
+};
+
+template <typename T> static void write_value(ostream &output, T value) {
+    output.write((const char *)&value, sizeof(T));
+}
+
+static inline uint32_t get_element_size(MoveExportWriter::ColumnType type) {
+    return type == MoveExportWriter::COLUMN_U64 ? sizeof(uint64_t) : sizeof(float);
+}
+
+static inline uint64_t align(uint64_t offset) {
+    return (offset + MoveExportWriter::COLUMN_ALIGNMENT - 1) / MoveExportWriter::COLUMN_ALIGNMENT * MoveExportWriter::COLUMN_ALIGNMENT;
+}
+
+MoveExportWriter::MoveExportWriter(const string &filename, uint64_t capacity) : filename(filename),
+        output(filename, ios::binary | ios::in | ios::out | ios::trunc), capacity(max(capacity, (uint64_t)1)), record_count(0), failed(false) {
+    uint64_t offset = HEADER_SIZE + COLUMN_COUNT * DESCRIPTOR_SIZE;
+    for (size_t i = 0; i < COLUMN_COUNT; i++) {
+        offset = align(offset);
+        columns[i].data.resize(BUFFER_SIZE);
+        columns[i].used = 0;
+        columns[i].offset = offset;
+        offset += this->capacity * get_element_size(COLUMN_TYPES[i]);
+    }
+}
+
+void MoveExportWriter::flush(COLUMN_BUFFER &buffer) {
+    if (buffer.used == 0)
+        return;
+    output.seekp(buffer.offset);
+    output.write(buffer.data.data(), buffer.used);
+    buffer.offset += buffer.used;
+    buffer.used = 0;
+}
+
+void MoveExportWriter::grow() {
+    for (size_t i = 0; i < COLUMN_COUNT; i++)
+        flush(columns[i]);
+    capacity *= 2;
+
+    // Every column but the first moves up, so the last one is moved first and each one from its
+    // end, which never overwrites data that is still to be read
+    uint64_t starts[COLUMN_COUNT];
+    uint64_t offset = HEADER_SIZE + COLUMN_COUNT * DESCRIPTOR_SIZE;
+    for (size_t i = 0; i < COLUMN_COUNT; i++) {
+        offset = align(offset);
+        starts[i] = offset;
+        offset += capacity * get_element_size(COLUMN_TYPES[i]);
+    }
+    for (size_t i = COLUMN_COUNT; i-- > 1; ) {
+        uint64_t length = record_count * get_element_size(COLUMN_TYPES[i]);
+        uint64_t start = columns[i].offset - length;
+        vector<char> &block = columns[i].data;
+        for (uint64_t end = length; end > 0 && !failed; ) {
+            uint64_t size = min(end, (uint64_t)block.size());
+            end -= size;
+            output.seekg(start + end);
+            output.read(block.data(), size);
+            output.seekp(starts[i] + end);
+            output.write(block.data(), size);
+            failed = !output;
+        }
+        columns[i].offset = starts[i] + length;
+    }
+}
+
+bool MoveExportWriter::close() {
+    if (!output.is_open()) {
+        cerr << "Cannot write " << filename << endl;
+        return false;
+    }
+
+    // The last column is flushed last, so that the file ends with its last record
+    for (size_t i = 0; i < COLUMN_COUNT; i++)
+        flush(columns[i]);
+
+    output.seekp(0);
+    output.write(MAGIC, sizeof(MAGIC));
+    write_value<uint32_t>(output, VERSION);
+    write_value<uint32_t>(output, COLUMN_COUNT);
+    write_value<uint64_t>(output, record_count);
+
+    for (size_t i = 0; i < COLUMN_COUNT; i++) {
+        uint32_t element_size = get_element_size(COLUMN_TYPES[i]);
+        char name[NAME_SIZE] = { 0 };
+        strncpy(name, COLUMN_NAMES[i], NAME_SIZE - 1);
+        output.write(name, NAME_SIZE);
+        write_value<uint32_t>(output, COLUMN_TYPES[i]);
+        write_value<uint32_t>(output, element_size);
+        write_value<uint64_t>(output, columns[i].offset - record_count * element_size);
+    }
+
+    output.close();
+    if (!output || failed) {
+        cerr << "Cannot write " << filename << endl;
+        return false;
+    }
+    return true;
+}
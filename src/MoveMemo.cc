@@ -0,0 +1,100 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MoveMemo.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+MoveMemo::MoveMemo(size_t max_size) : most_recent(NONE), least_recent(NONE), hits(0), misses(0) {
+    // Each slot also costs about one index node
+    size_t slot_size = sizeof(SLOT) + MAX_SEQUENCE_MOVES * (sizeof(QUANTIZED_MOVE) + sizeof(float)) + 4 * sizeof(void *);
+    capacity = max(max_size / slot_size, (size_t)1);
+    index.reserve(capacity);
+}
+
+void MoveMemo::unlink(uint32_t slot) {
+    SLOT &s = slots[slot];
+    if (s.previous != NONE)
+        slots[s.previous].next = s.next;
+    else
+        most_recent = s.next;
+    if (s.next != NONE)
+        slots[s.next].previous = s.previous;
+    else
+        least_recent = s.previous;
+}
+
+void MoveMemo::link_front(uint32_t slot) {
+    SLOT &s = slots[slot];
+    s.previous = NONE;
+    s.next = most_recent;
+    if (most_recent != NONE)
+        slots[most_recent].previous = slot;
+    most_recent = slot;
+    if (least_recent == NONE)
+        least_recent = slot;
+}
+
+const float * MoveMemo::find(uint64_t key, const QUANTIZED_MOVE *sequence_moves, size_t count) {
+    unordered_map<uint64_t, uint32_t>::const_iterator it = index.find(key);
+    if (it == index.end() || slots[it->second].count != count
+            || memcmp(moves.data() + (size_t)it->second * MAX_SEQUENCE_MOVES, sequence_moves, count * sizeof(QUANTIZED_MOVE)) != 0) {
+        misses++;
+        return NULL;
+    }
+
+    hits++;
+    if (it->second != most_recent) {
+        unlink(it->second);
+        link_front(it->second);
+    }
+    return durations.data() + (size_t)it->second * MAX_SEQUENCE_MOVES;
+}
+
+void MoveMemo::insert(uint64_t key, const QUANTIZED_MOVE *sequence_moves, const float *sequence_durations, size_t count) {
+    if (count > MAX_SEQUENCE_MOVES || index.count(key))
+        return;
+
+    uint32_t slot;
+    if (slots.size() < capacity) {
+        slot = slots.size();
+        slots.push_back(SLOT());
+        moves.resize(slots.size() * MAX_SEQUENCE_MOVES);
+        durations.resize(slots.size() * MAX_SEQUENCE_MOVES);
+    } else {
+        slot = least_recent;
+        unlink(slot);
+        index.erase(slots[slot].key);
+    }
+
+    slots[slot].key = key;
+    slots[slot].count = count;
+    memcpy(moves.data() + (size_t)slot * MAX_SEQUENCE_MOVES, sequence_moves, count * sizeof(QUANTIZED_MOVE));
+    memcpy(durations.data() + (size_t)slot * MAX_SEQUENCE_MOVES, sequence_durations, count * sizeof(float));
+    link_front(slot);
+    index[key] = slot;
+}
+
+uint64_t MoveMemo::get_hits() const { return hits; }
+uint64_t MoveMemo::get_misses() const { return misses; }
@@ -0,0 +1,88 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MoveTable.h"
+
+#include <fstream>
+
+#include "GCodeProcessorBase.h"
+
+using namespace std;
+
+// Records the moves instead of timing them, by acting as its own kinematics class
+class MoveRecorder : public GCodeProcessorBase {
+protected:
+    vector<MOVE> &moves;
+    vector<uint64_t> &lines;
+
+    virtual void process_line(const GCODE_LINE &line, const GCODE_COMMAND &command, float line_duration) {}
+
+public:
+    MoveRecorder(istream *input, vector<MOVE> &moves, vector<uint64_t> &lines) : GCodeProcessorBase(input), moves(moves), lines(lines) {}
+
+    inline float get_move_duration(const COORDS &movement, float rate) {
+        moves.push_back({ movement, rate });
+        lines.push_back(line_number);
+        return 0.0;
+    }
+
+    void process_file() {
+        process_input(*this);
+    }
+};
+
+MoveTable::MoveTable(const string &filename) : filename(filename) {}
+
+const string & MoveTable::get_filename() const { return filename; }
+size_t MoveTable::size() const { return moves.size(); }
+const vector<MOVE> & MoveTable::get_moves() const { return moves; }
+uint64_t MoveTable::get_line(size_t index) const { return lines[index]; }
+
+bool MoveTable::load() {
+    ifstream input (filename);
+    if (!input.is_open())
+        return false;
+
+    moves.clear();
+    lines.clear();
+    MoveRecorder recorder (&input, moves, lines);
+    recorder.process_file();
+    moves.shrink_to_fit();
+    lines.shrink_to_fit();
+    return true;
+}
+
+float MoveTable::estimate(const Config &config) const {
+    double estimated_time = 0.0;
+    with_kinematics(config, [&](auto &kinematics) {
+        for (vector<MOVE>::const_iterator it = moves.begin(); it != moves.end(); ++it)
+            estimated_time += kinematics.get_move_duration(it->movement, it->rate);
+    });
+    return estimated_time;
+}
+
+void MoveTable::estimate_moves(const Config &config, vector<float> &durations) const {
+    durations.resize(moves.size());
+    with_kinematics(config, [&](auto &kinematics) {
+        for (size_t i = 0; i < moves.size(); i++)
+            durations[i] = kinematics.get_move_duration(moves[i].movement, moves[i].rate);
+    });
+}
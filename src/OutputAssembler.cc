@@ -0,0 +1,173 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "OutputAssembler.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef __linux__
+
+class OutputWriter {
+protected:
+    int input_fd, output_fd;
+    const char *input_data;
+    uint64_t output_offset;     // Output position of the first pending iovec
+    vector<iovec> pending;
+    bool kernel_copy;
+
+public:
+    OutputWriter(int input_fd, int output_fd, const char *input_data)
+        : input_fd(input_fd), output_fd(output_fd), input_data(input_data), output_offset(0), kernel_copy(true) {
+        pending.reserve(IOV_MAX);
+    }
+
+    bool flush() {
+        size_t index = 0;
+        while (index < pending.size()) {
+            ssize_t written = pwritev(output_fd, &pending[index], pending.size() - index, output_offset);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            output_offset += written;
+
+            // Skip what has been written, the last vector may have been written partially
+            while (written > 0) {
+                if ((size_t)written >= pending[index].iov_len) {
+                    written -= pending[index].iov_len;
+                    index++;
+                } else {
+                    pending[index].iov_base = (char *)pending[index].iov_base + written;
+                    pending[index].iov_len -= written;
+                    written = 0;
+                }
+            }
+        }
+        pending.clear();
+        return true;
+    }
+
+    bool write(const char *data, size_t length) {
+        if (length == 0)
+            return true;
+        pending.push_back({ (void *)data, length });
+        return pending.size() < IOV_MAX || flush();
+    }
+
+    bool copy(uint64_t offset, uint64_t length) {
+        if (kernel_copy && length >= OutputAssembler::KERNEL_COPY_THRESHOLD) {
+            if (!flush())
+                return false;
+
+            loff_t input_offset = offset, position = output_offset;
+            while (length > 0) {
+                ssize_t copied = copy_file_range(input_fd, &input_offset, output_fd, &position, length, 0);
+                // The input has become shorter since it was mapped, reading the mapping past its end would fault
+                if (copied == 0)
+                    return false;
+                if (copied < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    // Not supported for these files (different file systems, old kernel): copy the rest from user space
+                    kernel_copy = false;
+                    break;
+                }
+                length -= copied;
+            }
+            offset = input_offset;
+            output_offset = position;
+            if (length == 0)
+                return true;
+        }
+        return write(input_data + offset, length);
+    }
+};
+
+bool OutputAssembler::assemble(const string &input_filename, const string &output_filename, const vector<EDIT> &edits, const string &text) {
+    int input_fd = open(input_filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (input_fd < 0)
+        return false;
+
+    struct stat input_stat;
+    if (fstat(input_fd, &input_stat) != 0) {
+        close(input_fd);
+        return false;
+    }
+    uint64_t input_size = input_stat.st_size;
+
+    const char *input_data = NULL;
+    if (input_size > 0) {
+        void *mapping = mmap(NULL, input_size, PROT_READ, MAP_PRIVATE, input_fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(input_fd);
+            return false;
+        }
+        madvise(mapping, input_size, MADV_SEQUENTIAL);
+        input_data = (const char *)mapping;
+    }
+
+    uint64_t output_size = input_size;
+    for (vector<EDIT>::const_iterator it = edits.begin(); it != edits.end(); ++it)
+        output_size += it->text_length - it->removed;
+
+    bool success = false;
+    int output_fd = open(output_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (output_fd >= 0) {
+        // Preallocation is only an optimization, not all file systems support it
+        if (output_size > 0)
+            fallocate(output_fd, 0, 0, output_size);
+
+        OutputWriter writer (input_fd, output_fd, input_data);
+        uint64_t position = 0;
+        success = true;
+        for (vector<EDIT>::const_iterator it = edits.begin(); success && it != edits.end(); ++it) {
+            success = writer.copy(position, it->offset - position) && writer.write(text.data() + it->text_start, it->text_length);
+            position = it->offset + it->removed;
+        }
+        success = success && writer.copy(position, input_size - position) && writer.flush();
+        success = ftruncate(output_fd, output_size) == 0 && success;
+        success = close(output_fd) == 0 && success;
+    }
+
+    if (input_data)
+        munmap((void *)input_data, input_size);
+    close(input_fd);
+    return success;
+}
+
+#else
+
+bool OutputAssembler::assemble(const string &input_filename, const string &output_filename, const vector<EDIT> &edits, const string &text) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,158 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "OverrideCurves.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+static const char MAGIC[8] = { 'G', 'C', 'T', 'C', 'U', 'R', 'V', 'E' };
+
+template <typename T> static void write_value(ostream &output, T value) {
+    output.write((const char *)&value, sizeof(T));
+}
+
+template <typename T> static bool read_value(istream &input, T &value) {
+    return (bool)input.read((char *)&value, sizeof(T));
+}
+
+OverrideCurves::OverrideCurves() {
+    for (size_t i = 0; i < FACTOR_COUNT; i++)
+        factors[i] = i == UNIT_FACTOR ? 1.0f : pow(10.0f, ((float)i - UNIT_FACTOR) / UNIT_FACTOR);
+    reset();
+}
+
+void OverrideCurves::reset() {
+    offsets.clear();
+    remaining.clear();
+    elapsed.clear();
+    file_size = 0;
+    next_checkpoint = 0;
+}
+
+void OverrideCurves::add_checkpoint(uint64_t offset, const double *elapsed_times) {
+    offsets.push_back(offset);
+    elapsed.insert(elapsed.end(), elapsed_times, elapsed_times + FACTOR_COUNT);
+    next_checkpoint = offset + CHECKPOINT_BYTES;
+}
+
+void OverrideCurves::finish(uint64_t file_size, const double *total_times) {
+    // The end of the file is a checkpoint with no time left
+    if (offsets.empty() || offsets.back() < file_size) {
+        offsets.push_back(file_size);
+        elapsed.insert(elapsed.end(), total_times, total_times + FACTOR_COUNT);
+    }
+
+    // The differences are taken in double, so the remaining time is exact even late in long prints
+    remaining.resize(elapsed.size());
+    for (size_t i = 0; i < elapsed.size(); i++)
+        remaining[i] = total_times[i % FACTOR_COUNT] - elapsed[i];
+    elapsed.clear();
+    elapsed.shrink_to_fit();
+    this->file_size = file_size;
+}
+
+bool OverrideCurves::save(const string &filename) const {
+    ofstream output (filename, ios::binary | ios::trunc);
+    output.write(MAGIC, sizeof(MAGIC));
+    write_value<uint32_t>(output, VERSION);
+    write_value<uint32_t>(output, FACTOR_COUNT);
+    write_value<uint64_t>(output, offsets.size());
+    write_value<uint64_t>(output, file_size);
+    output.write((const char *)factors, sizeof(factors));
+    output.write((const char *)offsets.data(), offsets.size() * sizeof(uint64_t));
+    output.write((const char *)remaining.data(), remaining.size() * sizeof(float));
+    output.close();
+    if (output.fail()) {
+        cerr << "Cannot write " << filename << endl;
+        return false;
+    }
+    return true;
+}
+
+bool OverrideCurves::load(const string &filename) {
+    reset();
+    ifstream input (filename, ios::binary);
+    char magic[sizeof(MAGIC)];
+    uint32_t version, factor_count;
+    uint64_t checkpoint_count;
+    if (!input.read(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0
+            || !read_value(input, version) || version != VERSION || !read_value(input, factor_count) || factor_count != FACTOR_COUNT
+            || !read_value(input, checkpoint_count) || !read_value(input, file_size))
+        return false;
+
+    float file_factors[FACTOR_COUNT];
+    if (!input.read((char *)file_factors, sizeof(file_factors)) || memcmp(file_factors, factors, sizeof(factors)) != 0)
+        return false;
+
+    // The size is checked before allocating, so a damaged count cannot exhaust the memory
+    streampos data_start = input.tellg();
+    input.seekg(0, ios::end);
+    if (checkpoint_count == 0 || (uint64_t)(input.tellg() - data_start) != checkpoint_count * (sizeof(uint64_t) + FACTOR_COUNT * sizeof(float)))
+        return false;
+    input.seekg(data_start);
+
+    offsets.resize(checkpoint_count);
+    remaining.resize(checkpoint_count * FACTOR_COUNT);
+    if (!input.read((char *)offsets.data(), offsets.size() * sizeof(uint64_t))
+            || !input.read((char *)remaining.data(), remaining.size() * sizeof(float))) {
+        reset();
+        return false;
+    }
+    next_checkpoint = UINT64_MAX;
+    return true;
+}
+
+uint64_t OverrideCurves::get_file_size() const {
+    return file_size;
+}
+
+size_t OverrideCurves::get_checkpoint_count() const {
+    return offsets.size();
+}
+
+float OverrideCurves::get_remaining_time(uint64_t offset, float factor) const {
+    if (offsets.empty())
+        return 0.0;
+
+    // Checkpoints around the offset, the time in between is spread evenly over its bytes
+    size_t next = upper_bound(offsets.begin(), offsets.end(), offset) - offsets.begin();
+    size_t previous = next > 0 ? next - 1 : 0;
+    next = min(next, offsets.size() - 1);
+    float position = next > previous ? (float)(offset - offsets[previous]) / (offsets[next] - offsets[previous]) : 0.0f;
+
+    // Sampled factors around the override. Most of the time of a move scales with the inverse of
+    // the speed, so the curves are interpolated linearly in it
+    factor = min(max(factor, factors[0]), factors[FACTOR_COUNT - 1]);
+    size_t upper = upper_bound(factors + 1, factors + FACTOR_COUNT - 1, factor) - factors;
+    size_t lower = upper - 1;
+    float weight = (1.0f / factor - 1.0f / factors[lower]) / (1.0f / factors[upper] - 1.0f / factors[lower]);
+
+    const float *before = &remaining[previous * FACTOR_COUNT], *after = &remaining[next * FACTOR_COUNT];
+    float at_lower = before[lower] + position * (after[lower] - before[lower]);
+    float at_upper = before[upper] + position * (after[upper] - before[upper]);
+    return at_lower + weight * (at_upper - at_lower);
+}
@@ -0,0 +1,144 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ProfileSet.h"
+
+#include <cmath>
+
+using namespace std;
+
+ProfileSet::ProfileSet(const vector<Config> &profiles, const vector<string> &names) : names(names) {
+    padded_size = (profiles.size() + LANES - 1) / LANES * LANES;
+    parameters.resize(PARAMETER_COUNT * padded_size);
+    totals.resize(padded_size);
+
+    for (size_t i = 0; i < padded_size; i++) {
+        // Padding lanes repeat the first profile so that they do not produce NaNs
+        const Config &config = profiles[i < profiles.size() ? i : 0];
+        float *p = &parameters[i];
+        p[PRINT_ACCEL_X * padded_size] = config.max_print_accel.x;
+        p[PRINT_ACCEL_Y * padded_size] = config.max_print_accel.y;
+        p[PRINT_ACCEL_Z * padded_size] = config.max_print_accel.z;
+        p[PRINT_ACCEL_E * padded_size] = config.max_print_accel.e;
+        p[MOVE_ACCEL_X * padded_size] = config.max_move_accel.x;
+        p[MOVE_ACCEL_Y * padded_size] = config.max_move_accel.y;
+        p[MOVE_ACCEL_Z * padded_size] = config.max_move_accel.z;
+        p[MOVE_ACCEL_E * padded_size] = config.max_move_accel.e;
+        p[MAX_JERK_X * padded_size] = config.max_jerk.x;
+        p[MAX_JERK_Y * padded_size] = config.max_jerk.y;
+        p[MAX_JERK_Z * padded_size] = config.max_jerk.z;
+        p[MAX_JERK_E * padded_size] = config.max_jerk.e;
+        p[MAX_JERK_MAGNITUDE * padded_size] = Utils::get_euclidean_length(config.max_jerk);
+        p[JERK_EFFICIENCY * padded_size] = config.jerk_efficiency;
+        p[ACCEL_EFFICIENCY * padded_size] = config.accel_efficiency;
+        p[SPEED_MULTIPLIER * padded_size] = config.speed_multiplier;
+    }
+}
+
+size_t ProfileSet::size() const { return names.size(); }
+const string & ProfileSet::get_name(size_t profile) const { return names[profile]; }
+double ProfileSet::get_total(size_t profile) const { return totals[profile]; }
+
+void ProfileSet::reset() {
+    fill(totals.begin(), totals.end(), 0.0);
+}
+
+void ProfileSet::add_move(const COORDS &movement, float rate) {
+    // Values that only depend on the move are computed once for all profiles
+    float length = Utils::get_euclidean_length(movement);
+    COORDS abs_movement = Utils::map(movement, [](float c) { return std::abs(c); });
+    bool print_move = movement.e != 0.0;
+
+    const float *accel_x = row(print_move ? PRINT_ACCEL_X : MOVE_ACCEL_X);
+    const float *accel_y = row(print_move ? PRINT_ACCEL_Y : MOVE_ACCEL_Y);
+    const float *accel_z = row(print_move ? PRINT_ACCEL_Z : MOVE_ACCEL_Z);
+    const float *accel_e = row(print_move ? PRINT_ACCEL_E : MOVE_ACCEL_E);
+    const float *jerk_x = row(MAX_JERK_X), *jerk_y = row(MAX_JERK_Y), *jerk_z = row(MAX_JERK_Z), *jerk_e = row(MAX_JERK_E);
+    const float *max_jerk_magnitude = row(MAX_JERK_MAGNITUDE);
+    const float *jerk_efficiency = row(JERK_EFFICIENCY);
+    const float *accel_efficiency = row(ACCEL_EFFICIENCY);
+    const float *speed_multiplier = row(SPEED_MULTIPLIER);
+
+    for (size_t block = 0; block < padded_size; block += LANES) {
+        float duration[LANES];
+
+        // Same operations as ClassicJerkKinematics::get_move_duration(), with the branches turned into
+        // selects so that each line maps to a few SIMD instructions across the lanes
+        for (size_t l = 0, i = block; l < LANES; l++, i++) {
+            float rate_speed_factor = speed_multiplier[i] * rate / length;
+            float speed_x = movement.x * rate_speed_factor, speed_y = movement.y * rate_speed_factor;
+            float speed_z = movement.z * rate_speed_factor, speed_e = movement.e * rate_speed_factor;
+
+            // Jerk components, reduced to comply with the max jerk per component
+            float jerk_speed_factor = max_jerk_magnitude[i] / length;
+            float jerk_speed_x = abs_movement.x * jerk_speed_factor, jerk_speed_y = abs_movement.y * jerk_speed_factor;
+            float jerk_speed_z = abs_movement.z * jerk_speed_factor, jerk_speed_e = abs_movement.e * jerk_speed_factor;
+            float reduce_x = jerk_x[i] / jerk_speed_x, reduce_y = jerk_y[i] / jerk_speed_y;
+            float reduce_z = jerk_z[i] / jerk_speed_z, reduce_e = jerk_e[i] / jerk_speed_e;
+            reduce_x = jerk_speed_x > jerk_x[i] ? reduce_x : 1.0f;
+            reduce_y = jerk_speed_y > jerk_y[i] ? reduce_y : 1.0f;
+            reduce_z = jerk_speed_z > jerk_z[i] ? reduce_z : 1.0f;
+            reduce_e = jerk_speed_e > jerk_e[i] ? reduce_e : 1.0f;
+            float jerk_multiplier = 1.0f;
+            jerk_multiplier = reduce_x < jerk_multiplier ? reduce_x : jerk_multiplier;
+            jerk_multiplier = reduce_y < jerk_multiplier ? reduce_y : jerk_multiplier;
+            jerk_multiplier = reduce_z < jerk_multiplier ? reduce_z : jerk_multiplier;
+            jerk_multiplier = reduce_e < jerk_multiplier ? reduce_e : jerk_multiplier;
+            jerk_speed_x = jerk_speed_x * jerk_multiplier * jerk_efficiency[i];
+            jerk_speed_y = jerk_speed_y * jerk_multiplier * jerk_efficiency[i];
+            jerk_speed_z = jerk_speed_z * jerk_multiplier * jerk_efficiency[i];
+            jerk_speed_e = jerk_speed_e * jerk_multiplier * jerk_efficiency[i];
+            float jerk_magnitude = sqrt(jerk_speed_x * jerk_speed_x + jerk_speed_y * jerk_speed_y + jerk_speed_z * jerk_speed_z + jerk_speed_e * jerk_speed_e);
+
+            // Speed deltas and acceleration time
+            float delta_x = std::abs(speed_x) - jerk_speed_x, delta_y = std::abs(speed_y) - jerk_speed_y;
+            float delta_z = std::abs(speed_z) - jerk_speed_z, delta_e = std::abs(speed_e) - jerk_speed_e;
+            delta_x = delta_x > 0.0f ? delta_x : 0.0f;
+            delta_y = delta_y > 0.0f ? delta_y : 0.0f;
+            delta_z = delta_z > 0.0f ? delta_z : 0.0f;
+            delta_e = delta_e > 0.0f ? delta_e : 0.0f;
+            float accel_time_x = delta_x / accel_x[i], accel_time_y = delta_y / accel_y[i];
+            float accel_time_z = delta_z / accel_z[i], accel_time_e = delta_e / accel_e[i];
+            float accel_time = accel_time_x;
+            accel_time = accel_time_x < accel_time ? accel_time : accel_time_x;
+            accel_time = accel_time_y < accel_time ? accel_time : accel_time_y;
+            accel_time = accel_time_z < accel_time ? accel_time : accel_time_z;
+            accel_time = accel_time_e < accel_time ? accel_time : accel_time_e;
+
+            bool accelerates = accel_time > EPSILON;
+            float accel_vector_x = delta_x / accel_time, accel_vector_y = delta_y / accel_time;
+            float accel_vector_z = delta_z / accel_time, accel_vector_e = delta_e / accel_time;
+            float accel_magnitude = sqrt(accel_vector_x * accel_vector_x + accel_vector_y * accel_vector_y + accel_vector_z * accel_vector_z + accel_vector_e * accel_vector_e) * accel_efficiency[i];
+            accel_magnitude = accelerates ? accel_magnitude : 0.0f;
+            accel_time = accelerates ? accel_time : 0.0f;
+
+            float speed_magnitude = sqrt(speed_x * speed_x + speed_y * speed_y + speed_z * speed_z + speed_e * speed_e);
+
+            float accel_length = (2 * jerk_magnitude + accel_magnitude * accel_time) * accel_time;
+            float full_duration = accel_time * 2 + (length - accel_length) / speed_magnitude;
+            float short_duration = (sqrt(jerk_magnitude * jerk_magnitude + accel_magnitude * length) - jerk_magnitude) / (accel_magnitude / 2);
+            duration[l] = length > accel_length ? full_duration : short_duration;
+        }
+
+        for (size_t l = 0; l < LANES; l++)
+            totals[block + l] += duration[l];
+    }
+}
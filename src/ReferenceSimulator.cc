@@ -0,0 +1,562 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ReferenceSimulator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+
+#include "Utils.h"
+
+using namespace std;
+
+static const int AXES = 4;
+
+static inline void to_array(const COORDS &coords, float *values) {
+    values[0] = coords.x;
+    values[1] = coords.y;
+    values[2] = coords.z;
+    values[3] = coords.e;
+}
+
+ReferenceSimulator::ReferenceSimulator(const Config &config) : config(config), steps(0), interrupts(0) {}
+
+uint64_t ReferenceSimulator::get_step_count() const { return steps; }
+uint64_t ReferenceSimulator::get_interrupt_count() const { return interrupts; }
+
+uint32_t ReferenceSimulator::calc_timer_interval(uint32_t step_rate, uint32_t &step_loops) {
+    if (step_rate > MAX_STEP_FREQUENCY)
+        step_rate = MAX_STEP_FREQUENCY;
+    if (step_rate > 2 * DOUBLE_STEP_FREQUENCY) {
+        step_rate >>= 2;
+        step_loops = 4;
+    } else if (step_rate > DOUBLE_STEP_FREQUENCY) {
+        step_rate >>= 1;
+        step_loops = 2;
+    } else {
+        step_loops = 1;
+    }
+
+    // The slowest rate of the 16 bit timer, and the shortest interval the interrupt can keep up with
+    if (step_rate < 32)
+        step_rate = 32;
+    uint32_t timer = STEPPER_TIMER_RATE / step_rate;
+    return timer < 100 ? 100 : timer;
+}
+
+float ReferenceSimulator::get_jerk_junction_speed_sqr(const BLOCK &block, const float *current_speed, float &safe_speed) {
+    float max_jerk[AXES];
+    to_array(config.max_jerk, max_jerk);
+
+    // The highest speed the block can start at from a standstill
+    safe_speed = block.nominal_speed;
+    bool limited = false;
+    for (int axis = 0; axis < AXES; axis++) {
+        float jerk = abs(current_speed[axis]);
+        if (jerk <= max_jerk[axis])
+            continue;
+        if (limited) {
+            float max_axis_jerk = max_jerk[axis] * block.nominal_speed;
+            if (jerk * safe_speed > max_axis_jerk)
+                safe_speed = max_axis_jerk / jerk;
+        } else {
+            limited = true;
+            safe_speed = max_jerk[axis];
+        }
+    }
+
+    if (previous_nominal_speed <= 0.0001f)
+        return safe_speed * safe_speed;
+
+    // The speed change of every axis at the junction, at the lower of both nominal speeds
+    bool previous_faster = previous_nominal_speed > block.nominal_speed;
+    float smaller_speed_factor = previous_faster ? block.nominal_speed / previous_nominal_speed : previous_nominal_speed / block.nominal_speed;
+    float vmax_junction = previous_faster ? block.nominal_speed : previous_nominal_speed;
+    float v_factor = 1.0;
+    limited = false;
+    for (int axis = 0; axis < AXES; axis++) {
+        float v_exit = previous_speed[axis] * smaller_speed_factor, v_entry = current_speed[axis];
+        if (limited) {
+            v_exit *= v_factor;
+            v_entry *= v_factor;
+        }
+        // Coasting, reversal or full stop of the axis
+        float jerk = v_exit > v_entry ? ((v_entry > 0 || v_exit < 0) ? v_exit - v_entry : max(v_exit, -v_entry))
+                                      : ((v_entry < 0 || v_exit > 0) ? v_entry - v_exit : max(-v_exit, v_entry));
+        if (jerk > max_jerk[axis]) {
+            v_factor *= max_jerk[axis] / jerk;
+            limited = true;
+        }
+    }
+    if (limited)
+        vmax_junction *= v_factor;
+
+    // Nearly straight junctions are taken at the safe speed, if that is higher
+    float threshold = vmax_junction * 0.99f;
+    if (previous_safe_speed > threshold && safe_speed > threshold)
+        vmax_junction = safe_speed;
+    return vmax_junction * vmax_junction;
+}
+
+float ReferenceSimulator::get_deviation_junction_speed_sqr(const BLOCK &block, const float *unit_vector) {
+    if (previous_nominal_speed <= 0.0001f)
+        return 0.0;
+
+    float cos_theta = 0.0;
+    for (int axis = 0; axis < AXES; axis++)
+        cos_theta -= previous_unit_vector[axis] * unit_vector[axis];
+    if (cos_theta > 0.999999f)
+        return MINIMUM_PLANNER_SPEED * MINIMUM_PLANNER_SPEED;
+    cos_theta = max(cos_theta, -0.999999f);
+    float sin_theta_d2 = sqrt(0.5f * (1.0f - cos_theta));
+
+    // The acceleration along the junction vector, limited per axis
+    float max_accel[AXES], junction_vector[AXES], length = 0.0;
+    to_array(block.steps[3] ? config.max_print_accel : config.max_move_accel, max_accel);
+    for (int axis = 0; axis < AXES; axis++) {
+        junction_vector[axis] = unit_vector[axis] - previous_unit_vector[axis];
+        length += junction_vector[axis] * junction_vector[axis];
+    }
+    length = sqrt(length);
+    float junction_acceleration = block.acceleration;
+    for (int axis = 0; axis < AXES; axis++) {
+        float component = abs(junction_vector[axis] / length);
+        if (component > 0.0f && max_accel[axis] > 0.0f && junction_acceleration * component > max_accel[axis])
+            junction_acceleration = max_accel[axis] / component;
+    }
+    float vmax_junction_sqr = junction_acceleration * config.junction_deviation * sin_theta_d2 / (1.0f - sin_theta_d2);
+
+    // Short segments of arcs are limited by the centripetal acceleration of the arc
+    if (block.millimeters < 1.0f) {
+        float junction_theta = (float)M_PI_2 + asin(cos_theta);
+        vmax_junction_sqr = min(vmax_junction_sqr, block.millimeters * junction_acceleration / junction_theta);
+    }
+    return min(vmax_junction_sqr, min(block.nominal_speed * block.nominal_speed, previous_nominal_speed * previous_nominal_speed));
+}
+
+bool ReferenceSimulator::add_block(size_t index, const MOVE &move) {
+    float steps_per_mm[AXES], movement[AXES];
+    to_array(config.steps_per_mm, steps_per_mm);
+    to_array(move.movement, movement);
+
+    BLOCK block;
+    block.move = index;
+    block.step_event_count = 0;
+    int64_t target_steps[AXES], delta[AXES];
+    for (int axis = 0; axis < AXES; axis++) {
+        target[axis] += movement[axis];
+        target_steps[axis] = llround(target[axis] * steps_per_mm[axis]);
+        delta[axis] = target_steps[axis] - position[axis];
+        block.steps[axis] = (uint32_t)llabs(delta[axis]);
+        block.step_event_count = max(block.step_event_count, block.steps[axis]);
+    }
+    // The firmware keeps its position, so the distance is added to the next move
+    if (block.step_event_count < MIN_STEPS_PER_SEGMENT)
+        return false;
+
+    float delta_mm[AXES];
+    for (int axis = 0; axis < AXES; axis++)
+        delta_mm[axis] = delta[axis] / steps_per_mm[axis];
+    if (block.steps[0] < MIN_STEPS_PER_SEGMENT && block.steps[1] < MIN_STEPS_PER_SEGMENT && block.steps[2] < MIN_STEPS_PER_SEGMENT)
+        block.millimeters = abs(delta_mm[3]);
+    else
+        block.millimeters = sqrt(delta_mm[0] * delta_mm[0] + delta_mm[1] * delta_mm[1] + delta_mm[2] * delta_mm[2]);
+    float inverse_millimeters = 1.0f / block.millimeters;
+
+    block.nominal_speed = max(move.rate * config.speed_multiplier, MINIMUM_PLANNER_SPEED);
+    float inverse_secs = block.nominal_speed * inverse_millimeters;
+    block.nominal_rate = max((uint32_t)ceil(block.step_event_count * inverse_secs), (uint32_t)MINIMAL_STEP_RATE);
+    float current_speed[AXES], unit_vector[AXES];
+    for (int axis = 0; axis < AXES; axis++) {
+        current_speed[axis] = delta_mm[axis] * inverse_secs;
+        unit_vector[axis] = delta_mm[axis] * inverse_millimeters;
+    }
+
+    // The acceleration in steps of the leading axis, limited by the maximum of every axis
+    float max_accel[AXES];
+    to_array(block.steps[3] ? config.max_print_accel : config.max_move_accel, max_accel);
+    double accel = INFINITY;
+    for (int axis = 0; axis < AXES; axis++) {
+        if (block.steps[axis] && max_accel[axis] > 0.0f)
+            accel = min(accel, (double)max_accel[axis] * steps_per_mm[axis] * block.step_event_count / block.steps[axis]);
+    }
+    block.acceleration_steps_per_s2 = isfinite(accel) ? max((uint32_t)accel, (uint32_t)1) : UINT32_MAX / 2;
+    block.acceleration = block.acceleration_steps_per_s2 / (block.step_event_count * inverse_millimeters);
+
+    float safe_speed = 0.0;
+    float vmax_junction_sqr = config.motion_model == MOTION_JUNCTION_DEVIATION
+        ? get_deviation_junction_speed_sqr(block, unit_vector)
+        : get_jerk_junction_speed_sqr(block, current_speed, safe_speed);
+    float allowable_speed_sqr = MINIMUM_PLANNER_SPEED * MINIMUM_PLANNER_SPEED + 2 * block.acceleration * block.millimeters;
+    block.max_entry_speed_sqr = vmax_junction_sqr;
+    block.entry_speed_sqr = min(vmax_junction_sqr, allowable_speed_sqr);
+    block.nominal_length = block.nominal_speed * block.nominal_speed <= allowable_speed_sqr;
+    block.entry_fixed = false;
+
+    memcpy(previous_speed, current_speed, sizeof(previous_speed));
+    memcpy(previous_unit_vector, unit_vector, sizeof(previous_unit_vector));
+    previous_nominal_speed = block.nominal_speed;
+    previous_safe_speed = safe_speed;
+    memcpy(position, target_steps, sizeof(position));
+
+    blocks.push_back(block);
+    return true;
+}
+
+void ReferenceSimulator::recalculate() {
+    // Reverse pass: every block can decelerate to the entry speed of the next one, the last one to a stop
+    float next_entry_speed_sqr = MINIMUM_PLANNER_SPEED * MINIMUM_PLANNER_SPEED;
+    for (size_t i = blocks.size(); i-- > 0; ) {
+        BLOCK &block = blocks[i];
+        if (!block.entry_fixed) {
+            block.entry_speed_sqr = block.nominal_length ? block.max_entry_speed_sqr
+                : min(block.max_entry_speed_sqr, next_entry_speed_sqr + 2 * block.acceleration * block.millimeters);
+        }
+        next_entry_speed_sqr = block.entry_speed_sqr;
+    }
+
+    // Forward pass: every block can be reached from the entry speed of the previous one
+    for (size_t i = 1; i < blocks.size(); i++) {
+        const BLOCK &previous = blocks[i - 1];
+        BLOCK &block = blocks[i];
+        if (block.entry_fixed || previous.nominal_length)
+            continue;
+        float reachable_speed_sqr = previous.entry_speed_sqr + 2 * previous.acceleration * previous.millimeters;
+        if (reachable_speed_sqr < block.entry_speed_sqr)
+            block.entry_speed_sqr = reachable_speed_sqr;
+    }
+}
+
+double ReferenceSimulator::execute_block(const BLOCK &block, float exit_speed_sqr) {
+    // Trapezoid in steps
+    uint32_t count = block.step_event_count;
+    uint32_t initial_rate = max((uint32_t)ceil(block.nominal_rate * sqrt(block.entry_speed_sqr) / block.nominal_speed), (uint32_t)MINIMAL_STEP_RATE);
+    uint32_t final_rate = max((uint32_t)ceil(block.nominal_rate * sqrt(exit_speed_sqr) / block.nominal_speed), (uint32_t)MINIMAL_STEP_RATE);
+    double accel = block.acceleration_steps_per_s2;
+    double nominal_sqr = (double)block.nominal_rate * block.nominal_rate;
+    double initial_sqr = (double)initial_rate * initial_rate, final_sqr = (double)final_rate * final_rate;
+
+    int64_t accelerate_steps = (int64_t)ceil((nominal_sqr - initial_sqr) / (2 * accel));
+    int64_t decelerate_steps = (int64_t)floor((nominal_sqr - final_sqr) / (2 * accel));
+    int64_t plateau_steps = (int64_t)count - accelerate_steps - decelerate_steps;
+    if (plateau_steps < 0) {
+        // The nominal rate is not reached, accelerate up to the intersection with the deceleration
+        accelerate_steps = (int64_t)ceil((2 * accel * count - initial_sqr + final_sqr) / (4 * accel));
+        accelerate_steps = min(max(accelerate_steps, (int64_t)0), (int64_t)count);
+        plateau_steps = 0;
+    }
+    uint32_t accelerate_until = accelerate_steps, decelerate_after = accelerate_steps + plateau_steps;
+
+    // Stepper interrupt. The rate during acceleration and deceleration depends on the time since
+    // the start of the phase, in timer ticks
+    uint32_t acceleration_rate = (uint32_t)(accel * 16777216.0 / STEPPER_TIMER_RATE);
+    uint32_t step_loops, nominal_loops;
+    uint32_t nominal_interval = calc_timer_interval(block.nominal_rate, nominal_loops);
+    uint32_t acc_step_rate = initial_rate;
+    uint64_t acceleration_time = calc_timer_interval(initial_rate, step_loops), deceleration_time = 0;
+    uint64_t ticks = 0;
+    uint32_t completed = 0;
+    while (true) {
+        completed = min(completed + step_loops, count);
+        interrupts++;
+
+        uint32_t interval;
+        if (completed <= accelerate_until) {
+            acc_step_rate = min((uint32_t)((acceleration_time * acceleration_rate) >> 24) + initial_rate, block.nominal_rate);
+            interval = calc_timer_interval(acc_step_rate, step_loops);
+            acceleration_time += interval;
+        } else if (completed > decelerate_after) {
+            uint32_t step_rate = (uint32_t)((deceleration_time * acceleration_rate) >> 24);
+            step_rate = step_rate < acc_step_rate ? max(acc_step_rate - step_rate, final_rate) : final_rate;
+            interval = calc_timer_interval(step_rate, step_loops);
+            deceleration_time += interval;
+        } else {
+            interval = nominal_interval;
+            step_loops = nominal_loops;
+
+            // The interrupts up to the deceleration only differ in their step count
+            uint32_t cruise_end = min(decelerate_after, count - 1);
+            if (completed < cruise_end) {
+                uint64_t skipped = (cruise_end - completed) / step_loops;
+                completed += skipped * step_loops;
+                ticks += skipped * interval;
+                interrupts += skipped;
+            }
+        }
+        ticks += interval;
+        if (completed == count)
+            break;
+    }
+
+    steps += count;
+    return (double)ticks / STEPPER_TIMER_RATE;
+}
+
+double ReferenceSimulator::simulate_marlin(const MoveTable &table, vector<float> &durations, uint64_t &dropped) {
+    memset(position, 0, sizeof(position));
+    memset(target, 0, sizeof(target));
+    memset(previous_speed, 0, sizeof(previous_speed));
+    memset(previous_unit_vector, 0, sizeof(previous_unit_vector));
+    previous_nominal_speed = 0.0;
+    previous_safe_speed = 0.0;
+    blocks.clear();
+
+    // The first block starts as soon as the buffer is full, and the host keeps it full
+    const vector<MOVE> &moves = table.get_moves();
+    double total = 0.0;
+    dropped = 0;
+    for (size_t i = 0; i < moves.size() || !blocks.empty(); ) {
+        if (i < moves.size()) {
+            if (!add_block(i, moves[i]))
+                dropped++;
+            if (++i < moves.size() && blocks.size() < PLANNER_BUFFER_SIZE - 1)
+                continue;
+        }
+        if (blocks.empty())
+            continue;
+
+        recalculate();
+        float exit_speed_sqr = blocks.size() > 1 ? blocks[1].entry_speed_sqr : MINIMUM_PLANNER_SPEED * MINIMUM_PLANNER_SPEED;
+        double duration = execute_block(blocks.front(), exit_speed_sqr);
+        durations[blocks.front().move] = duration;
+        total += duration;
+        blocks.pop_front();
+        if (!blocks.empty())
+            blocks.front().entry_fixed = true;
+    }
+    return total;
+}
+
+double ReferenceSimulator::simulate_klipper(const MoveTable &table, vector<float> &durations) {
+    const vector<MOVE> &moves = table.get_moves();
+    vector<KLIPPER_MOVE> planned (moves.size());
+    float steps_per_mm[AXES];
+    to_array(config.steps_per_mm, steps_per_mm);
+    float corner_scale = config.square_corner_velocity * config.square_corner_velocity * (sqrt(2.0f) - 1.0f);
+    double exact_position[AXES] = { 0.0, 0.0, 0.0, 0.0 };
+    int64_t step_position[AXES] = { 0, 0, 0, 0 };
+
+    for (size_t i = 0; i < moves.size(); i++) {
+        const COORDS &movement = moves[i].movement;
+        KLIPPER_MOVE &move = planned[i];
+        float xyz_d = sqrt(movement.x * movement.x + movement.y * movement.y + movement.z * movement.z);
+        move.kinematic = xyz_d >= 0.000000001f;
+        move.move_d = move.kinematic ? xyz_d : abs(movement.e);
+        move.axes_r = Utils::map(movement, [&](float c) { return c / move.move_d; });
+
+        // Every step is scheduled at its exact time, they are only counted
+        float values[AXES];
+        to_array(movement, values);
+        uint64_t move_steps = 0;
+        for (int axis = 0; axis < AXES; axis++) {
+            exact_position[axis] += values[axis];
+            int64_t target_steps = llround(exact_position[axis] * steps_per_mm[axis]);
+            move_steps = max(move_steps, (uint64_t)llabs(target_steps - step_position[axis]));
+            step_position[axis] = target_steps;
+        }
+        steps += move_steps;
+
+        float max_accel[AXES], direction[AXES];
+        to_array(movement.e != 0.0f ? config.max_print_accel : config.max_move_accel, max_accel);
+        to_array(move.axes_r, direction);
+        move.accel = INFINITY;
+        for (int axis = move.kinematic ? 0 : 3; axis < (move.kinematic ? 3 : 4); axis++) {
+            if (direction[axis] != 0.0f && max_accel[axis] > 0.0f)
+                move.accel = min(move.accel, max_accel[axis] / abs(direction[axis]));
+        }
+
+        float speed = max(moves[i].rate * config.speed_multiplier, MINIMUM_PLANNER_SPEED);
+        move.max_cruise_v2 = speed * speed;
+        move.delta_v2 = 2.0f * move.move_d * move.accel;
+        move.smooth_delta_v2 = move.delta_v2 * (1.0f - MINIMUM_CRUISE_RATIO);
+        move.max_start_v2 = 0.0;
+        move.max_smoothed_v2 = 0.0;
+        if (i == 0 || !move.kinematic || !planned[i - 1].kinematic)
+            continue;
+
+        const KLIPPER_MOVE &previous = planned[i - 1];
+        float extruder_v2 = INFINITY;
+        float extrusion_change = abs(move.axes_r.e - previous.axes_r.e);
+        if (extrusion_change > 0.0f)
+            extruder_v2 = (INSTANT_CORNER_VELOCITY / extrusion_change) * (INSTANT_CORNER_VELOCITY / extrusion_change);
+
+        float cos_theta = -(move.axes_r.x * previous.axes_r.x + move.axes_r.y * previous.axes_r.y + move.axes_r.z * previous.axes_r.z);
+        float sin_theta_d2 = sqrt(Utils::pos(0.5f * (1.0f - cos_theta)));
+        float cos_theta_d2 = sqrt(Utils::pos(0.5f * (1.0f + cos_theta)));
+        float max_start_v2 = INFINITY;
+        if (1.0f - sin_theta_d2 > 0.0f && cos_theta_d2 > 0.0f) {
+            float r_jd = sin_theta_d2 / (1.0f - sin_theta_d2);
+            float quarter_tan_theta_d2 = 0.25f * sin_theta_d2 / cos_theta_d2;
+            max_start_v2 = min(r_jd * corner_scale, min(move.delta_v2, previous.delta_v2) * quarter_tan_theta_d2);
+        }
+        move.max_start_v2 = min(min(max_start_v2, extruder_v2), min(min(move.max_cruise_v2, previous.max_cruise_v2), previous.max_start_v2 + previous.delta_v2));
+        move.max_smoothed_v2 = min(move.max_start_v2, previous.max_smoothed_v2 + previous.smooth_delta_v2);
+    }
+
+    // Look ahead over the whole file, from the end. Moves that only accelerate are delayed until
+    // the peak cruise speed in front of them is known
+    auto set_junction = [&](size_t index, float start_v2, float cruise_v2, float end_v2) {
+        const KLIPPER_MOVE &move = planned[index];
+        float half_inverse_accel = 0.5f / move.accel;
+        float accel_d = (cruise_v2 - start_v2) * half_inverse_accel, decel_d = (cruise_v2 - end_v2) * half_inverse_accel;
+        float cruise_d = move.move_d - accel_d - decel_d;
+        float start_v = sqrt(start_v2), cruise_v = sqrt(cruise_v2), end_v = sqrt(end_v2);
+        float duration = cruise_d / cruise_v;
+        if (accel_d > 0.0f)
+            duration += accel_d / ((start_v + cruise_v) * 0.5f);
+        if (decel_d > 0.0f)
+            duration += decel_d / ((end_v + cruise_v) * 0.5f);
+        durations[index] = duration;
+    };
+
+    typedef struct _DELAYED {
+        size_t index;
+        float start_v2, end_v2;
+    } DELAYED;
+    vector<DELAYED> delayed;
+    float next_end_v2 = 0.0, next_smoothed_v2 = 0.0, peak_cruise_v2 = 0.0;
+    for (size_t i = planned.size(); i-- > 0; ) {
+        const KLIPPER_MOVE &move = planned[i];
+        float reachable_start_v2 = next_end_v2 + move.delta_v2;
+        float start_v2 = min(move.max_start_v2, reachable_start_v2);
+        float reachable_smoothed_v2 = next_smoothed_v2 + move.smooth_delta_v2;
+        float smoothed_v2 = min(move.max_smoothed_v2, reachable_smoothed_v2);
+        if (smoothed_v2 < reachable_smoothed_v2) {
+            // The move can accelerate
+            if (smoothed_v2 + move.smooth_delta_v2 > next_smoothed_v2 || !delayed.empty()) {
+                peak_cruise_v2 = min(move.max_cruise_v2, (smoothed_v2 + reachable_smoothed_v2) * 0.5f);
+                float cruise_v2 = peak_cruise_v2;
+                for (vector<DELAYED>::reverse_iterator it = delayed.rbegin(); it != delayed.rend(); ++it) {
+                    cruise_v2 = min(cruise_v2, it->start_v2);
+                    set_junction(it->index, min(it->start_v2, cruise_v2), cruise_v2, min(it->end_v2, cruise_v2));
+                }
+                delayed.clear();
+            }
+            float cruise_v2 = min(min((start_v2 + reachable_start_v2) * 0.5f, move.max_cruise_v2), peak_cruise_v2);
+            set_junction(i, min(start_v2, cruise_v2), cruise_v2, min(next_end_v2, cruise_v2));
+        } else {
+            delayed.push_back({ i, start_v2, next_end_v2 });
+        }
+        next_end_v2 = start_v2;
+        next_smoothed_v2 = smoothed_v2;
+    }
+    for (vector<DELAYED>::reverse_iterator it = delayed.rbegin(); it != delayed.rend(); ++it)
+        set_junction(it->index, it->start_v2, it->start_v2, it->end_v2);
+
+    double total = 0.0;
+    for (vector<float>::const_iterator it = durations.begin(); it != durations.end(); ++it)
+        total += *it;
+    return total;
+}
+
+double ReferenceSimulator::simulate(const MoveTable &table, vector<float> &durations, uint64_t &dropped_moves) {
+    steps = 0;
+    interrupts = 0;
+    dropped_moves = 0;
+    durations.assign(table.size(), 0.0);
+    if (config.motion_model == MOTION_SQUARE_CORNER_VELOCITY)
+        return simulate_klipper(table, durations);
+    return simulate_marlin(table, durations, dropped_moves);
+}
+
+bool ReferenceSimulator::validate(const string &filename, const Config &config, REFERENCE_REPORT &report) {
+    report = REFERENCE_REPORT();
+    report.filename = filename;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    MoveTable table (filename);
+    if (!table.load())
+        return false;
+    chrono::steady_clock::time_point loaded = chrono::steady_clock::now();
+
+    vector<float> estimates;
+    table.estimate_moves(config, estimates);
+    chrono::steady_clock::time_point estimated = chrono::steady_clock::now();
+
+    ReferenceSimulator simulator (config);
+    vector<float> references;
+    report.reference_time = simulator.simulate(table, references, report.dropped_moves);
+    chrono::steady_clock::time_point simulated = chrono::steady_clock::now();
+
+    report.moves = table.size();
+    report.steps = simulator.get_step_count();
+    report.interrupts = simulator.get_interrupt_count();
+    report.load_seconds = chrono::duration<float>(loaded - start).count();
+    report.estimate_seconds = chrono::duration<float>(estimated - loaded).count();
+    report.simulate_seconds = chrono::duration<float>(simulated - estimated).count();
+
+    vector<float> deviations (table.size());
+    for (size_t i = 0; i < table.size(); i++) {
+        report.estimated_time += estimates[i];
+        deviations[i] = abs(estimates[i] - references[i]);
+        report.total_deviation += deviations[i];
+    }
+    if (table.size() == 0)
+        return true;
+    report.mean_deviation = report.total_deviation / table.size();
+
+    vector<size_t> order (table.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    size_t worst_count = min((size_t)WORST_MOVE_COUNT, order.size());
+    partial_sort(order.begin(), order.begin() + worst_count, order.end(), [&](size_t a, size_t b) { return deviations[a] > deviations[b]; });
+    for (size_t i = 0; i < worst_count; i++)
+        report.worst_moves.push_back({ table.get_line(order[i]), estimates[order[i]], references[order[i]] });
+
+    vector<float>::iterator p95 = deviations.begin() + (size_t)(0.95 * (deviations.size() - 1));
+    nth_element(deviations.begin(), p95, deviations.end());
+    report.p95_deviation = *p95;
+    return true;
+}
+
+void ReferenceSimulator::print_report(const REFERENCE_REPORT &report, ostream *stream) {
+    *stream << report.filename << ": estimate ";
+    Utils::format_time(stream, round(report.estimated_time));
+    *stream << ", reference ";
+    Utils::format_time(stream, round(report.reference_time));
+    *stream << setfill(' ') << fixed << setprecision(2);
+    if (report.reference_time > 0.0)
+        *stream << " (" << showpos << 100.0 * (report.estimated_time - report.reference_time) / report.reference_time << noshowpos << "%)";
+    *stream << endl;
+
+    *stream << "  " << report.moves << " moves, " << report.dropped_moves << " dropped by the firmware. Deviation per move: mean "
+        << 1000.0 * report.mean_deviation << " ms, 95th percentile " << 1000.0 * report.p95_deviation << " ms, sum "
+        << (report.reference_time > 0.0 ? 100.0 * report.total_deviation / report.reference_time : 0.0) << "% of the reference" << endl;
+
+    if (!report.worst_moves.empty()) {
+        *stream << "  Largest deviations:";
+        for (vector<MOVE_DEVIATION>::const_iterator it = report.worst_moves.begin(); it != report.worst_moves.end(); ++it)
+            *stream << (it == report.worst_moves.begin() ? " " : ", ") << "line " << it->line << " (" << setprecision(3) << it->estimate << "s vs " << it->reference << "s)";
+        *stream << endl;
+    }
+
+    *stream << setprecision(2) << "  Parsed in " << report.load_seconds << "s, estimated in " << report.estimate_seconds << "s, simulated "
+        << report.steps << " steps";
+    // Klipper schedules every step on the host, there is no stepper interrupt to count
+    if (report.interrupts > 0)
+        *stream << " in " << report.interrupts << " interrupts";
+    *stream << " in " << report.simulate_seconds << "s" << endl;
+    stream->unsetf(ios::floatfield);
+    *stream << setprecision(6);
+}
@@ -0,0 +1,277 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ResultCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <thread>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_STAT_INDEX
+#endif
+
+#include "Hasher.h"
+#include "cfgpath.h"
+#include "versioninfo.h"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+static const char CACHE_MAGIC[8] = { 'G', 'C', 'T', 'C', 'A', 'C', 'H', 'E' };
+static const uint32_t CACHE_FORMAT = 3;
+static const size_t HASH_BLOCK_SIZE = 1024 * 1024;
+static const double EVICTION_TARGET = 0.9;     // Evict down to this fraction of the maximum size
+
+static string to_hex(uint64_t value) {
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", (unsigned long long)value);
+    return string(text);
+}
+
+ResultCache::ResultCache(const string &folder, uint64_t max_size, const Config &config)
+    : folder(folder), max_size(max_size), current_size(0), size_known(false) {
+    Hasher hasher;
+    hasher.update_string(Project_VERSION_STRING);
+    hasher.update_value(CACHE_FORMAT);
+    hasher.update_value(config.get_hash());
+    settings_hash = hasher.digest();
+
+    boost::system::error_code error;
+    fs::create_directories(this->folder / "results", error);
+    fs::create_directories(this->folder / "stat", error);
+}
+
+string ResultCache::get_default_folder() {
+    char folder[MAX_PATH];
+    get_user_cache_folder(folder, sizeof(folder), Project_NAME);
+    return string(folder);
+}
+
+bool ResultCache::get_content_key(const string &filename, string &key) {
+#ifdef HAVE_STAT_INDEX
+    // Unchanged files are recognized by their stat data without reading them
+    struct stat file_stat;
+    if (stat(filename.c_str(), &file_stat) != 0)
+        return false;
+    Hasher stat_hasher;
+    stat_hasher.update_value(file_stat.st_dev);
+    stat_hasher.update_value(file_stat.st_ino);
+    stat_hasher.update_value(file_stat.st_size);
+#ifdef __APPLE__
+    stat_hasher.update_value(file_stat.st_mtimespec);
+#else
+    stat_hasher.update_value(file_stat.st_mtim);
+#endif
+    fs::path stat_path = folder / "stat" / to_hex(stat_hasher.digest());
+
+    vector<char> stat_entry;
+    if (read_entry(stat_path, stat_entry)) {
+        key = string(stat_entry.begin(), stat_entry.end());
+    } else
+#endif
+    {
+        ifstream input (filename, ios::binary);
+        if (!input.is_open())
+            return false;
+
+        Hasher hasher;
+        vector<char> buffer (HASH_BLOCK_SIZE);
+        uint64_t size = 0;
+        while (input) {
+            input.read(buffer.data(), buffer.size());
+            hasher.update(buffer.data(), input.gcount());
+            size += input.gcount();
+        }
+        if (input.bad())
+            return false;
+
+        key = to_hex(hasher.digest()) + "-" + to_hex(size);
+#ifdef HAVE_STAT_INDEX
+        write_entry(stat_path, vector<char>(key.begin(), key.end()));
+#endif
+    }
+
+    return true;
+}
+
+fs::path ResultCache::get_entry_path(const string &key, const char *extension) {
+    return folder / "results" / (key + "-" + to_hex(settings_hash) + extension);
+}
+
+bool ResultCache::read_entry(const fs::path &path, vector<char> &data) {
+    ifstream input (path.string(), ios::binary);
+    if (!input.is_open())
+        return false;
+
+    char magic[sizeof(CACHE_MAGIC)];
+    uint32_t format;
+    uint64_t length;
+    input.read(magic, sizeof(magic));
+    input.read((char *)&format, sizeof(format));
+    input.read((char *)&length, sizeof(length));
+    if (!input || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 || format != CACHE_FORMAT)
+        return false;
+
+    data.resize(length);
+    input.read(data.data(), length);
+    if (input.gcount() != (streamsize)length)
+        return false;
+
+    // The modification time is the last use, for the LRU eviction
+    boost::system::error_code error;
+    fs::last_write_time(path, time(NULL), error);
+    return true;
+}
+
+void ResultCache::write_entry(const fs::path &path, const vector<char> &data) {
+    // Written to a unique temporary file first, concurrent writers and readers never see partial entries.
+    // Thread ids are only unique within a process, the cache may also be shared by several processes
+    fs::path temp = path;
+    temp += "." + to_hex(hash<thread::id>()(this_thread::get_id()));
+#ifdef HAVE_STAT_INDEX
+    temp += "." + to_hex(getpid());
+#endif
+    temp += ".tmp";
+    {
+        ofstream output (temp.string(), ios::binary);
+        uint64_t length = data.size();
+        output.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        output.write((const char *)&CACHE_FORMAT, sizeof(CACHE_FORMAT));
+        output.write((const char *)&length, sizeof(length));
+        output.write(data.data(), data.size());
+        if (!output)
+            return;
+    }
+
+    boost::system::error_code error;
+    fs::rename(temp, path, error);
+    if (error) {
+        fs::remove(temp, error);
+        return;
+    }
+
+    lock_guard<std::mutex> lock (mutex);
+    if (!size_known) {
+        current_size = 0;
+        for (fs::recursive_directory_iterator it (folder, error), end; !error && it != end; it.increment(error)) {
+            if (fs::is_regular_file(it->status()))
+                current_size += fs::file_size(it->path(), error);
+        }
+        size_known = true;
+    } else {
+        current_size += sizeof(CACHE_MAGIC) + sizeof(CACHE_FORMAT) + sizeof(uint64_t) + data.size();
+    }
+
+    if (current_size > max_size)
+        evict();
+}
+
+void ResultCache::evict() {
+    vector<pair<time_t, fs::path>> entries;
+    boost::system::error_code error;
+    for (fs::recursive_directory_iterator it (folder, error), end; !error && it != end; it.increment(error)) {
+        if (fs::is_regular_file(it->status()))
+            entries.push_back(make_pair(fs::last_write_time(it->path(), error), it->path()));
+    }
+    sort(entries.begin(), entries.end());
+
+    current_size = 0;
+    for (vector<pair<time_t, fs::path>>::iterator it = entries.begin(); it != entries.end(); ++it)
+        current_size += fs::file_size(it->second, error);
+
+    for (vector<pair<time_t, fs::path>>::iterator it = entries.begin(); it != entries.end() && current_size > max_size * EVICTION_TARGET; ++it) {
+        uintmax_t size = fs::file_size(it->second, error);
+        if (fs::remove(it->second, error))
+            current_size -= size;
+    }
+}
+
+static string get_time_extension(uint64_t estimator_settings) {
+    return "-" + to_hex(estimator_settings) + ".time";
+}
+
+bool ResultCache::get_time(const string &filename, uint64_t estimator_settings, float &time) {
+    string key;
+    vector<char> data;
+    if (!get_content_key(filename, key) || !read_entry(get_entry_path(key, get_time_extension(estimator_settings).c_str()), data)
+            || data.size() != sizeof(float))
+        return false;
+    memcpy(&time, data.data(), sizeof(float));
+    return true;
+}
+
+void ResultCache::put_time(const string &filename, uint64_t estimator_settings, float time) {
+    string key;
+    if (get_content_key(filename, key))
+        write_entry(get_entry_path(key, get_time_extension(estimator_settings).c_str()), vector<char>((const char *)&time, (const char *)&time + sizeof(time)));
+}
+
+static string get_edits_extension(uint64_t estimator_settings, const EmissionPolicy &policy, float total_time) {
+    Hasher hasher;
+    hasher.update_value(estimator_settings);
+    hasher.update_value(policy.min_interval);
+    hasher.update_value(policy.min_lines);
+    hasher.update_value(policy.adaptive);
+    hasher.update_value(policy.layers_only);
+    hasher.update_value(policy.format);
+    hasher.update_value(total_time);
+    return "-" + to_hex(hasher.digest()) + ".edits";
+}
+
+bool ResultCache::get_edits(const string &filename, uint64_t estimator_settings, const EmissionPolicy &policy, float total_time, vector<EDIT> &edits, string &text,
+                            uint64_t &emitted_messages) {
+    string key;
+    vector<char> data;
+    if (!get_content_key(filename, key) || !read_entry(get_entry_path(key, get_edits_extension(estimator_settings, policy, total_time).c_str()), data))
+        return false;
+
+    uint64_t header[3];     // Emitted messages, number of edits, text length
+    if (data.size() < sizeof(header))
+        return false;
+    memcpy(header, data.data(), sizeof(header));
+    if (data.size() != sizeof(header) + header[1] * sizeof(EDIT) + header[2])
+        return false;
+
+    emitted_messages = header[0];
+    edits.resize(header[1]);
+    memcpy(edits.data(), data.data() + sizeof(header), header[1] * sizeof(EDIT));
+    text.assign(data.data() + sizeof(header) + header[1] * sizeof(EDIT), header[2]);
+    return true;
+}
+
+void ResultCache::put_edits(const string &filename, uint64_t estimator_settings, const EmissionPolicy &policy, float total_time, const vector<EDIT> &edits, const string &text,
+                            uint64_t emitted_messages) {
+    string key;
+    if (!get_content_key(filename, key))
+        return;
+
+    uint64_t header[3] = { emitted_messages, edits.size(), text.size() };
+    vector<char> data ((const char *)header, (const char *)header + sizeof(header));
+    data.insert(data.end(), (const char *)edits.data(), (const char *)(edits.data() + edits.size()));
+    data.insert(data.end(), text.begin(), text.end());
+    write_entry(get_entry_path(key, get_edits_extension(estimator_settings, policy, total_time).c_str()), data);
+}
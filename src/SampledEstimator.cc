@@ -0,0 +1,156 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "SampledEstimator.h"
+
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+static const uint8_t AXIS_PARAMS = PARAM_X | PARAM_Y | PARAM_Z | PARAM_E;
+static const uint8_t ALL_PARAMS = AXIS_PARAMS | PARAM_F;
+
+// Two sided 95% quantile of the normal distribution
+static const float CONFIDENCE_FACTOR = 1.96f;
+
+SampledEstimator::SampledEstimator(istream *input, uint64_t input_size, const Config &config)
+    : GCodeProcessorBase(input, config), input_size(input_size), known_params(ALL_PARAMS), sample_start(0), sample_time(0.0), sample_bytes(0) {}
+
+void SampledEstimator::process_line(const GCODE_LINE &line, const GCODE_COMMAND &command, float line_duration) {
+    bool counted = line.offset >= sample_start;
+    if (command.letter == 'G' && command.number == 1) {
+        // A move from an unknown position or at an unknown feed rate is left out, together with its bytes
+        uint8_t unknown = command.params & AXIS_PARAMS & ~known_params;
+        bool rate_known = (known_params | command.params) & PARAM_F;
+        known_params |= command.params & ALL_PARAMS;
+        if (unknown || !rate_known || !counted)
+            return;
+        sample_time += line_duration;
+    } else if (command.letter == 'G' && (command.number == 28 || command.number == 92)) {
+        // Set the position of the given axes, or of all of them without parameters
+        uint8_t axes = command.params & AXIS_PARAMS;
+        if (!axes)
+            axes = command.number == 28 ? (PARAM_X | PARAM_Y | PARAM_Z) : AXIS_PARAMS;
+        known_params |= axes;
+    }
+    if (counted)
+        sample_bytes += line.text.size() + 1;
+}
+
+template <class K> bool SampledEstimator::process_sample(uint64_t start, K &kinematics, uint64_t &read_bytes) {
+    // Start one byte early, so that a sample or lead-in starting right at a line start keeps that line
+    uint64_t lead_in_start = start > LEAD_IN_SIZE ? start - LEAD_IN_SIZE : 0;
+    uint64_t read_start = lead_in_start > 0 ? lead_in_start - 1 : 0;
+    input->clear();
+    input->seekg(read_start);
+    input->read(buffer.data(), start - read_start + SAMPLE_SIZE);
+    size_t length = input->gcount();
+    bool at_eof = read_start + length >= input_size;
+    read_bytes = length;
+
+    const char *data = buffer.data();
+    if (lead_in_start > 0) {
+        const char *newline = (const char *)memchr(data, '\n', length);
+        if (!newline)
+            return false;
+        length -= newline + 1 - data;
+        data = newline + 1;
+    }
+
+    reset();
+    offset = read_start + (data - buffer.data());
+    known_params = lead_in_start > 0 ? 0 : ALL_PARAMS;
+    sample_start = start;
+    sample_time = 0.0;
+    sample_bytes = 0;
+    process_buffer(data, length, at_eof, kinematics);
+    return sample_bytes > 0;
+}
+
+void SampledEstimator::estimate_exact(SAMPLED_ESTIMATE &result) {
+    input->clear();
+    input->seekg(0);
+    known_params = ALL_PARAMS;
+    sample_start = 0;
+    sample_time = 0.0;
+    sample_bytes = 0;
+    process_file();
+
+    result.time = sample_time;
+    result.margin = 0.0;
+    result.sampled_bytes = input_size;
+    result.exact = true;
+}
+
+void SampledEstimator::estimate(size_t sample_count, SAMPLED_ESTIMATE &result) {
+    // Once the samples would cover half of the file, a sequential pass is about as fast
+    if (sample_count == 0 || 2 * sample_count * (LEAD_IN_SIZE + SAMPLE_SIZE) >= input_size) {
+        estimate_exact(result);
+        return;
+    }
+
+    vector<double> rates;
+    uint64_t sampled_bytes = 0;
+    with_kinematics(config, [&](auto &kinematics) {
+        for (size_t i = 0; i < sample_count; i++) {
+            uint64_t stratum_start = input_size * i / sample_count;
+            uint64_t stratum_end = input_size * (i + 1) / sample_count;
+            uint64_t last_start = stratum_end > stratum_start + SAMPLE_SIZE ? stratum_end - SAMPLE_SIZE : stratum_start;
+            uint64_t start = uniform_int_distribution<uint64_t>(stratum_start, last_start)(random);
+
+            // The lead-in starts from a standstill
+            typename remove_reference<decltype(kinematics)>::type sample_kinematics (kinematics);
+            uint64_t read_bytes;
+            if (process_sample(start, sample_kinematics, read_bytes))
+                rates.push_back(sample_time / sample_bytes);
+            sampled_bytes += read_bytes;
+        }
+    });
+
+    // Fall back to an exact estimate if the samples hold no lines at all, e.g. for a file with
+    // very long lines
+    if (rates.size() < 2) {
+        estimate_exact(result);
+        return;
+    }
+
+    // The strata have the same size, so the time per byte of the file is the mean of the samples
+    double sum = 0.0;
+    for (vector<double>::const_iterator it = rates.begin(); it != rates.end(); ++it)
+        sum += *it;
+    double mean = sum / rates.size();
+
+    // With one sample per stratum, the variance within the strata is estimated from the differences
+    // between neighbouring ones, so that the differences between distant parts of the file, which
+    // the strata already balance, do not widen the interval
+    double squares = 0.0;
+    for (size_t i = 1; i < rates.size(); i++)
+        squares += (rates[i] - rates[i - 1]) * (rates[i] - rates[i - 1]);
+    double variance = squares / (2 * (rates.size() - 1));
+
+    result.time = mean * input_size;
+    result.margin = CONFIDENCE_FACTOR * sqrt(variance / rates.size()) * input_size;
+    result.sampled_bytes = sampled_bytes;
+    result.exact = false;
+}
@@ -0,0 +1,453 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ShardCoordinator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+
+#ifdef __linux__
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "Utils.h"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+// Shards are written to the worker's stdin at once, and never more than two at a time, which stays
+// below the capacity of a pipe so that writing never blocks the coordinator
+static const size_t MAX_SHARD_BYTES = 16 * 1024;
+
+ShardCoordinator::ShardCoordinator(const vector<string> &inputs, size_t process_count, const vector<string> &worker_args,
+                                   const string &command_template, float timeout, bool info_only)
+    : inputs(inputs), process_count(process_count), worker_args(worker_args), command_template(command_template), timeout(timeout),
+      info_only(info_only), shard_size(1), next_output(0), failed(0), startup_failures(0) {}
+
+string ShardCoordinator::get_temp_filename(const string &output_filename) {
+    fs::path output (output_filename);
+    return (output.parent_path() / ("." + output.filename().string() + ".tmp")).string();
+}
+
+void ShardCoordinator::run_worker(FileProcessor &processor, bool info_only, bool export_moves, bool curves, bool verify, istream *input, ostream *output) {
+    string filename;
+    // Names are NUL-terminated, as that is the only character a path cannot contain
+    while (getline(*input, filename, '\0')) {
+        float estimated_time = 0.0;
+        uint64_t emitted_messages = 0;
+        string export_name = export_moves ? FileProcessor::get_export_filename(filename) : string();
+        string curves_name = curves && info_only ? FileProcessor::get_curves_filename(filename) : string();
+        bool success = processor.estimate(filename, estimated_time, export_name, curves_name);
+        if (!success) {
+            cerr << "Cannot read " << filename << endl;
+        } else if (!info_only) {
+            // Renamed once complete, a worker that is killed never leaves a partial output behind
+            string output_name = FileProcessor::get_output_filename(filename);
+            string temp = get_temp_filename(output_name);
+            success = processor.decorate(filename, temp, estimated_time, emitted_messages)
+                && (!verify || processor.verify(filename, temp))
+                && rename(temp.c_str(), output_name.c_str()) == 0;
+            // The curves describe the output, whose offsets differ from the ones of the input
+            float output_time;
+            if (success && curves)
+                success = processor.estimate(output_name, output_time, string(), FileProcessor::get_curves_filename(output_name));
+            if (!success) {
+                boost::system::error_code error;
+                fs::remove(temp, error);
+                cerr << "Cannot decorate " << filename << endl;
+            }
+        }
+
+        boost::system::error_code error;
+        uintmax_t bytes = fs::file_size(filename, error);
+        *output << (success ? "ok " : "error ") << fixed << setprecision(3) << estimated_time << ' '
+            << emitted_messages << ' ' << (error ? 0 : bytes) << endl;
+    }
+}
+
+void ShardCoordinator::fail(size_t file) {
+    results[file].done = true;
+    results[file].success = false;
+    failed++;
+}
+
+void ShardCoordinator::print_results() {
+    for (; next_output < results.size() && results[next_output].done; next_output++) {
+        const FILE_RESULT &result = results[next_output];
+        if (info_only && result.success) {
+            cout << inputs[next_output] << " total time: ";
+            Utils::format_time(&cout, round(result.estimated_time));
+            cout << endl;
+        }
+    }
+}
+
+void ShardCoordinator::print_report(double seconds) {
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < workers.size(); i++) {
+        const WORKER &worker = workers[i];
+        bytes += worker.bytes;
+        cerr << "Worker " << i << ": " << worker.files << " files, " << worker.bytes / 1e6 << " MB in " << worker.busy_seconds << "s ("
+            << (worker.busy_seconds > 0 ? worker.bytes / worker.busy_seconds / 1e6 : 0.0) << " MB/s)";
+        if (worker.restarts > 0)
+            cerr << ", restarted " << worker.restarts << " times";
+        cerr << endl;
+    }
+    cerr << "Total: " << inputs.size() - failed << " of " << inputs.size() << " files, " << bytes / 1e6 << " MB in " << seconds
+        << "s with " << workers.size() << " processes (" << (seconds > 0 ? bytes / seconds / 1e6 : 0.0) << " MB/s)" << endl;
+}
+
+void ShardCoordinator::complete_file(size_t index, const string &result) {
+    WORKER &worker = workers[index];
+    if (worker.assigned.empty())
+        return;
+    size_t file = worker.assigned.front();
+    worker.assigned.pop_front();
+
+    istringstream fields (result);
+    string status;
+    uint64_t emitted_messages;
+    fields >> status >> results[file].estimated_time >> emitted_messages >> results[file].bytes;
+    results[file].done = true;
+    results[file].success = fields && status == "ok";
+    if (!results[file].success)
+        failed++;
+
+    worker.produced = true;
+    worker.files++;
+    worker.bytes += results[file].bytes;
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    if (worker.assigned.empty())
+        worker.busy_seconds += chrono::duration<double>(now - worker.busy_start).count();
+    else
+        worker.file_start = now;
+}
+
+#ifdef __linux__
+
+// Quotes an argument for /bin/sh
+static string quote(const string &arg) {
+    string quoted = "'";
+    for (size_t i = 0; i < arg.size(); i++)
+        quoted += arg[i] == '\'' ? string("'\\''") : string(1, arg[i]);
+    return quoted + "'";
+}
+
+bool ShardCoordinator::start_worker(size_t index) {
+    WORKER &worker = workers[index];
+
+    // Everything is prepared before forking
+    vector<string> args;
+    if (command_template.empty()) {
+        char path[PATH_MAX];
+        ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+        if (length <= 0)
+            return false;
+        args.push_back(string(path, length));
+        args.push_back("--worker");
+        args.insert(args.end(), worker_args.begin(), worker_args.end());
+    } else {
+        // {} stands for the number of the worker, e.g. to pick a container
+        string command = command_template;
+        string number = to_string(index);
+        for (size_t pos = command.find("{}"); pos != string::npos; pos = command.find("{}", pos + number.size()))
+            command.replace(pos, 2, number);
+        command += " --worker";
+        for (vector<string>::const_iterator it = worker_args.begin(); it != worker_args.end(); ++it)
+            command += " " + quote(*it);
+        args.push_back("/bin/sh");
+        args.push_back("-c");
+        args.push_back(command);
+    }
+    vector<char *> argv;
+    for (vector<string>::iterator it = args.begin(); it != args.end(); ++it)
+        argv.push_back(&(*it)[0]);
+    argv.push_back(NULL);
+
+    int to_worker[2], from_worker[2];
+    if (pipe2(to_worker, O_CLOEXEC) != 0)
+        return false;
+    if (pipe2(from_worker, O_CLOEXEC) != 0) {
+        close(to_worker[0]);
+        close(to_worker[1]);
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // dup2 clears the close-on-exec flag of the new descriptors
+        dup2(to_worker[0], STDIN_FILENO);
+        dup2(from_worker[1], STDOUT_FILENO);
+        signal(SIGPIPE, SIG_DFL);
+        // Its own process group, so a timeout also kills what the --worker-command shell started
+        setpgid(0, 0);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    close(to_worker[0]);
+    close(from_worker[1]);
+    if (pid > 0)
+        setpgid(pid, pid);
+    if (pid < 0) {
+        close(to_worker[1]);
+        close(from_worker[0]);
+        return false;
+    }
+
+    worker.pid = pid;
+    worker.input_fd = to_worker[1];
+    worker.output_fd = from_worker[0];
+    worker.assigned.clear();
+    worker.received.clear();
+    worker.produced = false;
+    return true;
+}
+
+void ShardCoordinator::assign_shard(size_t index) {
+    WORKER &worker = workers[index];
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    if (worker.assigned.empty())
+        worker.busy_start = worker.file_start = now;
+
+    string names;
+    for (size_t i = 0; i < shard_size && !pending.empty(); i++) {
+        size_t file = pending.front();
+        if (i > 0 && names.size() + inputs[file].size() + 1 > MAX_SHARD_BYTES)
+            break;
+        pending.pop_front();
+        worker.assigned.push_back(file);
+        names += inputs[file] + '\0';
+    }
+
+    // A worker that exited fails the write, its files are requeued once its output ends
+    for (size_t written = 0; written < names.size(); ) {
+        ssize_t result = write(worker.input_fd, names.data() + written, names.size() - written);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            break;
+        written += result;
+    }
+}
+
+void ShardCoordinator::read_results(size_t index) {
+    WORKER &worker = workers[index];
+    char buffer[4096];
+    ssize_t result = read(worker.output_fd, buffer, sizeof(buffer));
+    if (result < 0 && errno == EINTR)
+        return;
+    if (result <= 0) {
+        handle_exit(index, false);
+        return;
+    }
+
+    worker.received.append(buffer, result);
+    size_t start = 0;
+    for (size_t newline = worker.received.find('\n'); newline != string::npos; newline = worker.received.find('\n', start)) {
+        complete_file(index, worker.received.substr(start, newline - start));
+        start = newline + 1;
+    }
+    worker.received.erase(0, start);
+}
+
+void ShardCoordinator::handle_exit(size_t index, bool timed_out) {
+    WORKER &worker = workers[index];
+    bool requested = worker.input_fd < 0 && worker.assigned.empty();
+    if (timed_out)
+        kill(-worker.pid, SIGKILL);
+    if (worker.input_fd >= 0)
+        close(worker.input_fd);
+    close(worker.output_fd);
+    worker.input_fd = worker.output_fd = -1;
+    int status = 0;
+    waitpid(worker.pid, &status, 0);
+    worker.pid = -1;
+
+    if (!worker.assigned.empty()) {
+        worker.busy_seconds += chrono::duration<double>(chrono::steady_clock::now() - worker.busy_start).count();
+
+        // The file being processed is the likely cause
+        size_t file = worker.assigned.front();
+        worker.assigned.pop_front();
+        results[file].attempts++;
+        if (!info_only) {
+            boost::system::error_code error;
+            fs::remove(get_temp_filename(FileProcessor::get_output_filename(inputs[file])), error);
+        }
+
+        cerr << inputs[file] << ": worker " << index;
+        if (timed_out)
+            cerr << " exceeded the time budget of " << timeout << "s";
+        else if (WIFSIGNALED(status))
+            cerr << " was killed by signal " << WTERMSIG(status);
+        else
+            cerr << " exited with status " << WEXITSTATUS(status);
+        if (timed_out || results[file].attempts >= MAX_ATTEMPTS) {
+            cerr << endl;
+            fail(file);
+        } else {
+            // Retried last, so that it cannot hold up the other files again
+            cerr << ", retrying" << endl;
+            pending.push_back(file);
+        }
+
+        // The rest of the shard goes first
+        while (!worker.assigned.empty()) {
+            pending.push_front(worker.assigned.back());
+            worker.assigned.pop_back();
+        }
+    }
+
+    if (!requested && !worker.produced)
+        startup_failures++;
+    if (pending.empty())
+        return;
+    if (startup_failures >= MAX_STARTUP_FAILURES * process_count) {
+        cerr << "Workers keep exiting without results, not restarting worker " << index << endl;
+        return;
+    }
+    worker.restarts++;
+    if (!start_worker(index))
+        cerr << "Cannot restart worker " << index << endl;
+}
+
+bool ShardCoordinator::run() {
+    if (inputs.empty())
+        return true;
+
+    // Writes to a worker that exited fail instead of terminating the coordinator
+    signal(SIGPIPE, SIG_IGN);
+
+    FILE_RESULT empty_result = { false, false, 0, 0.0, 0 };
+    results.assign(inputs.size(), empty_result);
+    for (size_t i = 0; i < inputs.size(); i++)
+        pending.push_back(i);
+
+    // About 8 shards per worker, so that the workers finish at about the same time
+    size_t count = min(process_count, inputs.size());
+    shard_size = min(MAX_SHARD_SIZE, max((size_t)1, inputs.size() / (count * 8)));
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    workers.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        WORKER &worker = workers[i];
+        worker.pid = worker.input_fd = worker.output_fd = -1;
+        worker.produced = false;
+        worker.files = worker.bytes = worker.restarts = 0;
+        worker.busy_seconds = 0.0;
+        if (!start_worker(i))
+            cerr << "Cannot start worker " << i << endl;
+    }
+
+    while (next_output < inputs.size()) {
+        vector<pollfd> fds;
+        vector<size_t> polled;
+        for (size_t i = 0; i < workers.size(); i++) {
+            WORKER &worker = workers[i];
+            if (worker.pid < 0)
+                continue;
+            // The next shard is sent before the current one is done, so that workers never wait
+            if (worker.input_fd >= 0 && worker.assigned.size() <= 1 && !pending.empty()) {
+                assign_shard(i);
+            } else if (worker.input_fd >= 0 && worker.assigned.empty() && pending.empty()) {
+                // The worker exits once its input ends
+                close(worker.input_fd);
+                worker.input_fd = -1;
+            }
+            pollfd fd = { worker.output_fd, POLLIN, 0 };
+            fds.push_back(fd);
+            polled.push_back(i);
+        }
+
+        // Every file that is not done is pending once no worker is left
+        if (fds.empty()) {
+            cerr << "No workers left, " << pending.size() << " files were not processed" << endl;
+            for (; !pending.empty(); pending.pop_front())
+                fail(pending.front());
+            print_results();
+            break;
+        }
+
+        int ready = poll(fds.data(), fds.size(), timeout > 0 ? 100 : -1);
+        if (ready < 0 && errno != EINTR) {
+            cerr << "Cannot wait for the workers" << endl;
+            break;
+        }
+        for (size_t i = 0; ready > 0 && i < fds.size(); i++) {
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+                read_results(polled[i]);
+        }
+
+        if (timeout > 0) {
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            for (size_t i = 0; i < workers.size(); i++) {
+                if (workers[i].pid >= 0 && !workers[i].assigned.empty()
+                        && chrono::duration<float>(now - workers[i].file_start).count() > timeout)
+                    handle_exit(i, true);
+            }
+        }
+        print_results();
+    }
+
+    for (size_t i = 0; i < workers.size(); i++) {
+        if (workers[i].pid >= 0) {
+            if (workers[i].input_fd >= 0)
+                close(workers[i].input_fd);
+            close(workers[i].output_fd);
+            waitpid(workers[i].pid, NULL, 0);
+        }
+    }
+
+    print_report(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    return failed == 0 && next_output == inputs.size();
+}
+
+#else
+
+bool ShardCoordinator::start_worker(size_t index) {
+    return false;
+}
+
+void ShardCoordinator::assign_shard(size_t index) {}
+
+void ShardCoordinator::read_results(size_t index) {}
+
+void ShardCoordinator::handle_exit(size_t index, bool timed_out) {}
+
+bool ShardCoordinator::run() {
+    cerr << "Worker processes are only supported on Linux" << endl;
+    return false;
+}
+
+#endif
@@ -0,0 +1,73 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ZeroCopyDecorator.h"
+
+#include <algorithm>
+
+using namespace std;
+
+ZeroCopyDecorator::ZeroCopyDecorator(istream *input, uint64_t input_size, float total_time, const EmissionPolicy &policy, const Config &config)
+    : GCodeTimeDecorator(input, &messages, total_time, policy, config), input_size(input_size), text_end(0) {}
+
+const vector<EDIT> & ZeroCopyDecorator::get_edits() {
+    return edits;
+}
+
+const string & ZeroCopyDecorator::get_text() {
+    return text;
+}
+
+void ZeroCopyDecorator::add_edit(uint64_t offset, uint64_t removed) {
+    size_t end = messages.tellp();
+    if (end > text_end || removed > 0) {
+        edits.push_back({ offset, removed, text_end, end - text_end });
+        text_end = end;
+    }
+}
+
+void ZeroCopyDecorator::echo_line(const GCODE_LINE &line) {
+    // The messages after the previous line go in front of this one
+    add_edit(line.offset);
+
+    // The stream decorator terminates every line, including an unterminated last one
+    if (line.offset + line.text.size() == input_size)
+        messages << '\n';
+}
+
+void ZeroCopyDecorator::drop_line(const GCODE_LINE &line) {
+    // The line with its terminator, if it has one
+    add_edit(line.offset, min((uint64_t)line.text.size() + 1, input_size - line.offset));
+}
+
+void ZeroCopyDecorator::process_file() {
+    messages.str("");
+    text_end = 0;
+    edits.clear();
+
+    GCodeTimeDecorator::process_file();
+    add_edit(input_size);
+    text = messages.str();
+}
+
+bool ZeroCopyDecorator::write(const string &input_filename, const string &output_filename) {
+    return OutputAssembler::assemble(input_filename, output_filename, edits, text);
+}
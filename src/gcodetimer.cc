@@ -27,90 +27,108 @@
 #include <ostream>
 #include <fstream>
 #include <iomanip>
+#include <sstream>
 
 #include <string>
 #include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <memory>
+
+#include <boost/filesystem.hpp>
 
 #include "cfgpath.h"
 
 #include "Utils.h"
 #include "GCodeProcessorBase.h"
+#include "GCodeTimeEstimator.h"
+#include "SampledEstimator.h"
+#include "AsyncIO.h"
+#include "FileProcessor.h"
+#include "HotFolderWatcher.h"
+#include "ManifestRunner.h"
+#include "ShardCoordinator.h"
+#include "ResultCache.h"
 #include "CmdLineParams.h"
 #include "Config.h"
+#include "Calibrator.h"
+#include "ReferenceSimulator.h"
+#include "OverrideCurves.h"
+#include "ProfileSet.h"
 #include "versioninfo.h"
 
 using namespace std;
 
-class GCodeTimeEstimator : public GCodeProcessorBase {
+// Passes every move to a ProfileSet, by acting as its own kinematics class
+class MultiProfileEstimator : public GCodeProcessorBase {
 protected:
-    float estimated_time;
+    ProfileSet *profiles;
 
-    virtual void process_line(string line, float line_duration) {
-        estimated_time += line_duration;
-    }
+    virtual void process_line(const GCODE_LINE &line, const GCODE_COMMAND &command, float line_duration) {}
 
 public:
-    GCodeTimeEstimator(ifstream *input) : GCodeProcessorBase(input), estimated_time(0.0) {}
+    MultiProfileEstimator(istream *input, ProfileSet *profiles) : GCodeProcessorBase(input), profiles(profiles) {}
 
-    void process_file() {
-        estimated_time = 0;
-        GCodeProcessorBase::process_file();
+    inline float get_move_duration(const COORDS &movement, float rate) {
+        profiles->add_move(movement, rate);
+        return 0.0;
     }
 
-    float get_estimated_time() {
-        return estimated_time;
+    void process_file() {
+        profiles->reset();
+        process_input(*this);
     }
 };
 
-class GCodeTimeDecorator : public GCodeProcessorBase {
-protected:
-    float total_time, current_time, previous_printed_time;
-    ostream *output;
-
-    virtual void process_line(string line, float line_duration) {
-        // Echo the original line
-        *output << line << endl;
-
-        current_time += line_duration;
-        float new_print_time = round(total_time - current_time);
-        if (new_print_time != previous_printed_time) {
-            previous_printed_time = new_print_time;
-            *output << "M117 ETR ";
-            Utils::format_time(output, new_print_time);
-            *output << endl;
-        }
-    }
+// Estimates the file once exactly and once with the direction cache, and prints the difference, the
+// hit rate and the time per move of both. Neither run uses the memo, so that only the cache differs
+static bool print_direction_cache_stats(const string &filename, float tolerance) {
+    ifstream file (filename, ios::binary);
+    if (!file.is_open())
+        return false;
+    vector<char> contents ((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
 
-public:
-    GCodeTimeDecorator(ifstream *input, ostream *output, float total_time) : GCodeProcessorBase(input), total_time(total_time), output(output), current_time(0.0) {
-        previous_printed_time = round(total_time);
+    DirectionCache cache (tolerance);
+    float times[2];
+    double seconds[2];
+    for (size_t cached = 0; cached < 2; cached++) {
+        MemoryInputBuffer buffer (contents);
+        istream input (&buffer);
+        GCodeTimeEstimator estimator (&input);
+        if (cached)
+            estimator.set_direction_cache(&cache);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        estimator.process_file();
+        seconds[cached] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        times[cached] = estimator.get_estimated_time();
     }
 
-    void process_file() {
-        *output << "; ---" << endl;
-        *output << "; Decorated with timestamps by " << Project_NAME << " " << Project_VERSION_STRING << endl;
-
-        *output << "; Print acceleration settings (X,Y,Z,E) in mm/(s^2): ("
-            << Config::get()->max_print_accel.x << ", " << Config::get()->max_print_accel.y << ", " << Config::get()->max_print_accel.z << ", " << Config::get()->max_print_accel.e << "), "
-            << (int)round(Config::get()->accel_efficiency * 100) << "% avg efficiency" << endl;
-
-        *output << "; Move acceleration settings (X,Y,Z) in mm/(s^2): ("
-            << Config::get()->max_move_accel.x << ", " << Config::get()->max_move_accel.y << ", " << Config::get()->max_move_accel.z << "), "
-            << (int)round(Config::get()->accel_efficiency * 100) << "% avg efficiency" << endl;
-
-        *output << "; Max jerk settings (X,Y,Z,E) in mm/s: (" << Config::get()->max_jerk.x << ", " << Config::get()->max_jerk.y << ", " << Config::get()->max_jerk.z << ", " << Config::get()->max_jerk.e << "), "
-            << (int)round(Config::get()->jerk_efficiency * 100) << "% avg efficiency" << endl;
-
-        *output << "; ---" << endl << endl;
-
-        *output << "M117 TTL ";
-        Utils::format_time(output, total_time);
-        *output << endl;
-
-        GCodeProcessorBase::process_file();
+    uint64_t moves = cache.get_hits() + cache.get_misses();
+    if (moves == 0) {
+        cerr << filename << ": no moves use the direction cache" << endl;
+        return true;
     }
-};
+    cerr << filename << ": exact " << fixed << setprecision(1) << times[0] << "s in " << 1e9 * seconds[0] / moves << " ns/move, cached "
+        << times[1] << "s (" << showpos << setprecision(4) << (times[0] > 0.0f ? 100.0 * (times[1] - times[0]) / times[0] : 0.0) << noshowpos
+        << "%) in " << setprecision(1) << 1e9 * seconds[1] / moves << " ns/move, " << 100.0 * cache.get_hits() / moves << "% of "
+        << moves << " moves hit" << endl;
+    cerr.unsetf(ios::floatfield);
+    cerr << setprecision(6);
+    return true;
+}
 
+// Files read ahead and bytes buffered with --async-io
+static const size_t ASYNC_READ_AHEAD = 8;
+static const uint64_t ASYNC_MAX_BUFFERED = 512ULL * 1024 * 1024;
+
+static ResultCache * create_cache(CmdLineParams &params) {
+    if (!params.get_use_cache())
+        return NULL;
+    string folder = params.get_cache_folder().empty() ? ResultCache::get_default_folder() : params.get_cache_folder();
+    return new ResultCache(folder, params.get_cache_size(), *Config::get());
+}
 
 int main(int argc, char **argv) {
     CmdLineParams params;
@@ -123,50 +141,314 @@ int main(int argc, char **argv) {
     if (params.get_create_config()) {
         Config::get()->save();
         cout << "Config saved to " << Config::get()->get_path() << endl;
+    } else if (!params.get_calibration_manifest().empty()) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        Calibrator calibrator (*Config::get(), params.get_calibrate_axes());
+        if (!calibrator.load_manifest(params.get_calibration_manifest()))
+            return 1;
+        chrono::steady_clock::time_point loaded = chrono::steady_clock::now();
+
+        calibrator.fit();
+        chrono::steady_clock::time_point fitted = chrono::steady_clock::now();
+
+        calibrator.print_report(&cout);
+        cout << "Parsing took " << chrono::duration<float>(loaded - start).count() << "s, fitting took "
+            << chrono::duration<float>(fitted - loaded).count() << "s" << endl;
+
+        calibrator.get_config().save();
+        cout << "Config saved to " << calibrator.get_config().get_path() << endl;
+    } else if (!params.get_watch_folder().empty()) {
+        unique_ptr<ResultCache> cache (create_cache(params));
+        FileProcessor processor (params.get_emission_policy(), params.get_zero_copy(), cache.get(), params.get_memoize(), false, params.get_compact(),
+                                 params.get_direction_tolerance());
+        size_t workers = params.get_workers() > 0 ? params.get_workers() : max(thread::hardware_concurrency(), 1u);
+        HotFolderWatcher watcher (params.get_watch_folder(), processor, workers, 4 * workers);
+        if (!watcher.run())
+            return 1;
+    } else if (params.get_fast()) {
+        int result = 0;
+        for (vector<string>::const_iterator it = params.get_inputs().begin(); it != params.get_inputs().end(); ++it) {
+            ifstream input (*it, ios::binary);
+            boost::system::error_code error;
+            uint64_t input_size = boost::filesystem::file_size(*it, error);
+            if (!input.good() || error) {
+                cerr << "Cannot read " << *it << endl;
+                result = 1;
+                continue;
+            }
+
+            // Every round doubles the samples and takes about twice as long as the previous one
+            SampledEstimator estimator (&input, input_size);
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for (size_t samples = SampledEstimator::INITIAL_SAMPLE_COUNT; ; samples *= 2) {
+                chrono::steady_clock::time_point round_start = chrono::steady_clock::now();
+                SAMPLED_ESTIMATE estimate;
+                estimator.estimate(samples, estimate);
+
+                cout << *it << " total time: ";
+                if (estimate.exact) {
+                    Utils::format_time(&cout, round(estimate.time));
+                    cout << endl;
+                    break;
+                }
+                cout << "~";
+                Utils::format_time(&cout, round(estimate.time));
+                cout << " +/- ";
+                Utils::format_time(&cout, ceil(estimate.margin));
+                cout << " (95% confidence, " << fixed << setprecision(1) << 100.0 * estimate.sampled_bytes / input_size << "% sampled)" << endl;
+                cout.unsetf(ios::floatfield);
+
+                chrono::steady_clock::time_point now = chrono::steady_clock::now();
+                float elapsed = chrono::duration<float>(now - start).count();
+                float round_time = chrono::duration<float>(now - round_start).count();
+                if (elapsed + 2 * round_time > params.get_refine_budget())
+                    break;
+            }
+        }
+        return result;
+    } else if (params.get_reference()) {
+        // Every file is simulated on its own, so the files are spread over all cores
+        const vector<string> &inputs = params.get_inputs();
+        vector<REFERENCE_REPORT> reports (inputs.size());
+        vector<char> loaded (inputs.size());
+        Utils::parallel_for(inputs.size(), [&](size_t i) {
+            loaded[i] = ReferenceSimulator::validate(inputs[i], *Config::get(), reports[i]);
+        });
+
+        int result = 0;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            if (!loaded[i]) {
+                cerr << "Cannot read " << inputs[i] << endl;
+                result = 1;
+                continue;
+            }
+            ReferenceSimulator::print_report(reports[i], &cout);
+            double deviation = 100.0 * abs(reports[i].estimated_time - reports[i].reference_time) / reports[i].reference_time;
+            if (params.get_max_deviation() >= 0.0 && !(deviation <= params.get_max_deviation())) {
+                cerr << inputs[i] << ": the estimate deviates more than " << params.get_max_deviation() << "% from the reference" << endl;
+                result = 1;
+            }
+        }
+        return result;
+    } else if (!params.get_manifest().empty()) {
+        istream *manifest = &cin;
+        ifstream manifest_file;
+        if (params.get_manifest() != "-") {
+            manifest_file.open(params.get_manifest(), ios::binary);
+            if (!manifest_file.is_open()) {
+                cerr << "Cannot read " << params.get_manifest() << endl;
+                return 1;
+            }
+            manifest = &manifest_file;
+        }
+
+        unique_ptr<ResultCache> cache (create_cache(params));
+        FileProcessor processor (params.get_emission_policy(), params.get_zero_copy(), cache.get(), params.get_memoize(), params.get_parallel(), params.get_compact(),
+                                 params.get_direction_tolerance());
+
+        // Every profile gets a processor of its own. The cache is keyed by the default config, so they do not use it
+        vector<unique_ptr<FileProcessor>> profile_processors;
+        map<string, FileProcessor *> profiles;
+        for (vector<string>::const_iterator it = params.get_profiles().begin(); it != params.get_profiles().end(); ++it) {
+            if (!ifstream(*it).good()) {
+                cerr << "Cannot open profile " << *it << endl;
+                return 1;
+            }
+            profile_processors.emplace_back(new FileProcessor(params.get_emission_policy(), params.get_zero_copy(), NULL, params.get_memoize(),
+                                                              params.get_parallel(), params.get_compact(), params.get_direction_tolerance(), Config(*it)));
+            profiles[boost::filesystem::path(*it).stem().string()] = profile_processors.back().get();
+        }
+
+        size_t workers = params.get_workers() > 0 ? params.get_workers() : max(thread::hardware_concurrency(), 1u);
+        ManifestRunner runner (manifest, &cout, processor, profiles, params.get_info_only(), params.get_verify(), workers);
+        return runner.run() ? 0 : 1;
+    } else if (!params.get_query_curves().empty()) {
+        OverrideCurves curves;
+        if (!curves.load(params.get_query_curves())) {
+            cerr << "Cannot read " << params.get_query_curves() << endl;
+            return 1;
+        }
+
+        // One answer per line, so a host can keep the process open and ask again whenever the override changes
+        string line;
+        cout << fixed << setprecision(1);
+        while (getline(cin, line)) {
+            istringstream query (line);
+            uint64_t offset;
+            float percent;
+            if (query >> offset >> percent && percent > 0.0)
+                cout << curves.get_remaining_time(offset, percent / 100) << endl;
+            else
+                cout << "error" << endl;
+        }
+    } else if (!params.get_profiles().empty()) {
+        vector<Config> configs;
+        vector<string> names;
+        for (vector<string>::const_iterator it = params.get_profiles().begin(); it != params.get_profiles().end(); ++it) {
+            if (!ifstream(*it).good()) {
+                cerr << "Cannot open profile " << *it << endl;
+                return 1;
+            }
+            configs.push_back(Config(*it));
+            names.push_back(boost::filesystem::path(*it).stem().string());
+        }
+
+        // The vectorized ProfileSet implements the classic jerk model, other profiles get an estimator
+        // each. The estimators share no state, so all of them run on separate threads
+        vector<size_t> classic_profiles, other_profiles;
+        vector<Config> classic_configs;
+        vector<string> classic_names;
+        for (size_t i = 0; i < configs.size(); i++) {
+            if (configs[i].motion_model == MOTION_CLASSIC_JERK) {
+                classic_profiles.push_back(i);
+                classic_configs.push_back(configs[i]);
+                classic_names.push_back(names[i]);
+            } else {
+                other_profiles.push_back(i);
+            }
+        }
+        ProfileSet profiles (classic_configs, classic_names);
+
+        for (vector<string>::const_iterator it = params.get_inputs().begin(); it != params.get_inputs().end(); ++it) {
+            vector<double> totals (configs.size());
+            vector<thread> estimators;
+            if (!classic_profiles.empty()) {
+                estimators.emplace_back([&, it]() {
+                    ifstream input (*it);
+                    MultiProfileEstimator estimator (&input, &profiles);
+                    estimator.process_file();
+                    for (size_t i = 0; i < classic_profiles.size(); i++)
+                        totals[classic_profiles[i]] = profiles.get_total(i);
+                });
+            }
+            for (vector<size_t>::const_iterator profile = other_profiles.begin(); profile != other_profiles.end(); ++profile) {
+                size_t index = *profile;
+                estimators.emplace_back([&, it, index]() {
+                    ifstream input (*it);
+                    GCodeTimeEstimator estimator (&input, configs[index]);
+                    estimator.process_file();
+                    totals[index] = estimator.get_estimated_time();
+                });
+            }
+            for (vector<thread>::iterator estimator = estimators.begin(); estimator != estimators.end(); ++estimator)
+                estimator->join();
+
+            for (size_t i = 0; i < configs.size(); i++) {
+                cout << *it << " total time (" << names[i] << "): ";
+                Utils::format_time(&cout, round(totals[i]));
+                cout << endl;
+            }
+        }
+    } else if (params.get_worker()) {
+        unique_ptr<ResultCache> cache (create_cache(params));
+        FileProcessor processor (params.get_emission_policy(), params.get_zero_copy(), cache.get(), params.get_memoize(), params.get_parallel(), params.get_compact(),
+                                 params.get_direction_tolerance());
+        ShardCoordinator::run_worker(processor, params.get_info_only(), params.get_export_moves(), params.get_curves(), params.get_verify(), &cin, &cout);
+    } else if (params.get_processes() > 0) {
+        ShardCoordinator coordinator (params.get_inputs(), params.get_processes(), params.get_worker_args(), params.get_worker_command(),
+                                      params.get_timeout(), params.get_info_only());
+        return coordinator.run() ? 0 : 1;
     } else {
+        unique_ptr<ResultCache> cache (create_cache(params));
+        FileProcessor processor (params.get_emission_policy(), params.get_zero_copy(), cache.get(), params.get_memoize(), params.get_parallel(), params.get_compact(),
+                                 params.get_direction_tolerance());
+        unique_ptr<AsyncIO> io;
+        if (params.get_async_io() && !params.get_follow())
+            io.reset(new AsyncIO(params.get_inputs(), ASYNC_READ_AHEAD, ASYNC_MAX_BUFFERED));
+
+        int result = 0;
         for (vector<string>::const_iterator it = params.get_inputs().begin(); it != params.get_inputs().end(); ++it) {
-            ifstream input (*it);
+            AsyncIO::FILE_BUFFER buffer;
+            if (io)
+                io->next(buffer);
 
-            GCodeTimeEstimator estimator = GCodeTimeEstimator(&input);
-            estimator.process_file();
+            float estimated_time;
+            string export_name = params.get_export_moves() ? FileProcessor::get_export_filename(*it) : string();
+            // Offsets in the curves refer to the file that is printed, so decorated files get theirs below
+            string curves_name = params.get_curves() && params.get_info_only() ? FileProcessor::get_curves_filename(*it) : string();
+            bool estimated;
+            if (params.get_follow())
+                estimated = processor.follow(*it, params.get_sentinel(), params.get_idle_timeout(), estimated_time);
+            else if (io)
+                estimated = buffer.valid && processor.estimate(*it, buffer.data, estimated_time, export_name, curves_name);
+            else
+                estimated = processor.estimate(*it, estimated_time, export_name, curves_name);
+            if (!estimated) {
+                cerr << "Cannot read " << *it << endl;
+                result = 1;
+                continue;
+            }
 
             if (params.get_info_only()) {
                 cout << *it << " total time: ";
-                Utils::format_time(&cout, round(estimator.get_estimated_time()));
+                Utils::format_time(&cout, round(estimated_time));
                 cout << endl;
+                if (params.get_print_stats() && params.get_direction_tolerance() >= 0.0 && !print_direction_cache_stats(*it, params.get_direction_tolerance())) {
+                    cerr << "Cannot read " << *it << endl;
+                    result = 1;
+                }
             } else {
-                input.close();
-                input.open(*it);
+                string output_name;
+                if (!params.get_use_stdout())
+                    output_name = params.get_output().empty() ? FileProcessor::get_output_filename(*it) : params.get_output();
 
-                ofstream outputFile;
-                ostream *output;
-                if (params.get_use_stdout()) {
-                    output = &cout;
+                chrono::steady_clock::time_point start = chrono::steady_clock::now(), end = start;
+                uint64_t emitted_messages = 0;
+                uintmax_t output_size = 0;
+                float output_time;
+                bool decorated, verified = true, curves_written = true;
+                if (output_name.empty()) {
+                    if (io)
+                        decorated = processor.decorate(buffer.data, &cout, estimated_time, emitted_messages);
+                    else
+                        decorated = processor.decorate(*it, &cout, estimated_time, emitted_messages);
+                    end = chrono::steady_clock::now();
+                } else if (io) {
+                    vector<char> output;
+                    decorated = processor.decorate(buffer.data, output, estimated_time, emitted_messages);
+                    output_size = output.size();
+                    end = chrono::steady_clock::now();
+                    if (decorated && params.get_verify())
+                        verified = processor.verify(buffer.data, output);
+                    if (decorated && params.get_curves())
+                        curves_written = processor.estimate(output_name, output, output_time, string(), FileProcessor::get_curves_filename(output_name));
+                    if (decorated)
+                        io->write(output_name, move(output));
                 } else {
-                    string output_name;
-                    if (params.get_output().empty()) {
-                        int pos = (*it).rfind(".");
-                        if (pos == string::npos) {
-                            output_name = *it + ".timed";
-                        } else {
-                            output_name = (*it).substr(0, pos) + ".timed" + (*it).substr(pos, (*it).size() - pos);
-                        }
-                    } else {
-                        output_name = params.get_output();
-                    }
-                    outputFile.open(output_name);
-                    output = &outputFile;
+                    decorated = processor.decorate(*it, output_name, estimated_time, emitted_messages);
+                    end = chrono::steady_clock::now();
+                    if (decorated)
+                        output_size = boost::filesystem::file_size(output_name);
+                    if (decorated && params.get_verify())
+                        verified = processor.verify(*it, output_name);
+                    if (decorated && params.get_curves())
+                        curves_written = processor.estimate(output_name, output_time, string(), FileProcessor::get_curves_filename(output_name));
                 }
 
-                GCodeTimeDecorator decorator (&input, output, estimator.get_estimated_time());
-                decorator.process_file();
-
-                if (outputFile.is_open())
-                    outputFile.close();
+                if (!decorated) {
+                    cerr << "Cannot decorate " << *it << endl;
+                    result = 1;
+                } else if (!verified) {
+                    cerr << "The moves of " << output_name << " differ from the ones of " << *it << endl;
+                    result = 1;
+                } else if (!curves_written) {
+                    result = 1;
+                } else if (params.get_print_stats()) {
+                    float seconds = chrono::duration<float>(end - start).count();
+                    uintmax_t input_size = io ? buffer.data.size() : boost::filesystem::file_size(*it);
+                    cerr << *it << ": " << emitted_messages << " messages, decorated in " << seconds << "s ("
+                        << input_size / seconds / 1e6 << " MB/s), input " << input_size << " bytes";
+                    if (!output_name.empty()) {
+                        cerr << ", output " << output_size << " bytes (" << showpos << 100.0 * ((double)output_size - input_size) / input_size
+                            << noshowpos << "%)";
+                    }
+                    cerr << endl;
+                }
             }
-
-            input.close();
         }
+        if (io && !io->finish())
+            result = 1;
+        return result;
     }
     return 0;
 }
@@ -0,0 +1,124 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Checks that estimating a file does not allocate on the heap once the estimator and its input are
+// set up. Every operator new of the program is replaced by one that counts the calls
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "Config.h"
+#include "GCodeTimeEstimator.h"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+static atomic<uint64_t> allocation_count (0);
+
+void* operator new(size_t size) {
+    allocation_count++;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+// Writes a file with several times the size of the read buffer, with all commands the parser
+// handles, comments and a line longer than usual
+static void write_input(const string &filename) {
+    ofstream file (filename);
+    file << "; allocation test\nG28\nG90\nM82\nG92 E0\nG1 Z0.3 F7800\n";
+    double e = 0.0;
+    for (int layer = 0; layer < 500; layer++) {
+        file << ";LAYER:" << layer << "\nG1 Z" << 0.3 + layer * 0.2 << " F7800\nG92 E0\n";
+        e = 0.0;
+        for (int i = 0; i < 100; i++) {
+            double x = 50.0 + (i % 2 ? 20.0 : 0.0), y = 50.0 + i * 0.4;
+            e += 0.6;
+            file << "G1 X" << x << " Y" << y << " E" << e << " F" << (i % 3 ? 1800 : 3000) << " ; infill\n";
+        }
+        file << "G1 E" << e - 1.5 << " F2400\nG0 X10 Y10 F7800\nG1 E" << e << "\n";
+    }
+    file << ";" << string(1000, 'x') << "\nG28 X0\n";
+}
+
+int main() {
+    fs::path path = fs::temp_directory_path() / fs::unique_path("gcodetimer-%%%%-%%%%.gcode");
+    write_input(path.string());
+    bool ok = fs::file_size(path) > 4 * 256 * 1024;
+    if (!ok)
+        cerr << "test input is smaller than expected" << endl;
+
+    // Writing the input allocated, otherwise the counting operator new is not in use
+    if (allocation_count == 0) {
+        cerr << "allocations are not counted" << endl;
+        ok = false;
+    }
+
+    const MotionModel models[] = { MOTION_CLASSIC_JERK, MOTION_JUNCTION_DEVIATION, MOTION_SQUARE_CORNER_VELOCITY };
+    for (MotionModel model : models) {
+        Config config (path.string() + ".missing");
+        config.motion_model = model;
+
+        ifstream input (path.string(), ifstream::binary);
+        GCodeTimeEstimator estimator (&input, config);
+
+        // The first pass may set up the buffers of the stream
+        estimator.process_file();
+        float first_time = estimator.get_estimated_time();
+
+        input.clear();
+        input.seekg(0);
+        uint64_t before = allocation_count;
+        estimator.process_file();
+        uint64_t allocations = allocation_count - before;
+
+        printf("model %d: %llu lines, %.1f s, %llu allocations\n", (int)model, (unsigned long long)estimator.get_line_count(),
+               estimator.get_estimated_time(), (unsigned long long)allocations);
+        if (allocations != 0) {
+            cerr << "model " << model << ": " << allocations << " allocations while processing" << endl;
+            ok = false;
+        }
+        if (estimator.get_estimated_time() != first_time || estimator.get_move_count() == 0) {
+            cerr << "model " << model << ": second pass differs from the first" << endl;
+            ok = false;
+        }
+    }
+
+    fs::remove(path);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Checks that --compact output moves the printer exactly like its input: the moves of both, as
+// seen by the estimator (see MoveDigest), have to be bit-identical, on an input with everything
+// the compactor rewrites or has to leave alone
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "Config.h"
+#include "FileProcessor.h"
+#include "GCodeCompactor.h"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+static string get_input() {
+    ostringstream file;
+    file << "; compact test\nM104 S200 ; hotend\nG28\nG90\nM82\nG92 E0\nG1 Z000.300 F7800.0\r\nM117 Printing  ; text stays\n";
+    double e = 0.0;
+    for (int layer = 0; layer < 40; layer++) {
+        file << ";LAYER:" << layer << "\n\nG1 Z" << 0.3 + layer * 0.2 << " F7800\n";
+        for (int i = 0; i < 50; i++) {
+            double x = 50.0 + (i % 2 ? 20.0 : 0.0), y = 50.0 + (i / 2) * 0.4;
+            e += 0.5;
+            // Repeated feed rates and coordinates, '+' signs and padded numbers
+            char move[128];
+            snprintf(move, sizeof(move), "G1 X+%g Y%08.3f E%.5f F1800.00 ; infill\n", x, y, e);
+            file << move;
+            if (i % 10 == 9)
+                file << "G1 X" << x << " Y" << y << " F1800\n";
+        }
+        // Relative moves, rapid moves, a tool change and a line number all reset what is known
+        file << "G91\nG1 Z0.4 E-1 F2400\nG90\nG0 X10 Y10 F9000\nT0\nN10 G1 X20 Y20*33\nG92 E" << e << "\n";
+    }
+    return file.str();
+}
+
+int main() {
+    string text = get_input();
+    vector<char> input (text.begin(), text.end());
+    fs::path path = fs::temp_directory_path() / fs::unique_path("gcodetimer-%%%%-%%%%.gcode");
+    Config config (path.string() + ".missing");
+
+    FileProcessor processor (EmissionPolicy(), false, NULL, false, false, true, -1.0, config);
+    float total_time;
+    uint64_t emitted_messages;
+    vector<char> output;
+    bool ok = processor.estimate(string(), input, total_time) && processor.decorate(input, output, total_time, emitted_messages);
+    if (!ok)
+        cerr << "cannot decorate the test input" << endl;
+
+    string output_text (output.begin(), output.end());
+    istringstream input_stream (text), output_stream (output_text);
+    MoveDigest input_moves (&input_stream, config), output_moves (&output_stream, config);
+    input_moves.process_file();
+    output_moves.process_file();
+
+    printf("%zu bytes compacted to %zu, digest %016llx, %.3f s\n", input.size(), output.size(), (unsigned long long)input_moves.get_digest(),
+           input_moves.get_total_time());
+    if (input_moves.get_total_time() <= 0 || input_moves.get_digest() != output_moves.get_digest()
+            || input_moves.get_total_time() != output_moves.get_total_time()) {
+        cerr << "the compact output moves differently from the input" << endl;
+        ok = false;
+    }
+    if (output.size() >= input.size() || output_text.find("; infill") != string::npos || output_text.find("M117 Printing  ; text stays") == string::npos) {
+        cerr << "comments were not removed or a message was changed" << endl;
+        ok = false;
+    }
+    if (!processor.verify(input, output)) {
+        cerr << "--verify rejects the compact output" << endl;
+        ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Checks that --parallel writes exactly what the stream decorator writes, for policies that
+// decide their messages per chunk and for policies that carry state across chunks, on a file of
+// several chunks that was decorated before
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "ChunkedDecorator.h"
+#include "Config.h"
+#include "FileProcessor.h"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+// Writes about 12 MB of short moves, three chunks of the parallel decorator
+static void write_input(const fs::path &path) {
+    ofstream file (path.string());
+    file << "G28\nG90\nM82\nG92 E0\n";
+    double e = 0.0;
+    for (int layer = 0; layer < 300; layer++) {
+        file << ";LAYER:" << layer << "\nG1 Z" << 0.2 + layer * 0.2 << " F600\n";
+        for (int i = 0; i < 1500; i++) {
+            e += 0.01;
+            char move[96];
+            snprintf(move, sizeof(move), "G1 X%.3f Y%.3f E%.5f F%d\n", 50.0 + (i % 7) * 1.3, 50.0 + (i % 11) * 0.7, e, 1200 + (i % 5) * 600);
+            file << move;
+        }
+    }
+}
+
+static string read_file(const fs::path &path) {
+    ifstream file (path.string(), ios::binary);
+    return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+static bool check_policy(const char *name, const EmissionPolicy &policy, const fs::path &input, const Config &config) {
+    fs::path sequential_path = input.string() + ".sequential", parallel_path = input.string() + ".parallel";
+    FileProcessor processor (policy, false, NULL, false, false, false, -1.0, config);
+    float total_time;
+    uint64_t sequential_messages;
+    if (!processor.estimate(input.string(), total_time) || !processor.decorate(input.string(), sequential_path.string(), total_time, sequential_messages)) {
+        cerr << name << ": cannot decorate" << endl;
+        return false;
+    }
+
+    ChunkedDecorator decorator (total_time, policy, config);
+    if (!decorator.decorate(input.string(), parallel_path.string())) {
+        cerr << name << ": the parallel decorator failed" << endl;
+        return false;
+    }
+
+    string sequential = read_file(sequential_path), parallel = read_file(parallel_path);
+    fs::remove(sequential_path);
+    fs::remove(parallel_path);
+    printf("%s: %zu bytes, %llu messages\n", name, sequential.size(), (unsigned long long)sequential_messages);
+    if (sequential != parallel || decorator.get_emitted_messages() != sequential_messages) {
+        cerr << name << ": the parallel output differs from the sequential one" << endl;
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    fs::path path = fs::temp_directory_path() / fs::unique_path("gcodetimer-%%%%-%%%%.gcode");
+    Config config (path.string() + ".missing");
+
+    // Decorated once, so that old messages are dropped as well
+    fs::path plain_path = path.string() + ".plain";
+    write_input(plain_path);
+    FileProcessor processor (EmissionPolicy(), false, NULL, false, false, false, -1.0, config);
+    float total_time;
+    uint64_t emitted_messages;
+    if (!processor.estimate(plain_path.string(), total_time) || !processor.decorate(plain_path.string(), path.string(), total_time, emitted_messages)) {
+        cerr << "cannot decorate the test input" << endl;
+        return 1;
+    }
+    fs::remove(plain_path);
+
+    EmissionPolicy policy;
+    bool ok = check_policy("M117", policy, path, config);
+    policy.format = EmissionPolicy::FORMAT_BOTH;
+    policy.adaptive = true;
+    ok = check_policy("M117 and M73, adaptive", policy, path, config) && ok;
+    policy = EmissionPolicy();
+    policy.format = EmissionPolicy::FORMAT_M73;
+    policy.min_interval = 45.0;
+    ok = check_policy("M73, 45 s interval", policy, path, config) && ok;
+    policy = EmissionPolicy();
+    policy.min_lines = 5000;
+    ok = check_policy("5000 lines", policy, path, config) && ok;
+    policy = EmissionPolicy();
+    policy.layers_only = true;
+    ok = check_policy("layers only", policy, path, config) && ok;
+
+    fs::remove(path);
+    return ok ? 0 : 1;
+}
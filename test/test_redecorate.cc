@@ -0,0 +1,150 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Checks that decorating a decorated file again gives the same file: the old header and messages
+// are replaced instead of stacked, with any emission policy, and the estimate is read back from
+// the header only for the settings it was written with
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "Config.h"
+#include "FileProcessor.h"
+#include "GCodeTimeDecorator.h"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+static string get_input(const string &first_line) {
+    ostringstream file;
+    file << first_line << "\nG28\nG90\nM82\nG92 E0\n";
+    double e = 0.0;
+    for (int layer = 0; layer < 20; layer++) {
+        file << ";LAYER:" << layer << "\nG1 Z" << 0.3 + layer * 0.2 << " F7800\n";
+        for (int i = 0; i < 40; i++) {
+            e += 0.5;
+            file << "G1 X" << 50 + (i % 2) * 30 << " Y" << 50 + i << " E" << e << " F1800\n";
+        }
+    }
+    return file.str();
+}
+
+static size_t count_lines(const string &text, const string &prefix) {
+    size_t count = 0;
+    for (size_t start = 0; start < text.size(); ) {
+        size_t end = min(text.find('\n', start), text.size());
+        if (text.compare(start, prefix.size(), prefix) == 0)
+            count++;
+        start = end + 1;
+    }
+    return count;
+}
+
+static bool decorate(FileProcessor &processor, const string &input, string &output, uint64_t &emitted_messages) {
+    vector<char> contents (input.begin(), input.end()), decorated;
+    float total_time;
+    if (!processor.estimate(string(), contents, total_time) || !processor.decorate(contents, decorated, total_time, emitted_messages))
+        return false;
+    output.assign(decorated.begin(), decorated.end());
+    return true;
+}
+
+// Decorates input twice and checks that the second pass changes nothing
+static bool check_redecorate(const char *name, const EmissionPolicy &policy, bool compact, const string &input, const Config &config) {
+    FileProcessor processor (policy, false, NULL, false, false, compact, -1.0, config);
+    string once, twice;
+    uint64_t emitted_once, emitted_twice;
+    if (!decorate(processor, input, once, emitted_once) || !decorate(processor, once, twice, emitted_twice)) {
+        cerr << name << ": cannot decorate" << endl;
+        return false;
+    }
+
+    size_t messages = count_lines(twice, "M117 ETR ") + count_lines(twice, "M73 P");
+    size_t totals = count_lines(twice, "M117 TTL ");
+    printf("%s: %zu bytes, %llu messages\n", name, twice.size(), (unsigned long long)emitted_twice);
+    bool ok = true;
+    if (once != twice) {
+        cerr << name << ": decorating the output again changes it" << endl;
+        ok = false;
+    }
+    if (totals != 1 || count_lines(twice, "; ---") != 2 || emitted_once != emitted_twice || emitted_once == 0
+            || messages != emitted_once * (policy.format == EmissionPolicy::FORMAT_BOTH ? 2 : 1) + (policy.format == EmissionPolicy::FORMAT_M117 ? 0 : 1)) {
+        cerr << name << ": " << totals << " totals and " << messages << " messages for " << emitted_once << " emitted" << endl;
+        ok = false;
+    }
+    return ok;
+}
+
+int main() {
+    fs::path path = fs::temp_directory_path() / fs::unique_path("gcodetimer-%%%%-%%%%.gcode");
+    Config config (path.string() + ".missing");
+    string input = get_input("; generated");
+
+    EmissionPolicy policy;
+    bool ok = check_redecorate("M117", policy, false, input, config);
+    ok = check_redecorate("M117, compact", policy, true, input, config) && ok;
+    policy.format = EmissionPolicy::FORMAT_BOTH;
+    ok = check_redecorate("M117 and M73", policy, false, input, config) && ok;
+    policy.format = EmissionPolicy::FORMAT_M73;
+    policy.min_interval = 30.0;
+    ok = check_redecorate("M73, 30 s interval", policy, false, input, config) && ok;
+    policy = EmissionPolicy();
+    policy.layers_only = true;
+    ok = check_redecorate("layers only, compact", policy, true, input, config) && ok;
+
+    // Messages of the user in a file that was not decorated stay
+    string user_input = get_input("M117 TTL from the user\nM117 ETR 00h00m01s");
+    string output;
+    uint64_t emitted_messages;
+    FileProcessor processor (EmissionPolicy(), false, NULL, false, false, false, -1.0, config);
+    if (!decorate(processor, user_input, output, emitted_messages) || output.find("\nM117 TTL from the user\nM117 ETR 00h00m01s\n") == string::npos) {
+        cerr << "messages of the user were removed" << endl;
+        ok = false;
+    }
+
+    // The header only gives the estimate back for the same settings
+    vector<char> contents (input.begin(), input.end()), decorated;
+    float total_time, read_time;
+    if (!processor.estimate(string(), contents, total_time) || !processor.decorate(contents, decorated, total_time, emitted_messages)) {
+        cerr << "cannot decorate" << endl;
+        return 1;
+    }
+    string decorated_text (decorated.begin(), decorated.end());
+    istringstream header (decorated_text), other_header (decorated_text);
+    if (!GCodeTimeDecorator::read_header(&header, config.get_hash(), read_time) || read_time != total_time) {
+        cerr << "the header does not give back the estimate" << endl;
+        ok = false;
+    }
+    Config other_config (config);
+    other_config.max_print_accel.x *= 2;
+    if (GCodeTimeDecorator::read_header(&other_header, other_config.get_hash(), read_time)) {
+        cerr << "the header is accepted for other settings" << endl;
+        ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
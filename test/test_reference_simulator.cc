@@ -0,0 +1,122 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Checks the reference simulator against the analytic trapezoid of a single long straight move,
+// which accelerates from the entry speed of the firmware to the feed rate, cruises and slows down
+// to the exit speed
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "Config.h"
+#include "MoveTable.h"
+#include "ReferenceSimulator.h"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+static const double LENGTH = 200.0;         // mm
+static const double SPEED = 100.0;          // mm/s
+static const double ACCELERATION = 1000.0;  // mm/s^2
+static const double JERK = 10.0;            // mm/s
+static const double STEPS_PER_MM = 80.0;
+
+// Duration of a trapezoid that reaches the cruise speed
+static double get_trapezoid_duration(double length, double entry_speed, double exit_speed) {
+    double accel_d = (SPEED * SPEED - entry_speed * entry_speed) / (2 * ACCELERATION);
+    double decel_d = (SPEED * SPEED - exit_speed * exit_speed) / (2 * ACCELERATION);
+    return (SPEED - entry_speed) / ACCELERATION + (SPEED - exit_speed) / ACCELERATION + (length - accel_d - decel_d) / SPEED;
+}
+
+// Returns the simulated duration of a single move along X, or -1 if it cannot be loaded or is dropped
+static double simulate(const string &filename, double length, const Config &config, uint64_t &steps) {
+    {
+        ofstream file (filename);
+        file << "G1 X" << length << " F" << SPEED * 60 << "\n";
+    }
+    MoveTable table (filename);
+    if (!table.load() || table.size() != 1)
+        return -1.0;
+
+    ReferenceSimulator simulator (config);
+    vector<float> durations (table.size());
+    uint64_t dropped;
+    double duration = simulator.simulate(table, durations, dropped);
+    steps = simulator.get_step_count();
+    return dropped == 0 ? duration : -1.0;
+}
+
+int main() {
+    fs::path path = fs::temp_directory_path() / fs::unique_path("gcodetimer-%%%%-%%%%.gcode");
+
+    // Marlin cannot step slower than its minimal step rate, which is where its trapezoids start
+    // and end unless the jerk allows more. Its stepper interrupt sets the rate once per step, so
+    // each ramp may be off by one step interval at its slowest rate. Klipper starts and ends at a
+    // standstill and times its steps exactly
+    double minimal_speed = max((double)ReferenceSimulator::MINIMUM_PLANNER_SPEED, ReferenceSimulator::MINIMAL_STEP_RATE / STEPS_PER_MM);
+    const struct {
+        MotionModel model;
+        double entry_speed, exit_speed, tolerance;  // s
+    } cases[] = {
+        { MOTION_CLASSIC_JERK, JERK, minimal_speed, 1 / (JERK * STEPS_PER_MM) + 1 / (minimal_speed * STEPS_PER_MM) },
+        { MOTION_JUNCTION_DEVIATION, minimal_speed, minimal_speed, 2 / (minimal_speed * STEPS_PER_MM) },
+        { MOTION_SQUARE_CORNER_VELOCITY, 0.0, 0.0, 0.0001 },
+    };
+
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        Config config (path.string() + ".missing");
+        config.motion_model = cases[i].model;
+        config.max_move_accel.x = ACCELERATION;
+        config.max_jerk.x = JERK;
+        config.steps_per_mm.x = STEPS_PER_MM;
+
+        uint64_t steps, long_steps;
+        double expected = get_trapezoid_duration(LENGTH, cases[i].entry_speed, cases[i].exit_speed);
+        double simulated = simulate(path.string(), LENGTH, config, steps);
+        double long_simulated = simulate(path.string(), 2 * LENGTH, config, long_steps);
+
+        printf("model %d: simulated %.6f s, analytic %.6f s, %.6f s longer at twice the length\n", (int)cases[i].model, simulated, expected,
+               long_simulated - simulated);
+        if (simulated < 0.0 || long_simulated < 0.0 || steps != (uint64_t)llround(LENGTH * STEPS_PER_MM)
+                || long_steps != (uint64_t)llround(2 * LENGTH * STEPS_PER_MM)) {
+            cerr << "model " << cases[i].model << ": the move was not simulated" << endl;
+            ok = false;
+        } else if (abs(simulated - expected) > cases[i].tolerance) {
+            cerr << "model " << cases[i].model << ": the simulated move does not match the analytic trapezoid" << endl;
+            ok = false;
+        } else if (abs(long_simulated - simulated - LENGTH / SPEED) > 0.0001) {
+            // Only the cruise phase gets longer
+            cerr << "model " << cases[i].model << ": the cruise phase does not take length / speed" << endl;
+            ok = false;
+        }
+    }
+
+    fs::remove(path);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+/**
+ * gcodetimer
+ *
+ * Copyright © 2016 Juan Jose Gonzalez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ * sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or
+ * substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Checks that the result cache only gives back what was stored for the same file contents, config
+// values, estimator settings and, for the edits of a decorated file, emission policy and total
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "Config.h"
+#include "FileProcessor.h"
+#include "ResultCache.h"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+static void write_file(const fs::path &path, const string &text) {
+    ofstream file (path.string(), ios::binary);
+    file << text;
+}
+
+static bool check(const char *name, bool hit, bool expected) {
+    printf("%s: %s\n", name, hit ? "hit" : "miss");
+    if (hit != expected)
+        cerr << name << ": expected a " << (expected ? "hit" : "miss") << endl;
+    return hit == expected;
+}
+
+int main() {
+    fs::path folder = fs::temp_directory_path() / fs::unique_path("gcodetimer-%%%%-%%%%");
+    fs::path path = folder.string() + ".gcode";
+    write_file(path, "G28\nG1 X10 Y10 F1800\nG1 X20 E1\n");
+    Config config (path.string() + ".missing");
+
+    uint64_t settings = FileProcessor::get_settings_hash(config, false, -1.0);
+    bool ok = true;
+    float time;
+    {
+        ResultCache cache (folder.string(), 1 << 20, config);
+        cache.put_time(path.string(), settings, 12.5f);
+        ok = check("same settings", cache.get_time(path.string(), settings, time) && time == 12.5f, true) && ok;
+        ok = check("memoized", cache.get_time(path.string(), FileProcessor::get_settings_hash(config, true, -1.0), time), false) && ok;
+        ok = check("direction tolerance", cache.get_time(path.string(), FileProcessor::get_settings_hash(config, false, 0.01), time), false) && ok;
+
+        EmissionPolicy policy;
+        vector<EDIT> edits = { { 0, 0, 0, 5 } }, read_edits;
+        string text, read_text;
+        uint64_t emitted_messages;
+        cache.put_edits(path.string(), settings, policy, 12.5f, edits, "M117\n", 3);
+        ok = check("same edits", cache.get_edits(path.string(), settings, policy, 12.5f, read_edits, read_text, emitted_messages)
+                   && read_edits.size() == 1 && read_text == "M117\n" && emitted_messages == 3, true) && ok;
+        ok = check("other total", cache.get_edits(path.string(), settings, policy, 13.0f, read_edits, read_text, emitted_messages), false) && ok;
+        policy.min_interval = 10;
+        ok = check("other policy", cache.get_edits(path.string(), settings, policy, 12.5f, read_edits, read_text, emitted_messages), false) && ok;
+    }
+
+    // The config is part of the key of every entry, not only of the estimator settings
+    Config other_config (config);
+    other_config.max_jerk.x *= 2;
+    {
+        ResultCache cache (folder.string(), 1 << 20, other_config);
+        ok = check("other config", cache.get_time(path.string(), settings, time), false) && ok;
+    }
+
+    // Same size, but other contents and a later modification time
+    write_file(path, "G28\nG1 X10 Y10 F1800\nG1 X30 E1\n");
+    fs::last_write_time(path, fs::last_write_time(path) + 10);
+    {
+        ResultCache cache (folder.string(), 1 << 20, config);
+        ok = check("changed file", cache.get_time(path.string(), settings, time), false) && ok;
+    }
+
+    fs::remove_all(folder);
+    fs::remove(path);
+    return ok ? 0 : 1;
+}